@@ -0,0 +1,293 @@
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/db.h"
+
+// Usage: db_bench <benchmark> [num_records] [num_buf]
+// Each benchmark builds its tables from scratch in the current directory.
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_sec(bench_clock::time_point start)
+{
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static void make_records(int num_records, std::vector<int64_t>* keys,
+    std::vector<std::string>* values)
+{
+    keys->resize(num_records);
+    values->resize(num_records);
+    for(int i = 0; i < num_records; i++)
+    {
+        (*keys)[i] = i + 1;
+        (*values)[i] = "benchmark record #" + std::to_string(i + 1);
+    }
+
+    // rows come in no particular order.
+    std::shuffle(keys->begin(), keys->end(), std::mt19937(2021));
+}
+
+// per-row db_insert against db_insert_batch
+static void bench_insert_batch(int num_records)
+{
+    std::vector<int64_t> keys;
+    std::vector<std::string> values;
+    make_records(num_records, &keys, &values);
+
+    remove("bench_insert_row.db");
+    remove("bench_insert_batch.db");
+    int64_t row_table = open_table("bench_insert_row.db");
+    int64_t batch_table = open_table("bench_insert_batch.db");
+
+    auto start = bench_clock::now();
+    for(int i = 0; i < num_records; i++)
+    {
+        db_insert(row_table, keys[i], values[keys[i] - 1].c_str(),
+            values[keys[i] - 1].size());
+    }
+    double row_sec = elapsed_sec(start);
+
+    std::vector<const char*> value_ptrs(num_records);
+    std::vector<uint16_t> val_sizes(num_records);
+    for(int i = 0; i < num_records; i++)
+    {
+        value_ptrs[i] = values[keys[i] - 1].c_str();
+        val_sizes[i] = values[keys[i] - 1].size();
+    }
+
+    start = bench_clock::now();
+    int num_inserted = db_insert_batch(batch_table, keys, value_ptrs, val_sizes);
+    double batch_sec = elapsed_sec(start);
+
+    printf("insert_batch: %d records\n", num_records);
+    printf("  db_insert       %10.3f sec %12.0f records/sec\n",
+        row_sec, num_records / row_sec);
+    printf("  db_insert_batch %10.3f sec %12.0f records/sec (%d inserted)\n",
+        batch_sec, num_records / batch_sec, num_inserted);
+}
+
+struct sorted_records_t
+{
+    const std::vector<std::string>* values;
+    int next;
+};
+
+static bool next_sorted_record(void* arg, int64_t* key, const char** value,
+    uint16_t* val_size)
+{
+    auto records = (sorted_records_t*)arg;
+    if(records->next == (int)records->values->size()) return false;
+
+    *key = records->next + 1;
+    *value = (*records->values)[records->next].c_str();
+    *val_size = (*records->values)[records->next].size();
+    records->next++;
+    return true;
+}
+
+// per-row db_insert of sorted records against db_bulk_load
+static void bench_bulk_load(int num_records)
+{
+    std::vector<int64_t> keys;
+    std::vector<std::string> values;
+    make_records(num_records, &keys, &values);
+
+    remove("bench_load_row.db");
+    remove("bench_load_bulk.db");
+    int64_t row_table = open_table("bench_load_row.db");
+    int64_t bulk_table = open_table("bench_load_bulk.db");
+
+    auto start = bench_clock::now();
+    for(int i = 0; i < num_records; i++)
+    {
+        db_insert(row_table, i + 1, values[i].c_str(), values[i].size());
+    }
+    double row_sec = elapsed_sec(start);
+
+    sorted_records_t records = { &values, 0 };
+    start = bench_clock::now();
+    int num_loaded = db_bulk_load(bulk_table, next_sorted_record, &records);
+    double bulk_sec = elapsed_sec(start);
+
+    printf("bulk_load: %d records\n", num_records);
+    printf("  db_insert       %10.3f sec %12.0f records/sec\n",
+        row_sec, num_records / row_sec);
+    printf("  db_bulk_load    %10.3f sec %12.0f records/sec (%d loaded)\n",
+        bulk_sec, num_records / bulk_sec, num_loaded);
+}
+
+// drop the pages of the file from the OS cache, so they are read from disk.
+static void drop_file_cache(const char* pathname)
+{
+    int fd = open(pathname, O_RDONLY);
+    if(fd < 0) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+// full scan of a cold table with each readahead window
+static void bench_scan(int num_records, int num_buf)
+{
+    std::vector<int64_t> keys;
+    std::vector<std::string> values;
+    make_records(num_records, &keys, &values);
+
+    // records are inserted in no order, so leaves are not laid out in order.
+    remove("bench_scan.db");
+    int64_t table_id = open_table("bench_scan.db");
+
+    std::vector<const char*> value_ptrs(num_records);
+    std::vector<uint16_t> val_sizes(num_records);
+    for(int i = 0; i < num_records; i++)
+    {
+        value_ptrs[i] = values[keys[i] - 1].c_str();
+        val_sizes[i] = values[keys[i] - 1].size();
+    }
+    db_insert_batch(table_id, keys, value_ptrs, val_sizes);
+    shutdown_db();
+
+    struct stat file_stat;
+    stat("bench_scan.db", &file_stat);
+    double file_mb = file_stat.st_size / (1024.0 * 1024.0);
+
+    printf("scan: %d records, %.1f MB file\n", num_records, file_mb);
+    for(int window : { 0, 8, 32, 128 })
+    {
+        drop_file_cache("bench_scan.db");
+        init_db(num_buf);
+        table_id = open_table("bench_scan.db");
+        db_set_scan_readahead(window);
+
+        int64_t key;
+        const char* value;
+        uint16_t val_size;
+        size_t num_bytes = 0;
+        int num_scanned = 0;
+
+        auto start = bench_clock::now();
+        ScanCursor* cursor = db_scan_open(table_id, 1, num_records);
+        while(db_scan_next(cursor, &key, &value, &val_size) == 0)
+        {
+            num_bytes += sizeof(key) + val_size;
+            num_scanned++;
+        }
+        db_scan_close(cursor);
+        double sec = elapsed_sec(start);
+
+        printf("  readahead %4d   %10.3f sec %12.0f records/sec %8.1f MB/s"
+            " (%d scanned)\n", window, sec, num_scanned / sec,
+            num_bytes / (1024.0 * 1024.0) / sec, num_scanned);
+        shutdown_db();
+    }
+    init_db(num_buf);
+}
+
+// projection of an attribute range through an index, reading the amount
+// from each record against reading it from the index entries.
+static void bench_covering(int num_records, int num_buf)
+{
+    // rows have an attribute at 0, and an amount at 4.
+    std::mt19937 gen(2022);
+    std::vector<std::string> values(num_records);
+    for(auto& value : values)
+    {
+        int32_t attribute = gen() % 1000;
+        int64_t amount = gen() % 100000;
+        value.assign(100, ' ');
+        memcpy(&value[0], &attribute, 4);
+        memcpy(&value[4], &amount, 8);
+    }
+
+    remove("bench_covering.db");
+    int64_t table_id = open_table("bench_covering.db");
+    sorted_records_t records = { &values, 0 };
+    db_bulk_load(table_id, next_sorted_record, &records);
+    int plain_index = db_create_index(table_id, 0);
+    int covering_index = db_create_index(table_id, 0, 4, 8);
+    shutdown_db();
+
+    printf("covering: %d records, attributes 0 to 9 of 1000\n", num_records);
+    for(int index_id : { plain_index, covering_index })
+    {
+        drop_file_cache("bench_covering.db");
+        init_db(num_buf);
+        table_id = open_table("bench_covering.db");
+
+        std::vector<int64_t> keys;
+        std::vector<std::string> included;
+        int64_t total = 0;
+
+        auto start = bench_clock::now();
+        if(index_id == plain_index)
+        {
+            db_index_find(table_id, index_id, 0, 9, &keys);
+            for(int64_t key : keys)
+            {
+                int64_t amount;
+                uint16_t read_size;
+                db_read_value(table_id, key, 4, (char*)&amount, 8, &read_size);
+                total += amount;
+            }
+        }
+        else
+        {
+            db_index_find(table_id, index_id, 0, 9, &keys, &included);
+            for(auto& bytes : included)
+            {
+                int64_t amount;
+                memcpy(&amount, bytes.data(), 8);
+                total += amount;
+            }
+        }
+        double sec = elapsed_sec(start);
+
+        printf("  %-15s %10.3f sec %12.0f rows/sec (%zu rows, total %ld)\n",
+            (index_id == plain_index) ? "record lookups" : "covering index",
+            sec, keys.size() / sec, keys.size(), (long)total);
+        shutdown_db();
+    }
+    init_db(num_buf);
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <benchmark> [num_records] [num_buf]\n"
+            "benchmarks: insert_batch bulk_load scan covering\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::string name = argv[1];
+    int num_records = (argc > 2) ? atoi(argv[2]) : 1000000;
+    int num_buf = (argc > 3) ? atoi(argv[3]) : 100000;
+
+    init_db(num_buf);
+
+    if(name == "insert_batch") bench_insert_batch(num_records);
+    else if(name == "bulk_load") bench_bulk_load(num_records);
+    else if(name == "scan") bench_scan(num_records, num_buf);
+    else if(name == "covering") bench_covering(num_records, num_buf);
+    else
+    {
+        fprintf(stderr, "unknown benchmark: %s\n", name.c_str());
+        return EXIT_FAILURE;
+    }
+
+    shutdown_db();
+    return EXIT_SUCCESS;
+}
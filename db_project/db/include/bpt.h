@@ -7,8 +7,12 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <functional>
 #include <vector>
 
+#include "file.h"
+#include "mvcc.h"
+
 
 #ifdef WINDOWS
 #define bool char
@@ -19,6 +23,14 @@
 // Default order is 4.
 #define DEFAULT_ORDER 4
 
+// Bytes of records moved to the left leaf when a leaf is split,
+// which is half of the space after the header.
+#define LEAF_SPLIT_SIZE ((PAGE_SIZE - 128) / 2)
+
+// A leaf with this much free space takes records from its neighbor,
+// or is merged into it. It is 2500 bytes of a 4 KiB page.
+#define LEAF_MERGE_FREE_SPACE (PAGE_SIZE / 4096 * 2500)
+
 // Constants for printing part or all of the GPL license.
 #define LICENSE_FILE "LICENSE.txt"
 #define LICENSE_WARRANTEE 0
@@ -128,20 +140,69 @@ void print_license( int licence_part );
 void find_and_print(node * root, int key, bool verbose); 
 void find_and_print_range(node * root, int range1, int range2, bool verbose); 
 int find_range(int64_t table_id, pagenum_t root, int64_t key_start, int64_t key_end,
-    std::vector<int64_t> * keys, std::vector<char*> * values, std::vector<uint16_t> * val_sizes);
+    std::vector<int64_t> * keys, std::vector<char*> * values,
+    std::vector<uint16_t> * val_sizes, int trx_id);
+int find_range_snapshot(int64_t table_id, pagenum_t root, int64_t key_start,
+    int64_t key_end, std::vector<int64_t> * keys, std::vector<char*> * values,
+    std::vector<uint16_t> * val_sizes, const ReadView& view);
+int find_range_locking(int64_t table_id, pagenum_t root, int64_t key_start,
+    int64_t key_end, std::vector<int64_t> * keys, std::vector<char*> * values,
+    std::vector<uint16_t> * val_sizes, int trx_id);
+bool range_keys_in_leaf(page_t* leaf_p, int64_t key_start,
+    int64_t key_end, std::vector<int64_t>* lock_keys);
+int64_t find_next_key(int64_t table_id, pagenum_t leaf, int64_t key, int trx_id);
+
+void find_leaves_many(int64_t table_id, pagenum_t root, const int64_t* keys,
+    int num_keys, bool prefetch,
+    const std::function<void(page_t& leaf_p, int begin, int end)>& visit,
+    int trx_id);
+
+/* While it exists, find_leaf keeps the pages above the leaf latched
+ * instead of releasing them on the way down. Readers latch pages from
+ * the root down, holding a parent while they wait for its child, so
+ * a writer which holds a leaf must not wait for its parent. Writers make
+ * one with the header latched, so that the parents are latched already
+ * when a node is split or merged. Only the outermost one of a thread
+ * keeps pages.
+ */
+struct LatchedPath
+{
+    std::vector<struct BufferBlockPointer>* pages;
+
+    LatchedPath();
+    ~LatchedPath();
+
+    LatchedPath(const LatchedPath&) = delete;
+    LatchedPath& operator=(const LatchedPath&) = delete;
+};
+
+void visit_leaves(int64_t table_id, pagenum_t root,
+    const std::function<void(page_t& leaf_p)>& visit, int trx_id);
 
 record* find_record(int64_t table_id,
     pagenum_t root, int64_t key, int trx_id);
 struct BufferBlockPointer find_leaf(int64_t table_id,
-    pagenum_t root, int64_t key, int trx_id);
+    pagenum_t root, int64_t key, int trx_id, int64_t* upper_bound = nullptr,
+    int64_t* lower_bound = nullptr);
+struct BufferBlockPointer find_leaf_hashed(int64_t table_id,
+    pagenum_t root, int64_t key, int trx_id, int* index);
 
 
 int cut( int length );
 
+// Leaf formats.
+bool table_delta_leaves(int64_t table_id);
+bool leaf_delta_base(int64_t low, int64_t high, int64_t* base);
+void leaf_set_format(page_t* leaf, bool delta, int64_t base_key);
+bool leaf_to_plain(page_t* leaf);
+
 // Insertion.
 bool insert_into_leaf(page_t* leaf, const record* src);
+bool update_in_leaf(page_t* leaf, int index, const char* value,
+    uint16_t new_size);
 pagenum_t insert_into_leaf_after_splitting(
-    int64_t table_id, pagenum_t root, pagenum_t leaf, const record* src);
+    int64_t table_id, pagenum_t root, pagenum_t leaf, const record* src,
+    int split_size = LEAF_SPLIT_SIZE);
 bool insert_into_node(int64_t table_id, pagenum_t n, int64_t key, pagenum_t right);
 pagenum_t insert_into_node_after_splitting(int64_t table_id, pagenum_t root,
     pagenum_t old_node, int64_t key, pagenum_t right);
@@ -2,6 +2,7 @@
 #include <pthread.h>
 #include <stdexcept>
 #include <memory>
+#include <vector>
 
 #include "file.h"
 
@@ -27,7 +28,8 @@ public:
     pthread_mutex_t     mutex;
     pthread_cond_t      cond;
 
-    int              using_trx_id;
+    // thread which holds the latch(mutex) of this block
+    int              using_thread_id;
 
     // whether this is delete waited.
     bool        is_delete_waited;
@@ -53,6 +55,17 @@ public:
     }
 };
 
+// While one of them lives, get_block and get_new_block of this thread wait
+// for a frame to be unpinned, instead of throwing NoSpaceException.
+// Rollback uses it, so that an undo is never stopped halfway. Frames are
+// pinned only during an operation, so one is unpinned soon, unless the
+// pool is too small to hold a path of the tree.
+struct FrameWait
+{
+    FrameWait();
+    ~FrameWait();
+};
+
 struct BufferBlockPointer
 {
     int valid;
@@ -104,13 +117,21 @@ public:
     BufferBlockPointer get_block(int64_t table_id,
         pagenum_t page_num, int trx_id, page_t* content = nullptr);
 
-    BufferBlockPointer get_new_block(int64_t table_id, int trx_id, 
+    BufferBlockPointer get_new_block(int64_t table_id,
         PAGE_TYPE page_type = DEFAULT_PAGE);
 
     void set_delete_waited(BufferBlockPointer bbp);
 
     void get_page(BufferBlockPointer bbp, page_t& page);
 
+    // frame of the block, which can be read in place while bbp is held.
+    const page_t* get_frame(const BufferBlockPointer& bbp);
+
+    // copy the page if it is in the buffer pool, without its latch.
+    // (frames are changed under buffer_manager_latch, so the copy is not
+    // torn, but it may be out of date as soon as it is returned)
+    bool peek_page(int64_t table_id, pagenum_t page_num, page_t* content);
+
     void write_page(BufferBlockPointer bbp, const page_t& content);
 
     void free_page(int64_t table_id, pagenum_t page_num);
@@ -119,6 +140,20 @@ public:
 
     void unpin_page(int64_t table_id, pagenum_t page_num);
 
+    // write pages past the end of the file, without putting them
+    // into the buffer pool. (used by bulk loading, whose pages are
+    // read by no one until the root is set)
+    void write_new_pages(int64_t table_id, pagenum_t first_page,
+        const page_t* pages, int count);
+
+    // set the number of pages in the header, after pages are written
+    // past the end of the file by write_new_pages.
+    void extend_table(int64_t table_id, pagenum_t num_pages);
+
+    // let the pages which are not in the buffer pool be read
+    // in the background, so that get_block finds them in the OS cache.
+    void prefetch_pages(int64_t table_id, std::vector<pagenum_t> pages);
+
     void close_tables();
 
     void clear_pages();
@@ -126,6 +161,17 @@ public:
 private:
     BufferBlock* get_block_pointer(int64_t table_id, pagenum_t page_num);
 
+    // get_block and get_new_block, which throw NoSpaceException even if
+    // FrameWait lives.
+    BufferBlockPointer try_get_block(int64_t table_id, pagenum_t page_num,
+        int trx_id, page_t* content);
+    BufferBlockPointer try_get_new_block(int64_t table_id,
+        PAGE_TYPE page_type);
+
+    // make the buffered header agree with the header in the file.
+    // (buffer_manager_latch should be held)
+    void sync_header(int64_t table_id);
+
 public:
 
     ~BufferManager();
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+
+#include <utility>
+#include <vector>
+
+#include "file.h"
+
+// number of finished pages gathered before they are written at once
+#define BULK_WRITE_PAGES    256
+
+/* Builds a B+ tree from records sorted by key, bottom-up.
+ * Leaves are filled in order up to fill_factor of their space, and
+ * a separator is pushed into the rightmost node of the level above
+ * whenever a node is finished, so every level is built in one pass.
+ * Pages are numbered from the end of the file in the order they are
+ * started, and written past it in runs, without the buffer pool.
+ */
+struct BulkLoader
+{
+    struct level_t
+    {
+        // rightmost node of the level, which is being filled
+        page_t      node;
+        pagenum_t   page_num;
+    };
+
+    int64_t table_id;
+    double fill_factor;
+
+    // whether leaves are made in LEAF_DELTA format
+    bool delta_leaves;
+
+    // page number the next node gets
+    pagenum_t next_page;
+
+    // levels[0] is the leaves, and the last one is the root.
+    std::vector<level_t> levels;
+
+    // finished pages which are not written yet
+    std::vector<std::pair<pagenum_t, page_t>> finished;
+
+    int num_records;
+    int64_t last_key;
+
+    BulkLoader(int64_t table_id, pagenum_t first_page, double fill_factor);
+
+    // returns false if key is not greater than the last one.
+    bool add_record(int64_t key, const char* value, uint16_t val_size);
+
+    // finish every level and write the rest of pages.
+    // returns the root, or 0 if no record has been added.
+    pagenum_t finish();
+
+private:
+    // put key and child into the rightmost node of level, starting
+    // a new node or a new level if needed. returns the parent of child,
+    // which is the parent of the rightmost node below it too.
+    pagenum_t add_child(int level, int64_t key, pagenum_t child);
+
+    // finish the rightmost node of level and start new_page after it.
+    // key separates them, and goes into the level above.
+    void start_next_node(int level, pagenum_t new_page, int64_t key);
+
+    int max_internal_keys() const;
+
+    void add_finished(pagenum_t page_num, const page_t& page);
+
+    // write the finished pages in runs of consecutive page numbers.
+    void write_finished();
+};
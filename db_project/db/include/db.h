@@ -1,6 +1,8 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string>
 #include <vector>
 
 typedef uint64_t pagenum_t;
@@ -9,24 +11,222 @@ typedef uint64_t pagenum_t;
 int64_t open_table(const char* pathname);
 
 //  Insert a ‘key/value’ (i.e., record) with the given size to the data file.
-int db_insert(int64_t table_id, int64_t key, const char * value, uint16_t val_size);
+// A value larger than 992 bytes is kept in a chain of overflow pages, and
+// its leaf holds only the first bytes of it with the first page.
+// If trx_id is given, the key is locked until the trx ends, and the record
+// is deleted again if the trx is aborted.
+int db_insert(int64_t table_id, int64_t key, const char * value, uint16_t val_size,
+    int trx_id = 0);
 
+// Insert records whose keys may be in any order. They are sorted, and each
+// leaf is found once and filled with all of its records, being split only
+// when it is full. Records whose keys exist already are skipped.
+// Returns the number of inserted records, or -1 if the trx is aborted.
+int db_insert_batch(int64_t table_id, const std::vector<int64_t>& keys,
+    const std::vector<const char*>& values,
+    const std::vector<uint16_t>& val_sizes, int trx_id = 0);
+
+// Gives the next record of a bulk load, and returns false at the end.
+// The value must stay valid until the next call.
+typedef bool (*bulk_next_t)(void* arg, int64_t* key, const char** value,
+    uint16_t* val_size);
+
+// Build an empty table from the records given by next, which must be
+// sorted by key. Leaves are filled up to fill_factor of their space, and
+// the tree is built bottom-up with pages written straight to the file.
+// Returns the number of loaded records, or -1 if the table isn't empty,
+// the records are not sorted, or a value needs overflow pages.
+int db_bulk_load(int64_t table_id, bulk_next_t next, void* arg,
+    double fill_factor = 0.9);
+
+// If trx_id is a read-only trx, the record is read from its snapshot.
 int db_find(int64_t table_id, int64_t key, char * ret_val, uint16_t* val_size,
     int trx_id);
 
+// Read len bytes of the value from offset into buf, reading only the
+// overflow pages which hold them. read_size is set to the number of bytes
+// read, which is less than len at the end of the value.
+// Locks and snapshots are handled as db_find does.
+int db_read_value(int64_t table_id, int64_t key, uint16_t offset, char* buf,
+    uint16_t len, uint16_t* read_size, int trx_id = 0);
+
+// Look up many keys at once. Keys are sorted, so each page on their paths
+// is read once, and each leaf is visited once for all of its keys.
+// The value of keys[i] is copied into values + offsets[i], whose size is
+// val_sizes[i], and offsets[i] is -1 if it is not found. If prefetch is set,
+// the leaves to visit are prefetched before they are read.
+// Returns the number of found keys, or -1 if values_size is not enough.
+int db_find_many(int64_t table_id, const std::vector<int64_t>& keys,
+    char* values, size_t values_size, std::vector<int>* offsets,
+    std::vector<uint16_t>* val_sizes, int trx_id = 0, bool prefetch = false);
+
+// Read the version of a record in the snapshot taken at trx_begin().
+// It acquires no record lock, so it never waits for writers.
+int db_find_snapshot(int64_t table_id, int64_t key, char * ret_val,
+    uint16_t* val_size, int trx_id);
+
+// The new value may be larger or smaller than the old one. The leaf is
+// split only if its free space is not enough for the new value.
+// old_val_size is set to the size of the old value. An empty new value
+// is rejected with -1.
 int db_update(int64_t table_id, int64_t key, char* value, uint16_t new_val_size,
     uint16_t* old_val_size, int trx_id);
 
-// this is for rollback
-void db_update_with_page(int table_id, pagenum_t page_num, uint16_t offset,
-    const char* value, uint16_t val_size, int trx_id);
+// Update the record if the key exists, or insert it otherwise,
+// with a single traversal of the tree.
+int db_upsert(int64_t table_id, int64_t key, const char* value,
+    uint16_t val_size, int trx_id = 0);
+
+// these are for rollback, which restore the record by its key.
+void db_undo_update(int64_t table_id, int64_t key, const char* value,
+    uint16_t val_size);
+void db_undo_insert(int64_t table_id, int64_t key);
+void db_undo_delete(int64_t table_id, int64_t key, const char* value,
+    uint16_t val_size, int trx_id);
 
-int db_delete(int64_t table_id, int64_t key);
+// If trx_id is given, the key and the next key are locked until the trx
+// ends, and the record is inserted again if the trx is aborted.
+int db_delete(int64_t table_id, int64_t key, int trx_id = 0);
 
+// Read the records in [begin_key, end_key]. If trx_id is given, the range
+// is protected by next-key locks until the trx ends, so no phantom appears.
 int db_scan (int64_t table_id, int64_t begin_key, int64_t end_key, 
     std::vector<int64_t> * keys, std::vector<char*> * values, 
-    std::vector<uint16_t> * val_sizes);
+    std::vector<uint16_t> * val_sizes, int trx_id = 0);
+
+struct ScanCursor;
+
+// Open a cursor over the records in [begin_key, end_key], which reads them
+// one leaf at a time, so its memory doesn't grow with the range.
+// Locks and snapshots are handled as db_scan does. If descending is set,
+// records are given from end_key down, by the left-sibling links of leaves,
+// so only the leaves with the records read are visited.
+ScanCursor* db_scan_open(int64_t table_id, int64_t begin_key, int64_t end_key,
+    int trx_id = 0, bool descending = false);
+
+// Give the next record of the cursor. The value points into the leaf in
+// the buffer pool(or a copy of its version for read-only trx), and is
+// valid until the next call. The leaf is kept latched meanwhile, so the
+// table shouldn't be changed by this thread before the cursor is closed.
+// Returns 0 if a record is given, 1 at the end of the range, or -1 if the
+// trx is aborted.
+int db_scan_next(ScanCursor* cursor, int64_t* key, const char** value,
+    uint16_t* val_size);
+
+void db_scan_close(ScanCursor* cursor);
+
+// Aggregates of the records in [begin_key, end_key], computed on the leaves
+// in the buffer pool without copying the values out. Locks and snapshots
+// are handled as db_scan does. They return 0 on success, or -1 if the trx
+// is aborted.
+int db_count(int64_t table_id, int64_t begin_key, int64_t end_key,
+    int64_t* count, int trx_id = 0);
+
+// Sum of the values read as int64_t. Returns -1 if a value in the range
+// is not 8 bytes long, too.
+int db_sum(int64_t table_id, int64_t begin_key, int64_t end_key,
+    int64_t* sum, int trx_id = 0);
+
+// The smallest(or the greatest) key in the range, which is found in the
+// first leaf read. Returns -1 if there is no key in the range, too.
+int db_min_key(int64_t table_id, int64_t begin_key, int64_t end_key,
+    int64_t* key, int trx_id = 0);
+int db_max_key(int64_t table_id, int64_t begin_key, int64_t end_key,
+    int64_t* key, int trx_id = 0);
+
+// Records whose keys are byte strings, encoded by key_encode_int64() and
+// key_encode_bytes() in key.h so that memcmp orders them. A composite key
+// is the encodings of its columns one after another. The keys are kept in
+// a tree of their own(key_tree.h), and each record under the int64_t id of
+// its key, so a table should hold either these keys or int64_t keys, not
+// both. Locks and snapshots are handled as with int64_t keys, on that
+// record. A scan in a trx locks the records it reads and the gaps between
+// them in order of keys, as db_scan does, so no key is inserted into its
+// range until the trx ends. A deleted key is taken out of the tree once
+// nothing refers to its id. db_insert_key returns -1 if the key exists, or
+// is longer than KEY_MAX_SIZE.
+int db_insert_key(int64_t table_id, const char* key, uint16_t key_size,
+    const char* value, uint16_t val_size, int trx_id = 0);
+int db_find_key(int64_t table_id, const char* key, uint16_t key_size,
+    char* ret_val, uint16_t* val_size, int trx_id = 0);
+int db_delete_key(int64_t table_id, const char* key, uint16_t key_size,
+    int trx_id = 0);
+
+// Read the records whose keys are in [begin_key, end_key], in order of keys.
+int db_scan_keys(int64_t table_id, const char* begin_key,
+    uint16_t begin_size, const char* end_key, uint16_t end_size,
+    std::vector<std::string>* keys, std::vector<char*>* values,
+    std::vector<uint16_t>* val_sizes, int trx_id = 0);
+
+// Set the number of leaves read ahead by a scan, once it reads leaves one
+// after another. 0 turns readahead off.
+void db_set_scan_readahead(int num_leaves);
+
+// Turn the adaptive hash index on or off. It is on at first, and maps
+// keys looked up again and again by db_find, db_read_value and
+// db_find_snapshot to their leaves, so that their lookups don't descend
+// the tree. Its entries are kept in memory, and dropped when their leaves
+// are split, merged or evicted from the buffer pool.
+void db_set_adaptive_hash(bool enable);
+
+// Number of lookups which used the adaptive hash index, and which
+// descended the tree while it was on.
+void db_adaptive_hash_stats(uint64_t* hits, uint64_t* misses);
+
+// Keep the values read last by db_find in memory, up to capacity bytes,
+// so that db_find and db_read_value of them don't read any page. Locks
+// are still acquired, and read-only trxs read their snapshots instead.
+// A value is dropped whenever its record is changed, or the change is
+// rolled back. The capacity is shared evenly by RECORD_CACHE_PARTITIONS
+// partitions, so a value larger than its share is not kept. It is off(0)
+// at first.
+void db_set_record_cache(size_t capacity);
+
+// Number of reads served by the record cache, and which were not while
+// it was on.
+void db_record_cache_stats(uint64_t* hits, uint64_t* misses);
+
+// Make the new leaves of the table keep their keys as 32-bit deltas from
+// a base key, so that 8-byte slots are used instead of 12-byte ones, and
+// more records fit in a leaf. A leaf whose keys are too far apart stays
+// plain. Existing leaves keep their format until they are split or
+// merged. The setting is kept in the header page.
+// Only leaves are compressed: internal pages keep 16-byte entries, so
+// this doesn't raise the fan-out or lower the height of the tree.
+int db_set_delta_leaves(int64_t table_id, bool enable);
+
+// Keep a Bloom filter of the keys of the table in memory, so that lookups
+// of keys which are not in the table(db_find, db_read_value, db_find_many,
+// db_update, db_delete and the ones of byte-string keys) return without
+// reading the tree. It takes about 10 bits for each key, and is built from
+// the leaves whenever the table is opened. The setting is kept in the
+// header page.
+int db_set_key_filter(int64_t table_id, bool enable);
+
+// Make a secondary index on the int32_t attribute at offset of the values,
+// which is filled from the records of the table, and kept up to date by
+// every change of them, including rollback. Records whose values are too
+// short to have the attribute are not in the index. Changes of a table
+// with indexes hold the header latch, as the ones splitting a leaf do.
+// include_size bytes of the values from include_offset are copied into
+// the index(fewer if a value ends before), up to MAX_INDEX_INCLUDED_SIZE,
+// so that queries reading only them don't look up the records.
+// Returns the id of the index, or -1 if the table has MAX_INDEXES already.
+int db_create_index(int64_t table_id, uint16_t offset,
+    uint16_t include_offset = 0, uint16_t include_size = 0);
+
+// Append the keys of the records whose attributes are in [low, high] to
+// keys, in order of attributes, and their included bytes to included if
+// it is given. Only the index is read, and nothing is locked, so changes
+// of trxs which have not ended are seen, and records should be read by
+// their keys to be read by a trx.
+int db_index_find(int64_t table_id, int index_id, int32_t low, int32_t high,
+    std::vector<int64_t>* keys, std::vector<std::string>* included = nullptr);
 
 int init_db(int num_buf);
 
+// Trxs which are still active are aborted, and the pages are written
+// before the tables are closed. Versions and locks are kept by table id,
+// which a table opened later may have again, so they are dropped too.
+// No operation may be running.
 int shutdown_db();
@@ -7,13 +7,19 @@
 // These definitions are not requirements.
 // You may build your own way to handle the constants.
 #define INITIAL_DB_FILE_SIZE (10 * 1024 * 1024)  // 10 MiB
+
+// Every table has this page size. It is not set per table: frames of the
+// buffer pool are page_t, whose size is fixed, and pages are copied into
+// page_t on every access, so a frame sized by the header of its table
+// would change every path which reads a page.
 #define PAGE_SIZE (4 * 1024)                     // 4 KiB
 
 typedef uint64_t pagenum_t;
 
 enum PAGE_TYPE
 {
-	DEFAULT_PAGE = 0, HEADER_PAGE = 1, FREE_PAGE = 2, LEAF_PAGE = 3, INTERNAL_PAGE = 4
+	DEFAULT_PAGE = 0, HEADER_PAGE = 1, FREE_PAGE = 2, LEAF_PAGE = 3, INTERNAL_PAGE = 4,
+	OVERFLOW_PAGE = 5
 };
 
 struct page_t {
@@ -41,6 +47,12 @@ struct page_t {
 		return *(reinterpret_cast<T*>(c_array + offset));
 	};
 
+	template<typename T>
+	const T& get_pos_value(int offset) const
+	{
+		return *(reinterpret_cast<const T*>(c_array + offset));
+	};
+
 	void clear();
 };
 
@@ -61,6 +73,14 @@ void file_read_page(int64_t table_id, pagenum_t page_number, struct page_t* dest
 // Write an in-memory page(src) to the on-disk page
 void file_write_page(int64_t table_id, pagenum_t page_number, const struct page_t* src);
 
+// Write count in-memory pages(src) to the consecutive on-disk pages
+// from first_page, synchronizing them only once
+void file_write_pages(int64_t table_id, pagenum_t first_page,
+	const struct page_t* src, int count);
+
+// Let the OS read count on-disk pages from first_page in the background
+void file_prefetch_pages(int64_t table_id, pagenum_t first_page, int count);
+
 // Close the database file
 void file_close_table_files();
 
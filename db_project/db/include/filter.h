@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+/* In-memory Bloom filter of the keys of a table, which tells that a key
+ * is not in the table without reading the tree. It is built from the
+ * leaves when the table is opened, and keys are added to it before they
+ * are put into their leaves, so a key in the table is never missed.
+ * Deleted keys stay in the filter until it is built again, which happens
+ * when more keys are added than it is sized for.
+ * Snapshots may read deleted records, so they don't use the filter.
+ */
+
+// whether the table has a filter, in the flags of its header page
+// (ui64_array[4]).
+#define TABLE_KEY_FILTER        2
+
+#define FILTER_BITS_PER_KEY     10
+#define FILTER_NUM_PROBES       7
+
+// a filter is sized for twice the keys of the table, and at least these.
+#define FILTER_MIN_KEYS         4096
+
+// tables which can have filters at once. lookups find the filter of a
+// table in a slot without any latch. a table which gets no slot has no
+// filter, so its lookups just read the tree.
+#define FILTER_MAX_TABLES       256
+
+// build the filter of the table from its leaves, replacing the old one.
+// the header must be latched by the caller.
+void filter_build(int64_t table_id, int trx_id);
+
+void filter_drop(int64_t table_id);
+
+// drop the filters of all tables, which are closed.
+void filter_clear();
+
+void filter_add(int64_t table_id, int64_t key);
+
+// returns false if the key is not in the table, or true if it may be,
+// or the table has no filter.
+bool filter_may_contain(int64_t table_id, int64_t key);
+
+// whether more keys have been added to the filter than it is sized for,
+// so that it should be built again.
+bool filter_is_full(int64_t table_id);
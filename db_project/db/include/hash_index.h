@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+
+#include "file.h"
+
+/* Adaptive hash index, which maps keys looked up again and again to their
+ * leaves and slots, so that their lookups don't descend the tree.
+ * It is kept in memory only, for the primary tree of each table.
+ * A key gets an entry when it has been looked up HASH_INDEX_HOT_LOOKUPS
+ * times by descending the tree, while its leaf is latched.
+ * The entries of a leaf are dropped, with the leaf latched, whenever its
+ * keys may move to other pages(split, merge, redistribution, freeing),
+ * and when it is evicted from the buffer pool. So an entry found again
+ * after its leaf is latched points to the leaf of the key, though the
+ * slot may be out of date, and the key may have been deleted.
+ */
+#define HASH_INDEX_HOT_LOOKUPS  3
+
+// entries(and keys being counted) of a table. they are all dropped
+// when there are more, so that hot keys get their entries again.
+#define HASH_INDEX_MAX_ENTRIES  65536
+
+// entries are kept in partitions by the hash of the key, each with its
+// own latch, so that lookups of different keys don't wait for each other.
+// a partition drops its entries of a table when it has more than its
+// share of HASH_INDEX_MAX_ENTRIES.
+#define HASH_INDEX_PARTITIONS   16
+
+// whether entries are made and used, which is true at first.
+// turning it off drops all entries.
+void hash_index_enable(bool enable);
+
+// find the entry of key. the leaf is not latched, so the entry must be
+// checked by hash_index_check after the leaf is.
+bool hash_index_find(int64_t table_id, int64_t key, pagenum_t* leaf,
+    int* slot);
+
+// whether key still has its entry on leaf, which is latched by the caller.
+bool hash_index_check(int64_t table_id, int64_t key, pagenum_t leaf);
+
+// count a lookup of key which descended the tree to leaf, which is latched
+// by the caller. slot is where the key is in the leaf.
+void hash_index_looked_up(int64_t table_id, int64_t key, pagenum_t leaf,
+    int slot);
+
+// drop the entries on the page, whose keys may move to other pages.
+// the page must be latched by the caller, or be unpinned.
+void hash_index_drop_page(int64_t table_id, pagenum_t page_num);
+
+// drop the entries of all tables, which are closed.
+void hash_index_clear();
+
+// number of lookups which used an entry, and which descended the tree
+// while the hash index was on.
+void hash_index_stats(uint64_t* hits, uint64_t* misses);
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+
+#include "file.h"
+
+/* Secondary indexes are B+ trees in the file of their table. An index is
+ * on an int32_t attribute at a fixed offset of the values, and keeps an
+ * entry for each record whose value is long enough to have it.
+ * The key of an entry is the attribute in its upper 32 bits and the lower
+ * 32 bits of the primary key, so entries of an attribute are next to each
+ * other, and its value is the records sharing that key (usually one):
+ *   primary key(8), size of included bytes(2), included bytes
+ * The included bytes are a range of the value copied into the index, so
+ * that it can be read without the record. A value which ends in the range
+ * has fewer included bytes.
+ *
+ * Index i keeps its root in ui64_array[INDEX_HEADER_SLOT + 2 * i] of the
+ * header page, and its definition in the next one:
+ *   offset of the attribute + 1(4), offset of the included bytes(2),
+ *   number of the included bytes(2)
+ */
+#define MAX_INDEXES         4
+#define INDEX_HEADER_SLOT   6
+
+#define INDEX_ITEM_HEADER_SIZE  10
+
+// an entry is kept in its leaf, so a few records fit in it with
+// the largest included bytes.
+#define MAX_INDEX_INCLUDED_SIZE 256
+
+inline int64_t index_key(int32_t attribute, int64_t key)
+{
+    return (int64_t)((uint64_t)(int64_t)attribute << 32 | (uint32_t)key);
+}
+
+inline pagenum_t index_root(const page_t& header, int index_id)
+{
+    return header.ui64_array[INDEX_HEADER_SLOT + 2 * index_id];
+}
+
+// 0 if the index isn't defined.
+inline uint64_t index_definition(const page_t& header, int index_id)
+{
+    return header.ui64_array[INDEX_HEADER_SLOT + 2 * index_id + 1];
+}
+
+inline uint64_t index_make_definition(uint16_t offset,
+    uint16_t include_offset, uint16_t include_size)
+{
+    return ((uint64_t)offset + 1) | (uint64_t)include_offset << 32
+        | (uint64_t)include_size << 48;
+}
+
+inline uint32_t index_offset(uint64_t definition)
+{
+    return (uint32_t)definition - 1;
+}
+
+inline uint16_t index_include_offset(uint64_t definition)
+{
+    return (uint16_t)(definition >> 32);
+}
+
+inline uint16_t index_include_size(uint64_t definition)
+{
+    return (uint16_t)(definition >> 48);
+}
+
+// whether any index is defined on the table of the header.
+bool table_has_indexes(const page_t& header);
+
+// the indexes of the table are changed for the record of key, whose value
+// changes from old_value to new_value (nullptr if it doesn't exist).
+// the header must be latched by the caller.
+void index_record_changed(int64_t table_id, int64_t key,
+    const char* old_value, uint16_t old_size, const char* new_value,
+    uint16_t new_size, int trx_id);
+
+// fill the index from the records of the table, which must be empty.
+// the header must be latched by the caller.
+void index_build(int64_t table_id, int index_id, int trx_id);
+
+// read the record of the entry at offset, and return the offset of the
+// next one.
+uint32_t index_item(const char* entry, uint32_t offset, int64_t* key,
+    const char** included, uint16_t* included_size);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+/* Keys other than int64_t are given as byte strings, which are encoded so
+ * that memcmp orders them as their columns are ordered. A composite key is
+ * the concatenation of the encodings of its columns, in order.
+ * They are kept in the leaves of the tree of byte-string keys(key_tree.h).
+ */
+
+// append the encoding of an int64_t column, which is big-endian with
+// the sign bit flipped, so that negative numbers come first.
+void key_encode_int64(std::string* out, int64_t value);
+
+// append the encoding of a byte string column. 0x00 is escaped to
+// 0x00 0xFF, and the column ends with 0x00 0x01, so a string comes before
+// the strings it is a prefix of, and the next column doesn't affect that.
+void key_encode_bytes(std::string* out, const char* data, size_t size);
+
+// compare encoded keys as memcmp does, with the shorter first on a tie.
+int key_compare(const char* a, uint16_t a_size, const char* b,
+    uint16_t b_size);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "file.h"
+
+/* Tree of byte-string keys(see key.h) in the file of their table, whose
+ * leaves keep the whole keys(KeyNode in layout.h). The key of a record is
+ * mapped to an id, and the record is kept under the id in the int64_t
+ * tree, so that locks, snapshots and rollback work on it as on any record.
+ * A key which has been deleted keeps its id until nothing refers to the id
+ * any more(see reclaim_keys in db.cc), and is taken out of the tree then.
+ * Ids are not given again, so an id always stands for the same key.
+ *
+ * The root is kept in ui64_array[KEY_TREE_HEADER_SLOT] of the header page,
+ * and the id of the next new key in the next one.
+ */
+#define KEY_TREE_HEADER_SLOT    14
+
+// gap locks of these keys are on the gaps in order of the keys, which is
+// not the order of the ids. the gap below the key of id is locked as
+// key_gap(id), which is negative, so that it never meets the gap locks of
+// the int64_t tree. the gap after the last key is KEY_GAP_SUPREMUM.
+#define KEY_GAP_SUPREMUM        INT64_MIN
+
+inline int64_t key_gap(int64_t id)
+{
+    return (id < 0) ? KEY_GAP_SUPREMUM : -1 - id;
+}
+
+// a split node keeps at least two keys on each side.
+#define KEY_MAX_SIZE    ((PAGE_SIZE - 128) / 4 - 12)
+
+// set id to the id of the key, and return true. returns false if the key
+// has never been inserted.
+bool key_tree_find(int64_t table_id, const char* key, uint16_t key_size,
+    int64_t* id, int trx_id);
+
+// return the id of the key, mapping it to a new id if it has none.
+// the header is latched while the tree is changed.
+// a new key must not go into a gap locked by a scan of other trx, so -1 is
+// returned without mapping it in that case, and gap is set to the gap.
+int64_t key_tree_insert(int64_t table_id, const char* key, uint16_t key_size,
+    int trx_id, int64_t* gap);
+
+// take the key out of the tree if it is mapped to id. nodes left empty are
+// freed. returns false if the key is not mapped to id.
+bool key_tree_remove(int64_t table_id, const char* key, uint16_t key_size,
+    int64_t id);
+
+// add the keys in [begin_key, end_key] and their ids, in order of keys.
+// next_id is set to the id of the first key after end_key, or -1.
+void key_tree_scan(int64_t table_id, const char* begin_key,
+    uint16_t begin_size, const char* end_key, uint16_t end_size,
+    std::vector<std::string>* keys, std::vector<int64_t>* ids,
+    int64_t* next_id, int trx_id);
+
+// keys which may have been left without a record, by a delete or by the
+// rollback of an insert. they are kept in memory until they are taken.
+void key_tree_add_unused(int64_t table_id, const char* key,
+    uint16_t key_size, int64_t id);
+
+// take the oldest of them. returns false if there is none.
+bool key_tree_take_unused(int64_t* table_id, std::string* key, int64_t* id);
+
+// forget them, when the tables are closed.
+void key_tree_clear();
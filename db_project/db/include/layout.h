@@ -0,0 +1,204 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+
+#include <cstring>
+
+#include <algorithm>
+
+#include "file.h"
+
+/* Key which is a byte string, ordered as memcmp orders it, with the
+ * shorter one first on a tie.
+ */
+struct KeyBytes
+{
+    const char* data;
+    uint16_t size;
+};
+
+/* Order of the keys of a node, given to the searches below as a template
+ * argument. Integer keys are compared natively, so the int64_t tree keeps
+ * its search as it was.
+ */
+template<typename Key>
+struct KeyCompare
+{
+    static bool less(const Key& a, const Key& b) { return a < b; }
+};
+
+template<>
+struct KeyCompare<KeyBytes>
+{
+    static bool less(const KeyBytes& a, const KeyBytes& b)
+    {
+        int result = memcmp(a.data, b.data, std::min(a.size, b.size));
+        return result < 0 || (result == 0 && a.size < b.size);
+    }
+};
+
+// first index in [0, num_keys) whose key is not less than key,
+// or num_keys if there is none.
+template<typename Layout, typename Key, typename Compare = KeyCompare<Key>>
+int layout_lower_bound(const page_t& node, int num_keys, const Key& key)
+{
+    int low = 0, high = num_keys;
+    while(low < high)
+    {
+        int mid = (low + high) / 2;
+        if(Compare::less(Layout::raw_key(node, mid), key)) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+// first index in [0, num_keys) whose key is greater than key,
+// or num_keys if there is none.
+template<typename Layout, typename Key, typename Compare = KeyCompare<Key>>
+int layout_upper_bound(const page_t& node, int num_keys, const Key& key)
+{
+    int low = 0, high = num_keys;
+    while(low < high)
+    {
+        int mid = (low + high) / 2;
+        if(Compare::less(key, Layout::raw_key(node, mid))) high = mid;
+        else low = mid + 1;
+    }
+    return low;
+}
+
+/* Layouts of the nodes of the tree, with their offsets as constants of
+ * the type, so that the compiler folds them into each access.
+ * Both kinds of nodes start with a 128-byte header:
+ *   0: parent, 8: is_leaf(4), 12: number of keys(4)
+ * and the leaf keeps its free space at 112.
+ */
+template<int PageSize>
+struct NodeLayout
+{
+    static constexpr int HEADER_SIZE = 128;
+    static constexpr int FREE_SPACE_OFFSET = 112;
+
+    // bytes after the header.
+    static constexpr int BODY_SIZE = PageSize - HEADER_SIZE;
+};
+
+/* Leaf whose slots are Key, value size(2) and value offset(2).
+ * Values are packed from the end of the page.
+ */
+template<typename Key, int PageSize = PAGE_SIZE>
+struct LeafLayout : NodeLayout<PageSize>
+{
+    using NodeLayout<PageSize>::HEADER_SIZE;
+
+    static constexpr int SLOT_WIDTH = sizeof(Key) + 4;
+
+    static constexpr int slot(int index)
+    {
+        return HEADER_SIZE + index * SLOT_WIDTH;
+    }
+
+    static Key raw_key(const page_t& leaf, int index)
+    {
+        return leaf.get_pos_value<Key>(slot(index));
+    }
+
+    static uint16_t& val_size(page_t& leaf, int index)
+    {
+        return leaf.get_pos_value<uint16_t>(slot(index) + sizeof(Key));
+    }
+
+    static uint16_t val_size(const page_t& leaf, int index)
+    {
+        return leaf.get_pos_value<uint16_t>(slot(index) + sizeof(Key));
+    }
+
+    static uint16_t& val_offset(page_t& leaf, int index)
+    {
+        return leaf.get_pos_value<uint16_t>(slot(index) + sizeof(Key) + 2);
+    }
+
+    static uint16_t val_offset(const page_t& leaf, int index)
+    {
+        return leaf.get_pos_value<uint16_t>(slot(index) + sizeof(Key) + 2);
+    }
+
+    // first index in [0, num_keys) whose key is not less than raw,
+    // or num_keys if there is none.
+    static int lower_bound(const page_t& leaf, int num_keys, Key raw)
+    {
+        return layout_lower_bound<LeafLayout>(leaf, num_keys, raw);
+    }
+};
+
+/* Internal node whose entries are key(8) and child(8) after the leftmost
+ * child, which is kept at 120. The child of the i-th entry has the keys
+ * not less than its key.
+ */
+template<int PageSize = PAGE_SIZE>
+struct InternalLayout : NodeLayout<PageSize>
+{
+    using NodeLayout<PageSize>::HEADER_SIZE;
+    using NodeLayout<PageSize>::BODY_SIZE;
+
+    static constexpr int ENTRY_WIDTH = 16;
+    static constexpr int MAX_KEYS = BODY_SIZE / ENTRY_WIDTH;
+
+    static int64_t key(const page_t& node, int index)
+    {
+        return node.si64_array[HEADER_SIZE / 8 + index * 2];
+    }
+
+    static int64_t raw_key(const page_t& node, int index)
+    {
+        return key(node, index);
+    }
+
+    // child which has key, after the keys not greater than it.
+    static pagenum_t child_of(const page_t& node, int64_t key,
+        int* index)
+    {
+        int num_keys = node.ui32_array[3];
+        if(num_keys > MAX_KEYS) num_keys = MAX_KEYS;
+
+        *index = layout_upper_bound<InternalLayout>(node, num_keys, key);
+        return node.ui64_array[HEADER_SIZE / 8 + *index * 2 - 1];
+    }
+};
+
+/* Node of the tree of byte-string keys(see key_tree.h), whose slots are
+ * key offset(2), key size(2) and pointer(8), with the keys packed from
+ * the end of the page. The pointer of a leaf slot is the id of a record,
+ * and the one of an internal slot is the child which has the keys not
+ * less than its key. At 120, a leaf keeps the next leaf, and an internal
+ * node its leftmost child.
+ */
+template<int PageSize = PAGE_SIZE>
+struct KeyNodeLayout : NodeLayout<PageSize>
+{
+    using NodeLayout<PageSize>::HEADER_SIZE;
+
+    static constexpr int SLOT_WIDTH = 12;
+
+    static constexpr int slot(int index)
+    {
+        return HEADER_SIZE + index * SLOT_WIDTH;
+    }
+
+    static KeyBytes raw_key(const page_t& node, int index)
+    {
+        return {node.c_array + node.get_pos_value<uint16_t>(slot(index)),
+            node.get_pos_value<uint16_t>(slot(index) + 2)};
+    }
+
+    static uint64_t pointer(const page_t& node, int index)
+    {
+        return node.get_pos_value<uint64_t>(slot(index) + 4);
+    }
+};
+
+typedef LeafLayout<int64_t> PlainLeaf;
+typedef LeafLayout<int32_t> DeltaLeaf;
+typedef InternalLayout<> Internal;
+typedef KeyNodeLayout<> KeyNode;
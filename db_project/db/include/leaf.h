@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+
+#include "file.h"
+#include "layout.h"
+
+/* Slots of a leaf start at byte 128, and its values are packed from the
+ * end of the page. A leaf has one of two slot formats, kept at 16:
+ *   LEAF_PLAIN: key(8), value size(2), value offset(2)
+ *   LEAF_DELTA: key - base key(4), value size(2), value offset(2)
+ * The base key of a delta leaf is kept at 96, and every key of the leaf
+ * must be within 32 bits of it. Leaves made before the formats existed
+ * are cleared there, so they are plain.
+ * Internal pages have no such format(see InternalLayout), so the fan-out
+ * and the height of the tree are the same in both formats.
+ */
+#define LEAF_PLAIN          0
+#define LEAF_DELTA          1
+
+// whether the new leaves of a table are made in LEAF_DELTA format,
+// in the flags of its header page (ui64_array[4]).
+#define TABLE_DELTA_LEAVES  1
+
+inline bool leaf_is_delta(const page_t& leaf)
+{
+    return leaf.ui32_array[4] == LEAF_DELTA;
+}
+
+inline int leaf_slot_width(const page_t& leaf)
+{
+    return leaf_is_delta(leaf) ? DeltaLeaf::SLOT_WIDTH : PlainLeaf::SLOT_WIDTH;
+}
+
+// byte where the index-th slot starts
+inline int leaf_slot(const page_t& leaf, int index)
+{
+    return leaf_is_delta(leaf) ? DeltaLeaf::slot(index)
+        : PlainLeaf::slot(index);
+}
+
+inline int64_t leaf_key(const page_t& leaf, int index)
+{
+    if(leaf_is_delta(leaf))
+    {
+        return leaf.si64_array[12] + DeltaLeaf::raw_key(leaf, index);
+    }
+    return PlainLeaf::raw_key(leaf, index);
+}
+
+// size of the index-th value, with SLOT_OVERFLOW if it is a stub.
+inline uint16_t leaf_val_size(const page_t& leaf, int index)
+{
+    return leaf_is_delta(leaf) ? DeltaLeaf::val_size(leaf, index)
+        : PlainLeaf::val_size(leaf, index);
+}
+
+inline uint16_t leaf_val_offset(const page_t& leaf, int index)
+{
+    return leaf_is_delta(leaf) ? DeltaLeaf::val_offset(leaf, index)
+        : PlainLeaf::val_offset(leaf, index);
+}
+
+inline uint16_t& leaf_val_size(page_t& leaf, int index)
+{
+    return leaf_is_delta(leaf) ? DeltaLeaf::val_size(leaf, index)
+        : PlainLeaf::val_size(leaf, index);
+}
+
+inline uint16_t& leaf_val_offset(page_t& leaf, int index)
+{
+    return leaf_is_delta(leaf) ? DeltaLeaf::val_offset(leaf, index)
+        : PlainLeaf::val_offset(leaf, index);
+}
+
+inline const char* leaf_val(const page_t& leaf, int index)
+{
+    return leaf.c_array + leaf_val_offset(leaf, index);
+}
+
+// whether key can be kept in the delta leaf.
+inline bool leaf_delta_fits(const page_t& leaf, int64_t key)
+{
+    int64_t delta;
+    if(__builtin_sub_overflow(key, leaf.si64_array[12], &delta)) return false;
+    return delta >= INT32_MIN && delta <= INT32_MAX;
+}
+
+// set the key of the index-th slot, which must fit in the format.
+inline void leaf_set_key(page_t& leaf, int index, int64_t key)
+{
+    if(leaf_is_delta(leaf))
+    {
+        leaf.get_pos_value<int32_t>(DeltaLeaf::slot(index))
+            = (int32_t)(key - leaf.si64_array[12]);
+    }
+    else leaf.get_pos_value<int64_t>(PlainLeaf::slot(index)) = key;
+}
+
+// bytes between the last slot and the first value of the leaf.
+inline uint64_t& leaf_free_space(page_t& leaf)
+{
+    return leaf.ui64_array[PlainLeaf::FREE_SPACE_OFFSET / 8];
+}
+
+inline uint64_t leaf_free_space(const page_t& leaf)
+{
+    return leaf.ui64_array[PlainLeaf::FREE_SPACE_OFFSET / 8];
+}
+
+// index of the first key of the leaf which is not less than key,
+// or the number of keys if there is none. the format is looked at
+// once, and the search runs on the layout of the format.
+inline int leaf_lower_bound(const page_t& leaf, int64_t key)
+{
+    int num_keys = leaf.ui32_array[3];
+    if(leaf_is_delta(leaf) == false)
+    {
+        return PlainLeaf::lower_bound(leaf, num_keys, key);
+    }
+
+    // keys out of the range of deltas are before or after all of them.
+    if(leaf_delta_fits(leaf, key) == false)
+    {
+        return (key < leaf.si64_array[12]) ? 0 : num_keys;
+    }
+    return DeltaLeaf::lower_bound(leaf, num_keys,
+        (int32_t)(key - leaf.si64_array[12]));
+}
+
+// index of the record of key in the leaf, or -1.
+inline int leaf_find(const page_t& leaf, int64_t key)
+{
+    int index = leaf_lower_bound(leaf, key);
+    if(index < (int)leaf.ui32_array[3] && leaf_key(leaf, index) == key)
+    {
+        return index;
+    }
+    return -1;
+}
@@ -4,6 +4,20 @@
 #define LOCK_MODE_SHARED    0
 #define LOCK_MODE_EXCLUSIVE 1
 
+// gap locks are kept in the bucket of the header page, so that they
+// stay in place even if the record below them moves to another leaf.
+#define LOCK_GAP_PAGE       0
+
+// key standing for the gap after the last record of a table
+#define LOCK_SUPREMUM_KEY   INT64_MAX
+
+// record locks are not kept by the page the record is in, since records move
+// to other leaves by splits and merges of concurrent inserts and deletes.
+// any page id other than LOCK_GAP_PAGE asks for a lock on the record,
+// and the lock is kept in one of LOCK_RECORD_BUCKETS lists by its key.
+#define LOCK_RECORD_PAGE    1
+#define LOCK_RECORD_BUCKETS 1024
+
 #include <stdio.h>
 #include <stdint.h>
 #include <pthread.h>
@@ -82,10 +96,23 @@ extern pthread_mutex_t lock_table_latch;
 
 /* APIs for lock table */
 int init_lock_table();
+
+// drop the lists of every table. no trx may hold or wait for a lock.
+void lock_table_clear();
 lock_t* lock_acquire(int64_t table_id, pagenum_t page_id, int64_t key,
     int trx_id, int lock_mode);
 void remove_trx_locks(lock_t* head);
 int lock_release(lock_t* lock_obj);
 
+// returns true if any trx holds or waits for a lock on the record of key
+bool lock_is_used(int64_t table_id, int64_t key);
+
+// returns true if other trx holds a gap lock on the gap below key
+bool lock_check_gap(int64_t table_id, int64_t key, int trx_id);
+
+// waits until no other trx holds a gap lock on the gap below key.
+// throws DeadlockDetectException if the wait makes a cycle.
+void lock_wait_gap(int64_t table_id, int64_t key, int trx_id);
+
 
 #endif /* __LOCK_TABLE_H__ */
@@ -0,0 +1,96 @@
+#pragma once
+#include <pthread.h>
+
+#include <stdint.h>
+
+#include <vector>
+
+/* Multi-version concurrency control.
+ * The page always holds the newest version of a record. Older versions
+ * are kept in a version chain per record, made of the undo images the
+ * writers already keep for rollback (rollback_record_t::prev_val).
+ * A version is visible to a read view if its writer has committed
+ * before the view was made, which is decided by commit numbers.
+ */
+
+struct ReadView
+{
+    // trx which owns this view (its own changes are always visible)
+    int         creator_trx_id;
+
+    // changes committed with commit number up to this are visible
+    uint64_t    snapshot_no;
+
+    bool sees(int writer_trx_id, uint64_t writer_commit_no) const;
+};
+
+struct version_t
+{
+    // value of this version (nullptr if the record didn't exist)
+    const char* value;
+    uint16_t    size;
+
+    // trx which wrote this version, and its commit number(0 if active)
+    int         writer_trx_id;
+    uint64_t    writer_commit_no;
+
+    // trx which has overwritten this version
+    int         superseded_by;
+};
+
+struct version_chain_t
+{
+    // writer of the version which is in the page now
+    int         head_trx_id;
+    uint64_t    head_commit_no;
+
+    // older versions, from the oldest one to the newest one
+    std::vector<version_t> versions;
+};
+
+// take a snapshot of the committed changes for a new read view
+void mvcc_init_view(ReadView* view, int trx_id);
+
+// the oldest snapshot which has to be kept if there is no view
+uint64_t mvcc_snapshot_no();
+
+// keep the version overwritten by trx (page latch should be held)
+void mvcc_add_version(int64_t table_id, int64_t key, int trx_id,
+    const char* prev_val, uint16_t val_size);
+
+// forget the newest version written by trx, on its rollback
+void mvcc_remove_version(int64_t table_id, int64_t key, int trx_id);
+
+// copy the version of a record visible to the view into ret_val.
+// page_val is the version in the page (nullptr if there is no record).
+// returns 0 if there is a visible version, otherwise -1.
+int mvcc_read(const ReadView& view, int64_t table_id, int64_t key,
+    const char* page_val, uint16_t page_size, char* ret_val,
+    uint16_t* val_size);
+
+// collect the versions in [key_start, key_end] visible to the view, of the
+// records whose version in the page isn't visible to it. records deleted
+// after the snapshot are found only here, since they are not in the page.
+int mvcc_read_range(const ReadView& view, int64_t table_id, int64_t key_start,
+    int64_t key_end, std::vector<int64_t>* keys, std::vector<char*>* values,
+    std::vector<uint16_t>* val_sizes);
+
+// stamp the versions of trx with a commit number, and take over its undo
+// arena, which is needed until every view can see the trx.
+void mvcc_commit(struct Transaction* trx);
+
+// free the versions which are not needed by views whose snapshot number
+// is larger than or equal to horizon.
+void mvcc_purge(uint64_t horizon);
+
+// drop every version and the history of committed trxs. no trx may be
+// active, and no view may be read.
+void mvcc_clear();
+
+// whether any old version of the record is kept for some view
+bool mvcc_has_versions(int64_t table_id, int64_t key);
+
+// number of old versions currently kept
+size_t mvcc_num_versions();
+
+extern pthread_mutex_t version_latch;
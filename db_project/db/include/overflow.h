@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+
+#include <vector>
+
+#include "file.h"
+
+// values larger than this are kept in a chain of overflow pages,
+// and the leaf holds a stub in their place.
+#define MAX_INLINE_VALUE_SIZE   992
+
+// largest value which can be stored.
+#define MAX_VALUE_SIZE          65535
+
+// bytes at the head of the value which are kept in the stub,
+// so that they are read without the overflow pages.
+#define OVERFLOW_PREFIX_SIZE    64
+
+// stub: the first overflow page(8), the size of the whole value(2),
+// and the prefix of the value.
+#define OVERFLOW_STUB_SIZE      (10 + OVERFLOW_PREFIX_SIZE)
+
+// bytes of the value in an overflow page. the page has the next page
+// of the chain at 0, and the number of bytes it holds at 12.
+#define OVERFLOW_PAGE_DATA      (PAGE_SIZE - 16)
+
+// set in the size of a slot whose value is a stub. stored values are
+// less than a page, so the bit isn't used otherwise.
+#define SLOT_OVERFLOW           0x8000
+
+// bytes which the value of a slot takes in the leaf.
+inline uint16_t slot_stored_size(uint16_t slot_size)
+{
+    return slot_size & ~SLOT_OVERFLOW;
+}
+
+inline pagenum_t overflow_first_page(const char* stub)
+{
+    return *reinterpret_cast<const pagenum_t*>(stub);
+}
+
+inline uint16_t overflow_value_size(const char* stub)
+{
+    return *reinterpret_cast<const uint16_t*>(stub + 8);
+}
+
+// write the value after its prefix into new overflow pages, and fill
+// the stub with them. the header is latched to allocate the pages,
+// so no leaf should be latched by the caller.
+void overflow_write(int64_t table_id, const char* value, uint16_t size,
+    char* stub, int trx_id);
+
+// free the chain of overflow pages from first_page. the header is latched
+// as overflow_write does.
+void overflow_free(int64_t table_id, pagenum_t first_page, int trx_id);
+
+// copy len bytes of the value of the stub from offset into dest.
+// the leaf of the stub must stay latched, so that the chain isn't freed.
+void overflow_read(int64_t table_id, const char* stub, uint32_t offset,
+    uint32_t len, char* dest, int trx_id);
+
+// value of the index-th record of the leaf, and its size. a value in
+// overflow pages is read into buf, while the leaf is latched by the caller.
+const char* leaf_value(int64_t table_id, const page_t* leaf, int index,
+    uint16_t* size, std::vector<char>* buf, int trx_id);
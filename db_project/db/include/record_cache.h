@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Cache of whole values by <table id, key>, kept above the buffer pool,
+ * so that reads of the hottest records don't latch any page. It holds the
+ * values read last, up to its capacity in bytes(LRU), and is off while
+ * the capacity is 0.
+ * A value is put while its leaf is latched, and every change of a record,
+ * including the ones by rollback, drops its value while the leaf is still
+ * latched. so an old value is never put after the new one is written, and
+ * never read after the leaf is released. a record which isn't in any leaf
+ * has no value here, so inserts don't drop anything.
+ */
+
+// values are kept in partitions by the hash of the key, each with its own
+// latch and its share of the capacity, so that changes of different
+// records don't wait for each other.
+#define RECORD_CACHE_PARTITIONS 16
+
+// set the capacity in bytes, dropping the values past it.
+void record_cache_resize(size_t capacity);
+
+// copy the value of the record into value, and set val_size.
+// returns false if it is not in the cache.
+bool record_cache_get(int64_t table_id, int64_t key, char* value,
+    uint16_t* val_size);
+
+// copy len bytes of the value from offset into buf, as db_read_value does.
+bool record_cache_read(int64_t table_id, int64_t key, uint16_t offset,
+    char* buf, uint16_t len, uint16_t* read_size);
+
+// put the value read from the leaf, which should be latched.
+void record_cache_put(int64_t table_id, int64_t key, const char* value,
+    uint16_t val_size);
+
+// drop the value of the record, which has been changed in the leaf.
+// the leaf should be latched.
+void record_cache_invalidate(int64_t table_id, int64_t key);
+
+// drop the values of all tables, which are closed.
+void record_cache_clear();
+
+// number of reads served by the cache, and which were not.
+void record_cache_stats(uint64_t* hits, uint64_t* misses);
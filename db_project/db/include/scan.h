@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "buffer.h"
+#include "mvcc.h"
+
+// number of leaves read in a row by the sibling links, after which
+// the scan is taken as sequential and the next leaves are read ahead.
+#define SCAN_READAHEAD_TRIGGER  2
+
+// default number of leaves read ahead (0 turns readahead off)
+#define SCAN_READAHEAD_WINDOW   32
+
+extern int scan_readahead_window;
+
+/* Cursor over the records in [key_start, key_end], read one leaf at a time.
+ * The current leaf stays pinned and latched while its records are given
+ * out, so values are pointers into the buffer frame, which are valid until
+ * the cursor moves to the next leaf or is closed(a value kept in overflow
+ * pages is copied into the cursor, and is valid until the next call).
+ * The latch belongs to the thread which opened the cursor, so the cursor should not be passed to
+ * another thread.
+ * A read-only trx reads copies of the visible versions instead, since they
+ * may not be in the page, and no leaf is latched between calls.
+ * With a trx, the records of a leaf get next-key locks before the leaf
+ * is read, as find_range_locking does.
+ * A descending cursor moves by the left-sibling links. It never waits for
+ * the latch of a left sibling while holding a leaf, since writers latch
+ * leaves from left to right, so the link is checked again after the
+ * leaf is released, and the leaf is found from the root if it changed.
+ * Once leaves are read one after another, the next ones are read ahead,
+ * by the page numbers in their parent, so the scan doesn't wait for the
+ * disk at each leaf.
+ */
+struct ScanCursor
+{
+    int64_t table_id;
+    int64_t key_start;
+    int64_t key_end;
+    int trx_id;
+    bool descending;
+
+    // slot of the header page with the root of the tree to read, which is
+    // the table by default, or one of its indexes.
+    int root_slot;
+
+    // current leaf, and the frame its records are read from.
+    BufferBlockPointer leaf_bb;
+    const page_t* leaf;
+
+    // leaf to read next, or 0 if it should be found from the root.
+    pagenum_t next_leaf;
+
+    // leaf which the cursor has just left, from which next_leaf is taken.
+    pagenum_t prev_leaf;
+
+    // number of slots of the current leaf(or copied records) read.
+    int index;
+
+    // first key which is not given out yet: the smallest one, or the
+    // greatest one if the cursor is descending.
+    int64_t resume_key;
+
+    // whether the first key after the range is locked, for descending scan.
+    bool next_key_locked;
+
+    // leaves read in a row by the sibling links, and the number of
+    // leaves read ahead of the current one.
+    int sequential_leaves;
+    int readahead_left;
+
+    // whether the range ends in the current leaf.
+    bool is_last;
+    bool finished;
+
+    bool is_snapshot;
+    ReadView view;
+
+    // copies of the visible versions in the current leaf, for read-only trx.
+    std::vector<int64_t> keys;
+    std::vector<int> offsets;
+    std::vector<uint16_t> val_sizes;
+    std::vector<char> values;
+
+    // value given last, if it was read from overflow pages.
+    std::vector<char> overflow_value;
+
+    ScanCursor(int64_t table_id, int64_t key_start, int64_t key_end,
+        int trx_id, bool descending = false);
+
+    // give the next record, and return false at the end of the range.
+    bool next(int64_t* key, const char** value, uint16_t* val_size);
+
+    // release the current leaf.
+    void close();
+
+private:
+    pagenum_t get_root();
+
+    void read_leaf();
+    void read_leaf_locking();
+    void read_leaf_snapshot();
+
+    // find the leaf to read next by the sibling link, and check it is
+    // still next to prev_leaf. returns an invalid pointer if it isn't.
+    BufferBlockPointer get_next_leaf(page_t* leaf_p);
+
+    // collect the keys of the leaf to lock, and return true if the
+    // range ends in it.
+    bool keys_to_lock(page_t* leaf_p, std::vector<int64_t>* lock_keys);
+
+    void lock_next_key();
+
+    // count the leaf just reached, and read the next leaves ahead once
+    // the scan is found to be sequential.
+    void on_leaf(pagenum_t leaf_num, pagenum_t parent, bool sequential);
+
+    // move to the next leaf in the direction of the cursor,
+    // or finish the scan.
+    void next_leaf_or_finish();
+};
@@ -1,18 +1,38 @@
+#pragma once
 #include <pthread.h>
 
 #include <stdint.h>
 
+#include <atomic>
 #include <vector>
-#include <map>
+
+#include "mvcc.h"
+#include "undo.h"
 
 typedef uint64_t pagenum_t;
 
+// maximum number of read-write trxs which can be active at once
+#define MAX_ACTIVE_TRX      1024
+
+// maximum number of read-only trxs which can be active at once
+#define MAX_READ_ONLY_TRX   1024
+
+// snapshot number of a read view slot which is not in use
+#define READ_VIEW_SLOT_FREE UINT64_MAX
+
+// change made by a trx, which is undone by its key on rollback
+enum UNDO_TYPE
+{
+    UNDO_UPDATE = 0, UNDO_INSERT = 1, UNDO_DELETE = 2
+};
+
 struct rollback_record_t
 {
     int64_t     table_id;
-    pagenum_t   page_num;
-    uint16_t    offset;
+    int64_t     key;
+    UNDO_TYPE   type;
 
+    // value before the change (nullptr for insert)
     const char* prev_val;
     uint16_t    val_size;
 };
@@ -24,32 +44,91 @@ struct Transaction
     struct lock_t* lock_ptr;
     std::vector<rollback_record_t> rollback_records;
     
+    // trx which holds the lock this trx is waiting for. it is set and
+    // cleared under lock_table_latch, and never points to a freed trx.
     struct Transaction* waiting_trx;
 
+    // snapshot used by consistent reads of this trx
+    ReadView read_view;
+
+    // undo images pointed by rollback_records
+    UndoArena undo_arena;
+
+    // protects lock_ptr when threads share this trx
+    pthread_mutex_t trx_latch;
+
     Transaction(int trx_id);
     ~Transaction();
 };
 
 struct TrxManager
 {
-    int trx_count;
-    std::map<int, Transaction*> trx_table;
+    std::atomic<int> trx_count;
+
+    // active trx with id i is kept in the (i % MAX_ACTIVE_TRX)-th slot, so
+    // it is found with a single load, and no latch guards the table.
+    std::atomic<Transaction*> trx_table[MAX_ACTIVE_TRX];
+
+    // id of the trx which has claimed each slot(0 if free). it is set
+    // before the trx is put into trx_table, and reset after the trx is
+    // freed, so that a slot is checked without reading its Transaction.
+    std::atomic<int> trx_ids[MAX_ACTIVE_TRX];
+
+    // snapshot numbers of the trxs in trx_table, read by purge
+    // without touching Transaction objects which may be freed meanwhile.
+    std::atomic<uint64_t> trx_views[MAX_ACTIVE_TRX];
+
+    // snapshot numbers of read-only trxs. read-only trx with id -(i + 1)
+    // uses the i-th slot.
+    std::atomic<uint64_t> read_only_views[MAX_READ_ONLY_TRX];
+
+    // number of slots which have ever been used
+    std::atomic<int> read_only_slot_count;
 
     TrxManager();
 };
 
 
+// returns the id of the new trx, or 0 if MAX_ACTIVE_TRX trxs are active.
 int trx_begin(void);
 
+// Begin a trx which only reads records from the snapshot taken now.
+// It is not put into the trx table, acquires no lock, and keeps no undo,
+// so both begin and commit are cheap. Its id is negative.
+// If MAX_READ_ONLY_TRX of them are active, a normal trx is begun instead,
+// so 0 is returned if that fails too.
+int trx_begin_read_only(void);
+
+// returns true if trx_id is an id of a read-only trx
+bool trx_is_read_only(int trx_id);
+
+// returns the active trx whose id is trx_id, or nullptr.
+// the trx must not be committed by other thread while it is used.
+Transaction* trx_get(int trx_id);
+
 int trx_abort(int trx_id);
 
 int trx_commit(int trx_id);
 
-void trx_add_rollback_record(int trx_id, int64_t table_id, pagenum_t page_num,
-    uint16_t offset, const char* prev_val, uint16_t val_size);
+// abort every trx which is still active, and end read-only ones.
+// no operation of them may be running.
+void trx_abort_all();
+
+// returns a space for an undo image of trx, which is kept until no view
+// can read it. returns nullptr if there is no such trx.
+char* trx_alloc_undo(int trx_id, uint16_t size);
+
+void trx_add_rollback_record(int trx_id, int64_t table_id, int64_t key,
+    UNDO_TYPE type, const char* prev_val, uint16_t val_size);
+
+// copy the read view of trx. returns false if there is no such trx.
+bool trx_get_read_view(int trx_id, ReadView* view);
+
+// free old versions which no active trx can read
+void trx_purge();
 
-// if deadlock detected, return true
+// if deadlock detected, return true. lock_table_latch should be held,
+// so that no trx on the waiting path is freed meanwhile.
 bool trx_check_deadlock(Transaction* curr_trx);
 
-extern TrxManager trx_manager;
-extern pthread_mutex_t trx_table_latch;
\ No newline at end of file
+extern TrxManager trx_manager;
\ No newline at end of file
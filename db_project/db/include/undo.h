@@ -0,0 +1,46 @@
+#pragma once
+#include <pthread.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+// size of a chunk the undo images are carved from
+#define UNDO_CHUNK_SIZE     (16 * 1024)
+
+// maximum number of free chunks kept for reuse
+#define UNDO_POOL_SIZE      1024
+
+/* Bump allocator for the undo images of a trx.
+ * Images are only freed all at once, when the trx has ended and no view
+ * can read them anymore, so each allocation is just a pointer increment
+ * in the current chunk. Chunks are recycled through a global pool.
+ */
+struct UndoArena
+{
+    std::vector<char*> chunks;
+
+    // images larger than a chunk, which are deleted instead of pooled
+    std::vector<char*> large_images;
+
+    // bytes used in the last chunk
+    size_t used;
+
+    UndoArena();
+    UndoArena(UndoArena&& other);
+    UndoArena& operator=(UndoArena&& other);
+    ~UndoArena();
+
+    UndoArena(const UndoArena&) = delete;
+    UndoArena& operator=(const UndoArena&) = delete;
+
+    // returns a space of size bytes, valid until reset
+    char* alloc(size_t size);
+
+    // give every chunk back to the pool
+    void reset();
+};
+
+// number of chunks kept in the pool (for test)
+size_t undo_pool_size();
@@ -56,13 +56,20 @@
 
 #include <iostream>
 #include <cstdio>
+#include <cstring>
 #include <memory>
 
 #include <algorithm>
 
 #include "../include/file.h"
+#include "../include/hash_index.h"
 #include "../include/buffer.h"
+#include "../include/leaf.h"
 #include "../include/lock_table.h"
+#include "../include/mvcc.h"
+#include "../include/overflow.h"
+#include "../include/record_cache.h"
+#include "../include/scan.h"
 // GLOBALS.
 
 /* The order determines the maximum and minimum
@@ -76,7 +83,7 @@
  * default value.
  */
 int order = DEFAULT_ORDER;
-int real_order = 124;
+int real_order = Internal::MAX_KEYS / 2;
 
 
 // FUNCTION DEFINITIONS.
@@ -139,48 +146,415 @@ void print_license( int license_part ) {
  * by key_start and key_end, inclusive.  Places these in the arrays
  * returned_keys and returned_pointers, and returns the number of
  * entries found.
+ * If trx_id is given, the range is read under next-key locks
+ * (see find_range_locking).
  */
 int find_range(int64_t table_id, pagenum_t root, int64_t key_start, int64_t key_end,
-    std::vector<int64_t> * keys, std::vector<char*> * values, std::vector<uint16_t> * val_sizes)
+    std::vector<int64_t> * keys, std::vector<char*> * values,
+    std::vector<uint16_t> * val_sizes, int trx_id)
 {
-    int i, num_found;
-    num_found = 0;
+    if(trx_id > 0)
+    {
+        return find_range_locking(table_id, root, key_start, key_end,
+            keys, values, val_sizes, trx_id);
+    }
+
+    // leaves are read by a cursor, which reads the next ones ahead.
+    ScanCursor cursor(table_id, key_start, key_end, 0);
+
+    int num_found = 0;
+    int64_t c_key;
+    const char* c_value;
+    uint16_t c_size;
+    while(cursor.next(&c_key, &c_value, &c_size))
+    {
+        auto value = new char[c_size];
+        memcpy(value, c_value, c_size);
+
+        keys->push_back(c_key);
+        values->push_back(value);
+        val_sizes->push_back(c_size);
+        num_found++;
+    }
+
+    return num_found;
+}
 
-    BufferBlockPointer n_bb = find_leaf(table_id, root, key_start, 0);
-    pagenum_t n = n_bb.page_num;
+/* Version of find_range which reads the records visible to the read view.
+ * Each leaf is kept latched while the versions of its records
+ * are looked up, and no record lock is acquired.
+ * Records deleted after the snapshot are not in the leaves, so they are
+ * taken from the version chains, and merged in order of keys.
+ */
+int find_range_snapshot(int64_t table_id, pagenum_t root, int64_t key_start,
+    int64_t key_end, std::vector<int64_t> * keys, std::vector<char*> * values,
+    std::vector<uint16_t> * val_sizes, const ReadView& view)
+{
+    int trx_id = view.creator_trx_id;
+    std::vector<char> version(MAX_VALUE_SIZE), overflow_value;
+    uint16_t version_size;
     page_t n_p;
 
-    if(n == 0) return 0;
+    std::vector<int64_t> page_keys, old_keys;
+    std::vector<char*> page_values, old_values;
+    std::vector<uint16_t> page_sizes, old_sizes;
 
-    while(n != 0)
+    BufferBlockPointer n_bb = find_leaf(table_id, root, key_start, trx_id);
+    while(n_bb.valid)
     {
-        buffer_manager->get_block(table_id, n_bb.page_num, 0, &n_p);
-        
-        for(i = 0; i < n_p.si32_array[3]; i++)
+        buffer_manager->get_page(n_bb, n_p);
+
+        bool is_last = false;
+        for(int i = 0; i < n_p.si32_array[3]; i++)
         {
-            auto c_key = n_p.get_pos_value<int64_t>(128 + 12 * i);
-            if(key_end < c_key) return num_found;
-            if(key_start <= c_key)
+            auto c_key = leaf_key(n_p, i);
+            if(key_end < c_key)
             {
-                auto c_size = n_p.get_pos_value<uint16_t>(128 + 8 + 12 * i);
-                auto c_offset = n_p.get_pos_value<uint16_t>(128 + 10 + 12 * i);
-                auto value = new char[c_size];
-                for(uint16_t j = 0; j < c_size; j++)
+                is_last = true;
+                break;
+            }
+            if(c_key < key_start) continue;
+
+            uint16_t c_size;
+            const char* c_value = leaf_value(table_id, &n_p, i, &c_size,
+                &overflow_value, trx_id);
+            if(mvcc_read(view, table_id, c_key, c_value, c_size,
+                version.data(), &version_size) != 0) continue;
+
+            auto value = new char[version_size];
+            std::copy(version.data(), version.data() + version_size, value);
+
+            page_keys.push_back(c_key);
+            page_values.push_back(value);
+            page_sizes.push_back(version_size);
+        }
+
+        pagenum_t n = n_p.ui64_array[15];
+        if(is_last || n == 0) break;
+
+        n_bb = buffer_manager->get_block(table_id, n, trx_id);
+    }
+    n_bb = BufferBlockPointer::unvalid_instance();
+
+    mvcc_read_range(view, table_id, key_start, key_end,
+        &old_keys, &old_values, &old_sizes);
+
+    // the visible version of a key is the same in both of them.
+    int num_found = 0;
+    size_t i = 0, j = 0;
+    while(i < page_keys.size() || j < old_keys.size())
+    {
+        bool from_page = (j == old_keys.size()
+            || (i < page_keys.size() && page_keys[i] <= old_keys[j]));
+
+        if(from_page)
+        {
+            if(j < old_keys.size() && page_keys[i] == old_keys[j])
+            {
+                delete[] old_values[j++];
+            }
+            keys->push_back(page_keys[i]);
+            values->push_back(page_values[i]);
+            val_sizes->push_back(page_sizes[i++]);
+        }
+        else
+        {
+            keys->push_back(old_keys[j]);
+            values->push_back(old_values[j]);
+            val_sizes->push_back(old_sizes[j++]);
+        }
+        num_found++;
+    }
+    return num_found;
+}
+
+/* Collects the keys of a leaf which should be locked to read
+ * [key_start, key_end]: every key within the range and the first key
+ * after it.  If the range goes on past the last leaf, the supremum
+ * is used as the first key after it.
+ * Returns true if the range ends in this leaf.
+ */
+bool range_keys_in_leaf(page_t* leaf_p, int64_t key_start,
+    int64_t key_end, std::vector<int64_t>* lock_keys)
+{
+    lock_keys->clear();
+
+    for(int i = 0; i < leaf_p->si32_array[3]; i++)
+    {
+        int64_t c_key = leaf_key(*leaf_p, i);
+        if(c_key < key_start) continue;
+
+        lock_keys->push_back(c_key);
+        if(key_end < c_key) return true;
+    }
+
+    if(leaf_p->ui64_array[15] == 0)
+    {
+        lock_keys->push_back(LOCK_SUPREMUM_KEY);
+        return true;
+    }
+    return false;
+}
+
+/* Serializable version of find_range.
+ * Each key of the range and the first key after it get a next-key
+ * lock, i.e. a shared lock on the record and a shared lock on the gap
+ * below the record, so no other trx can update the records or insert
+ * a new one into the range until this trx ends.
+ * Locks are requested without holding any page latch. After that, the
+ * leaf is read again, and if the keys changed in the meantime(by a
+ * split or a concurrent insert), the leaf is handled again.
+ */
+int find_range_locking(int64_t table_id, pagenum_t root, int64_t key_start,
+    int64_t key_end, std::vector<int64_t> * keys, std::vector<char*> * values,
+    std::vector<uint16_t> * val_sizes, int trx_id)
+{
+    int num_found = 0;
+    std::vector<int64_t> lock_keys, check_keys;
+    page_t n_p;
+    std::vector<char> overflow_value;
+
+    // the key from which the scan (re)starts
+    int64_t resume_key = key_start;
+
+    while(true)
+    {
+        pagenum_t n;
+        {
+            BufferBlockPointer n_bb = find_leaf(table_id, root, resume_key,
+                trx_id);
+            n = n_bb.valid ? n_bb.page_num : 0;
+        }
+
+        if(n == 0)
+        {
+            // empty tree: only the supremum can protect the range
+            lock_acquire(table_id, LOCK_GAP_PAGE, LOCK_SUPREMUM_KEY,
+                trx_id, LOCK_MODE_SHARED);
+
+            page_t header_p;
+            buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+            if(header_p.ui64_array[3] == 0) return num_found;
+
+            root = header_p.ui64_array[3];
+            continue;
+        }
+
+        bool restart = false;
+        while(restart == false)
+        {
+            buffer_manager->get_block(table_id, n, trx_id, &n_p);
+            if(n_p.ui32_array[2] != 1)
+            {
+                restart = true;
+                break;
+            }
+
+            bool is_last = range_keys_in_leaf(&n_p, resume_key, key_end,
+                &lock_keys);
+
+            for(int64_t c_key : lock_keys)
+            {
+                if(c_key != LOCK_SUPREMUM_KEY)
                 {
-                    value[j] = n_p.c_array[c_offset + j];
+                    lock_acquire(table_id, n, c_key, trx_id, LOCK_MODE_SHARED);
                 }
+                lock_acquire(table_id, LOCK_GAP_PAGE, c_key, trx_id,
+                    LOCK_MODE_SHARED);
+            }
+
+            // read the leaf again, and check nothing has changed.
+            BufferBlockPointer n_bb = buffer_manager->get_block(
+                table_id, n, trx_id, &n_p);
+
+            if(n_p.ui32_array[2] != 1 || range_keys_in_leaf(&n_p,
+                resume_key, key_end, &check_keys) != is_last
+                || check_keys != lock_keys)
+            {
+                restart = true;
+                break;
+            }
+
+            for(int i = 0; i < n_p.si32_array[3]; i++)
+            {
+                auto c_key = leaf_key(n_p, i);
+                if(c_key < resume_key) continue;
+                if(key_end < c_key) break;
+
+                uint16_t c_size;
+                const char* c_value = leaf_value(table_id, &n_p, i, &c_size,
+                    &overflow_value, trx_id);
+                auto value = new char[c_size];
+                std::copy(c_value, c_value + c_size, value);
 
                 keys->push_back(c_key);
                 values->push_back(value);
                 val_sizes->push_back(c_size);
+                num_found++;
             }
+
+            if(is_last) return num_found;
+            if(lock_keys.empty() == false) resume_key = lock_keys.back() + 1;
+
+            n = n_p.ui64_array[15];
         }
-        n = n_p.ui64_array[15];
 
-        if(n != 0) n_bb = buffer_manager->get_block(table_id, n, 0, &n_p);
+        // the tree has been changed, so find the leaf again from the root.
+        page_t header_p;
+        buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+        root = header_p.ui64_array[3];
     }
+}
 
-    return num_found;
+/* Finds the smallest key greater than the given key, i.e. the key
+ * whose gap a new record with the given key would be put into.
+ * Looks into the right sibling if the key is at the end of the leaf,
+ * and returns LOCK_SUPREMUM_KEY if there is no greater key.
+ */
+int64_t find_next_key(int64_t table_id, pagenum_t leaf, int64_t key, int trx_id)
+{
+    page_t leaf_p;
+    buffer_manager->get_block(table_id, leaf, trx_id, &leaf_p);
+
+    while(true)
+    {
+        int num_keys = leaf_p.si32_array[3];
+        for(int i = 0; i < num_keys; i++)
+        {
+            int64_t c_key = leaf_key(leaf_p, i);
+            if(key < c_key) return c_key;
+        }
+
+        pagenum_t sibling = leaf_p.ui64_array[15];
+        if(sibling == 0) return LOCK_SUPREMUM_KEY;
+
+        buffer_manager->get_block(table_id, sibling, trx_id, &leaf_p);
+    }
+}
+
+
+/* Visits the subtree of the node n_p, which is latched,
+ * for the sorted keys in [begin, end), splitting them by the children
+ * they belong to, so that each page is read once.
+ */
+static void find_leaves_many_from(int64_t table_id, page_t& n_p,
+    const int64_t* keys, int begin, int end, bool prefetch,
+    const std::function<void(page_t& leaf_p, int begin, int end)>& visit,
+    int trx_id)
+{
+    if(n_p.ui32_array[2] == 1)
+    {
+        visit(n_p, begin, end);
+        return;
+    }
+
+    struct child_range_t
+    {
+        pagenum_t child;
+        int begin, end;
+    };
+
+    // keys less than the i-th key go to the i-th child.
+    std::vector<child_range_t> children;
+    int num_keys = n_p.ui32_array[3];
+    for(int i = 0, j = begin; i <= num_keys && j < end; i++)
+    {
+        int k = j;
+        while(k < end && (i == num_keys || keys[k] < n_p.si64_array[16 + 2 * i]))
+        {
+            k++;
+        }
+
+        pagenum_t child = (i == 0) ? n_p.ui64_array[15]
+            : n_p.ui64_array[17 + 2 * (i - 1)];
+        if(k > j) children.push_back({child, j, k});
+        j = k;
+    }
+
+    if(prefetch && children.size() > 1)
+    {
+        std::vector<pagenum_t> pages;
+        for(auto& i : children) pages.push_back(i.child);
+        buffer_manager->prefetch_pages(table_id, pages);
+    }
+
+    // the node is kept latched, so that its children can't be split
+    // by the time they are visited.
+    for(auto& i : children)
+    {
+        page_t child_p;
+        BufferBlockPointer child_bb = buffer_manager->get_block(
+            table_id, i.child, trx_id, &child_p);
+
+        find_leaves_many_from(table_id, child_p, keys, i.begin, i.end,
+            prefetch, visit, trx_id);
+    }
+}
+
+
+/* Finds the leaves of the sorted keys at once, descending
+ * each page on their paths only once.
+ * visit is called for each leaf, which is latched, with the range
+ * [begin, end) of the keys which belong to it.
+ * If prefetch is set, the children a node leads to are prefetched
+ * before they are read.
+ */
+void find_leaves_many(int64_t table_id, pagenum_t root, const int64_t* keys,
+    int num_keys, bool prefetch,
+    const std::function<void(page_t& leaf_p, int begin, int end)>& visit,
+    int trx_id)
+{
+    if(root == 0 || num_keys == 0) return;
+
+    page_t root_p;
+    BufferBlockPointer root_bb = buffer_manager->get_block(
+        table_id, root, trx_id, &root_p);
+
+    find_leaves_many_from(table_id, root_p, keys, 0, num_keys, prefetch,
+        visit, trx_id);
+}
+
+
+// pages kept by the LatchedPath of this thread, if it has one.
+static thread_local std::vector<BufferBlockPointer>* latched_path = nullptr;
+
+LatchedPath::LatchedPath() : pages(nullptr)
+{
+    // the outermost one keeps the pages, until the whole change is done.
+    if(latched_path == nullptr)
+    {
+        pages = new std::vector<BufferBlockPointer>();
+        latched_path = pages;
+    }
+}
+
+LatchedPath::~LatchedPath()
+{
+    if(pages == nullptr) return;
+
+    latched_path = nullptr;
+    delete pages;
+}
+
+/* Visits every leaf of the tree from the leftmost one, by the sibling
+ * links. Each leaf is latched only while it is visited, so the caller
+ * should keep the tree from changing, by latching the header.
+ */
+void visit_leaves(int64_t table_id, pagenum_t root,
+    const std::function<void(page_t& leaf_p)>& visit, int trx_id)
+{
+    if(root == 0) return;
+
+    pagenum_t leaf = find_leaf(table_id, root, INT64_MIN, trx_id).page_num;
+    while(leaf != 0)
+    {
+        page_t leaf_p;
+        BufferBlockPointer leaf_bb = buffer_manager->get_block(
+            table_id, leaf, trx_id, &leaf_p);
+
+        visit(leaf_p);
+        leaf = leaf_p.ui64_array[15];
+    }
 }
 
 
@@ -188,11 +562,17 @@ int find_range(int64_t table_id, pagenum_t root, int64_t key_start, int64_t key_
  * by key.  Displays information about the path
  * if the verbose flag is set.
  * Returns the leaf containing the given key.
+ * If upper_bound is given, it is set to the smallest separator
+ * greater than key, so that every key less than it belongs to the leaf
+ * (INT64_MAX if the leaf is the rightmost one).
+ * If lower_bound is given, it is set to the greatest separator not
+ * greater than key (INT64_MIN if the leaf is the leftmost one).
  */
-BufferBlockPointer find_leaf(int64_t table_id, pagenum_t root, int64_t key, int trx_id)
+BufferBlockPointer find_leaf(int64_t table_id, pagenum_t root, int64_t key,
+    int trx_id, int64_t* upper_bound, int64_t* lower_bound)
 {
     int i;
-    uint32_t curr_num_keys;
+    int curr_num_keys;
 
     pagenum_t curr = root;
     if(curr == 0)
@@ -208,21 +588,38 @@ BufferBlockPointer find_leaf(int64_t table_id, pagenum_t root, int64_t key, int
     BufferBlockPointer curr_bb = buffer_manager->get_block(
         table_id, root, trx_id, &curr_p);
 
+    // a reader, which doesn't latch the header, may have read the root
+    // before it was split. then it starts again from the new root.
+    while(latched_path == nullptr && curr_p.ui64_array[0] != 0)
+    {
+        pagenum_t parent = curr_p.ui64_array[0];
+        curr_bb = BufferBlockPointer::unvalid_instance();
+        curr_bb = buffer_manager->get_block(table_id, parent, trx_id, &curr_p);
+    }
+
+    if(upper_bound != nullptr) *upper_bound = INT64_MAX;
+    if(lower_bound != nullptr) *lower_bound = INT64_MIN;
+
     // while current page is not leaf node,
     while(curr_p.ui32_array[2] != 1)
     {  
-        i = 0;
         curr_num_keys = curr_p.ui32_array[3];
-        
-        int64_t* key_pagenum_pair = curr_p.si64_array + 128 / 8;
-        
-        while (i < curr_num_keys && i < real_order* 2) {
-            if (key >= key_pagenum_pair[i * 2]) i++;
-            else break;
+        curr = Internal::child_of(curr_p, key, &i);
+
+        // separators get closer to key as the tree is descended.
+        if(upper_bound != nullptr && i < curr_num_keys)
+        {
+            *upper_bound = Internal::key(curr_p, i);
+        }
+        if(lower_bound != nullptr && i > 0)
+        {
+            *lower_bound = Internal::key(curr_p, i - 1);
         }
 
-        curr = key_pagenum_pair[i * 2 - 1];
-        curr_bb = buffer_manager->get_block(table_id, curr, trx_id, &curr_p);
+        BufferBlockPointer child_bb = buffer_manager->get_block(table_id, curr,
+            trx_id, &curr_p);
+        if(latched_path != nullptr) latched_path->push_back(std::move(curr_bb));
+        curr_bb = std::move(child_bb);
     }
     
     return curr_bb;
@@ -233,41 +630,71 @@ BufferBlockPointer find_leaf(int64_t table_id, pagenum_t root, int64_t key, int
  */
 record* find_record(int64_t table_id, pagenum_t root, int64_t key, int trx_id)
 {
-    pagenum_t leaf;
     page_t leaf_p;
-    {
-        BufferBlockPointer leaf_bb = find_leaf(table_id, root, key, trx_id);
-        leaf = leaf_bb.page_num;
 
-        // if there is empty tree
-        if(leaf_bb.valid == false) return nullptr;
-    }
+    // the leaf is kept latched while the record is copied.
+    BufferBlockPointer leaf_bb = find_leaf(table_id, root, key, trx_id);
 
-    if(trx_id > 0)
-        lock_acquire(table_id, leaf, key, trx_id, LOCK_MODE_SHARED);  
-    
-    BufferBlockPointer leaf_bb = buffer_manager->get_block(table_id, leaf,
-        trx_id, &leaf_p);
+    // if there is empty tree
+    if(leaf_bb.valid == false) return nullptr;
+
+    buffer_manager->get_page(leaf_bb, leaf_p);
     
-    int num_keys = leaf_p.si32_array[3], i;
-    for (i = 0; i < num_keys; i++)
+    int i = leaf_find(leaf_p, key);
+    if(i < 0) return nullptr;
+
+    // a value in overflow pages is read while the leaf is latched.
+    std::vector<char> overflow_value;
+    uint16_t size;
+    const char* value = leaf_value(table_id, &leaf_p, i, &size,
+        &overflow_value, trx_id);
+
+    record* new_record = new record(key, size, nullptr);
+    char* content = new char[new_record->size];
+    for(int j = 0; j < new_record->size; j++)
     {
-        if(leaf_p.get_pos_value<int64_t>(128 + i * 12) == key)
+        content[j] = value[j];
+    }
+    new_record->content = content;
+    return new_record;
+}
+
+/* Finds the leaf of key in the primary tree for a point lookup, and sets
+ * index to the slot of key in it(-1 if it isn't there). A key looked up
+ * again and again is found by the adaptive hash index, without descending
+ * the tree. Writers keeping their path latched always descend.
+ */
+BufferBlockPointer find_leaf_hashed(int64_t table_id, pagenum_t root,
+    int64_t key, int trx_id, int* index)
+{
+    pagenum_t leaf;
+    int slot;
+    if(latched_path == nullptr && hash_index_find(table_id, key, &leaf, &slot))
+    {
+        BufferBlockPointer leaf_bb = buffer_manager->get_block(table_id, leaf,
+            trx_id);
+
+        // the entry may have been dropped while the leaf was waited for.
+        if(hash_index_check(table_id, key, leaf))
         {
-            record* new_record = new record(key,
-                leaf_p.get_pos_value<uint16_t>(128 + i * 12 + 8), nullptr);     
-            uint16_t offset = leaf_p.get_pos_value<uint16_t>(128 + i * 12 + 10);
-            
-            char* content = new char[new_record->size];
-            for(int j = 0; j < new_record->size; j++)
-            {
-                content[j] = leaf_p.c_array[j + offset];
-            }
-            new_record->content = content;
-            return new_record;
+            const page_t* leaf_p = buffer_manager->get_frame(leaf_bb);
+            bool at_slot = slot < (int)leaf_p->ui32_array[3]
+                && leaf_key(*leaf_p, slot) == key;
+            *index = at_slot ? slot : leaf_find(*leaf_p, key);
+            return leaf_bb;
         }
     }
-    return nullptr;
+
+    BufferBlockPointer leaf_bb = find_leaf(table_id, root, key, trx_id);
+    *index = -1;
+    if(leaf_bb.valid == false) return leaf_bb;
+
+    *index = leaf_find(*buffer_manager->get_frame(leaf_bb), key);
+    if(latched_path == nullptr && *index >= 0)
+    {
+        hash_index_looked_up(table_id, key, leaf_bb.page_num, *index);
+    }
+    return leaf_bb;
 }
 
 /* Finds the appropriate place to
@@ -283,75 +710,227 @@ int cut( int length ) {
 
 // INSERTION
 
+/* Whether new leaves of the table are made in LEAF_DELTA format.
+ * The header is latched by every writer which makes leaves.
+ */
+bool table_delta_leaves(int64_t table_id)
+{
+    page_t header_p;
+    buffer_manager->get_block(table_id, 0, 0, &header_p);
+    return (header_p.ui64_array[4] & TABLE_DELTA_LEAVES) != 0;
+}
+
+/* Finds the base key with which the keys in [low, high] can be kept
+ * in a delta leaf. The lowest key is taken if it can be, so that
+ * greater keys can be added later.
+ * Returns false if they are too far from each other.
+ */
+bool leaf_delta_base(int64_t low, int64_t high, int64_t* base)
+{
+    uint64_t span = (uint64_t)high - (uint64_t)low;
+    if(span > UINT32_MAX) return false;
+
+    *base = (span <= INT32_MAX) ? low : high - INT32_MAX;
+    return true;
+}
+
+/* Makes the leaf keep its slots in LEAF_DELTA format from base_key,
+ * if delta is set, or in LEAF_PLAIN format otherwise.
+ * The leaf must be empty.
+ */
+void leaf_set_format(page_t* leaf, bool delta, int64_t base_key)
+{
+    leaf->ui32_array[4] = delta ? LEAF_DELTA : LEAF_PLAIN;
+    leaf->si64_array[12] = delta ? base_key : 0;
+}
+
+/* Rewrites the slots of a delta leaf in plain format, which takes
+ * 4 more bytes for each of them. Slots are moved from the last one,
+ * since each plain slot starts after the delta slot it is made from.
+ * Returns false if the free space is not enough.
+ */
+bool leaf_to_plain(page_t* leaf)
+{
+    int num_keys = leaf->ui32_array[3];
+    if(leaf_free_space(*leaf) < 4u * num_keys) return false;
+
+    for(int i = num_keys - 1; i >= 0; i--)
+    {
+        int64_t key = leaf_key(*leaf, i);
+        int32_t size_offset = leaf->get_pos_value<int32_t>(
+            DeltaLeaf::slot(i) + 4);
+
+        leaf->get_pos_value<int64_t>(PlainLeaf::slot(i)) = key;
+        leaf->get_pos_value<int32_t>(PlainLeaf::slot(i) + 8) = size_offset;
+    }
+
+    leaf_set_format(leaf, false, 0);
+    leaf_free_space(*leaf) -= 4 * num_keys;
+    return true;
+}
+
 /* Inserts a new pointer to a record and its corresponding
  * key into a leaf.
- * Returns the altered leaf.
+ * A delta leaf becomes plain if the key is too far from its base key.
+ * Returns false without changing the leaf if there is no space.
  */
 bool insert_into_leaf(page_t* leaf, const record* src) {
 
-    if(leaf->ui64_array[112 / 8] < 12 + src->size) return false;
+    // the size of a stub is marked, and is kept so in the slot.
+    uint16_t stored_size = slot_stored_size(src->size);
 
     int i, insertion_point;
     int num_keys = leaf->ui32_array[3];
-    
 
-    insertion_point = 0;
+    // an empty delta leaf takes the key as its base.
+    if(leaf_is_delta(*leaf) && num_keys == 0) leaf->si64_array[12] = src->key;
 
-    while (insertion_point < num_keys && leaf->get_pos_value<int64_t>(
-        128 + insertion_point * 12) < src->key) insertion_point++;
-    
-
-    for (i = num_keys; i > insertion_point; i--) {
-        leaf->get_pos_value<int64_t>(128 + i * 12)
-            = leaf->get_pos_value<int64_t>(128 + (i - 1) * 12);
-        
-        leaf->get_pos_value<int32_t>(128 + 8 + i * 12)
-            = leaf->get_pos_value<int32_t>(128 + 8 + (i - 1) * 12);
+    if(leaf_is_delta(*leaf) && leaf_delta_fits(*leaf, src->key) == false)
+    {
+        if(leaf_free_space(*leaf) < 4u * num_keys + 12 + stored_size
+            || leaf_to_plain(leaf) == false) return false;
     }
 
-    uint16_t insert_offset = 128 + num_keys * 12
-        + leaf->ui64_array[112 / 8] - src->size;
+    int width = leaf_slot_width(*leaf);
+    if(leaf_free_space(*leaf) < (uint64_t)width + stored_size) return false;
 
-    leaf->get_pos_value<int64_t>(128 + insertion_point * 12) = src->key;
-    leaf->get_pos_value<uint16_t>(128 + insertion_point * 12 + 8) = src->size; // size
-    leaf->get_pos_value<uint16_t>(128 + insertion_point * 12 + 10) = insert_offset;
+    insertion_point = leaf_lower_bound(*leaf, src->key);
+    
+    // slots after the insertion point move by one.
+    memmove(leaf->c_array + leaf_slot(*leaf, insertion_point + 1),
+        leaf->c_array + leaf_slot(*leaf, insertion_point),
+        (num_keys - insertion_point) * width);
+
+    uint16_t insert_offset = leaf_slot(*leaf, num_keys)
+        + leaf_free_space(*leaf) - stored_size;
 
-    for(i = 0; i < src->size; i++)
+    leaf_set_key(*leaf, insertion_point, src->key);
+    leaf_val_size(*leaf, insertion_point) = src->size; // size
+    leaf_val_offset(*leaf, insertion_point) = insert_offset;
+
+    for(i = 0; i < stored_size; i++)
     {
         leaf->c_array[insert_offset + i] = src->content[i];
     }
-    leaf->ui64_array[112 / 8] -= 12 + src->size;
+    leaf_free_space(*leaf) -= width + stored_size;
     leaf->ui32_array[3] += 1;
 
     return true;
 }
 
 
+/* Replaces the value of the index-th record in the leaf
+ * with a value of new_size bytes, which may be larger or smaller
+ * than the old one. The values stored below it are moved,
+ * so that values are still packed at the end of the page.
+ * Returns false if the free space is not enough.
+ */
+bool update_in_leaf(page_t* leaf, int index, const char* value,
+    uint16_t new_size)
+{
+    uint64_t free_space = leaf_free_space(*leaf);
+    int num_keys = leaf->ui32_array[3];
+
+    uint16_t old_size = slot_stored_size(leaf_val_size(*leaf, index));
+    uint16_t offset = leaf_val_offset(*leaf, index);
+
+    // new_size may be the marked size of a stub.
+    uint16_t slot_size = new_size;
+    new_size = slot_stored_size(new_size);
+
+    if(free_space + old_size < new_size) return false;
+
+    // values in [values_start, offset) move by the change of size.
+    int delta = (int)new_size - (int)old_size;
+    uint64_t values_start = leaf_slot(*leaf, num_keys) + free_space;
+
+    memmove(leaf->c_array + values_start - delta,
+        leaf->c_array + values_start, offset - values_start);
+
+    for(int i = 0; i < num_keys; i++)
+    {
+        uint16_t& i_offset = leaf_val_offset(*leaf, i);
+        if(i_offset < offset) i_offset -= delta;
+    }
+
+    // the value ends at the same place, and starts delta bytes earlier.
+    offset -= delta;
+    memcpy(leaf->c_array + offset, value, new_size);
+
+    leaf_val_size(*leaf, index) = slot_size;
+    leaf_val_offset(*leaf, index) = offset;
+    leaf_free_space(*leaf) = free_space - delta;
+
+    return true;
+}
+
+
+/* Whether the records in [from, to) fit in a leaf, which is delta if
+ * delta is set and their keys are close enough, and plain otherwise.
+ */
+static bool leaf_split_fits(const int64_t* keys, const uint16_t* lengths,
+    int from, int to, bool delta)
+{
+    int64_t base;
+    int width = (delta && leaf_delta_base(keys[from], keys[to - 1], &base))
+        ? 8 : 12;
+
+    int bytes = 0;
+    for(int i = from; i < to; i++)
+    {
+        bytes += slot_stored_size(lengths[i]) + width;
+    }
+    return bytes <= PlainLeaf::BODY_SIZE;
+}
+
 /* Inserts a new key and pointer
  * to a new record into a leaf so as to exceed
  * the tree's order, causing the leaf to be split
- * in half.
+ * in half. About split_size bytes of records are kept
+ * in the left leaf, and the rest go to the right one.
  */
 pagenum_t insert_into_leaf_after_splitting(
-    int64_t table_id, pagenum_t root, pagenum_t leaf, const record* src) {
+    int64_t table_id, pagenum_t root, pagenum_t leaf, const record* src,
+    int split_size) {
 
     int insertion_index, split, i, j;
 
+    // the header is latched by the writer already.
+    bool delta = table_delta_leaves(table_id);
+
     page_t old_leaf_p, old_leaf_clone;
     BufferBlockPointer old_leaf_bb = buffer_manager->get_block(
         table_id, leaf, 0, &old_leaf_p);
-    BufferBlockPointer new_leaf_bb = buffer_manager->get_new_block(table_id, 0);
+    BufferBlockPointer new_leaf_bb = buffer_manager->get_new_block(table_id);
     pagenum_t new_leaf = new_leaf_bb.page_num;
 
+    // keys of the old leaf move to the new one.
+    hash_index_drop_page(table_id, leaf);
+
     old_leaf_clone = old_leaf_p;
 
+    // the right sibling gets the new leaf as its left sibling.
+    page_t sibling_p;
+    BufferBlockPointer sibling_bb = BufferBlockPointer::unvalid_instance();
+    if(old_leaf_p.ui64_array[15] != 0)
+    {
+        try
+        {
+            sibling_bb = buffer_manager->get_block(table_id,
+                old_leaf_p.ui64_array[15], 0, &sibling_p);
+        }
+        catch(const NoSpaceException& e)
+        {
+            buffer_manager->set_delete_waited(new_leaf_bb);
+            throw e;
+        }
+    }
+
     page_t left_p(LEAF_PAGE), right_p(LEAF_PAGE);
  
     int num_keys = old_leaf_p.ui32_array[3];    // number of keys old leaf has.
 
-    insertion_index = 0;
-    while (insertion_index < num_keys && old_leaf_p.get_pos_value<int64_t>(
-        128 + insertion_index * 12) < src->key) insertion_index++;
+    insertion_index = leaf_lower_bound(old_leaf_p, src->key);
     
     int64_t* temp_keys = new int64_t[num_keys + 1];
     uint16_t* temp_length = new uint16_t[num_keys + 1];
@@ -360,25 +939,45 @@ pagenum_t insert_into_leaf_after_splitting(
     for(i = 0, j = 0; i < num_keys; i++, j++)
     {
         if (j == insertion_index) j++;
-        temp_keys[j] = old_leaf_p.get_pos_value<int64_t>(128 + i * 12); 
-        temp_length[j] = old_leaf_p.get_pos_value<int16_t>(128 + i * 12 + 8); 
-        temp_offset[j] = old_leaf_p.get_pos_value<int16_t>(128 + i * 12 + 10); 
+        temp_keys[j] = leaf_key(old_leaf_p, i);
+        temp_length[j] = leaf_val_size(old_leaf_p, i);
+        temp_offset[j] = leaf_val_offset(old_leaf_p, i);
     }
 
     temp_keys[insertion_index] = src->key; 
     temp_length[insertion_index] = src->size;
     temp_offset[insertion_index] = 0;
 
-    uint16_t acc_size = 0;
-    int64_t new_key = 0;
-    for(i = 0; i < num_keys + 1 && acc_size < 1984; acc_size += temp_length[++i] + 12)
+    // bytes are counted as if both leaves had the format of the table.
+    int width = delta ? 8 : 12;
+    int acc_size = 0;
+
+    // the right leaf gets one record at least.
+    for(i = 0; i < num_keys && acc_size < split_size;
+        acc_size += slot_stored_size(temp_length[++i]) + width);
+    split = i;
+
+    // a half which is plain may not fit, if the old leaf was delta or its
+    // keys are too far apart. the records of the old leaf fit together,
+    // so the split is moved toward the new key until both halves fit.
+    while(split > 1 && leaf_split_fits(temp_keys, temp_length,
+        0, split, delta) == false) split--;
+    while(split < num_keys && leaf_split_fits(temp_keys, temp_length,
+        split, num_keys + 1, delta) == false) split++;
+
+    int64_t base = 0;
+    leaf_set_format(&left_p, delta && leaf_delta_base(temp_keys[0],
+        temp_keys[split - 1], &base), base);
+    for(i = 0; i < split; i++)
     {
         record inserted(temp_keys[i], temp_length[i],
             (temp_offset[i] == 0) ? src->content : old_leaf_p.c_array + temp_offset[i]);
         insert_into_leaf(&left_p, &inserted); 
     }
-    new_key = temp_keys[i];
+    int64_t new_key = temp_keys[split];
 
+    leaf_set_format(&right_p, delta && leaf_delta_base(temp_keys[split],
+        temp_keys[num_keys], &base), base);
     for(; i < num_keys + 1; i++)
     {
         record inserted(temp_keys[i], temp_length[i], old_leaf_p.c_array + temp_offset[i]);
@@ -393,10 +992,17 @@ pagenum_t insert_into_leaf_after_splitting(
     // set slbling
     right_p.ui64_array[15] = old_leaf_p.ui64_array[15];
     left_p.ui64_array[15] = new_leaf;
+    left_p.ui64_array[13] = old_leaf_p.ui64_array[13];
+    right_p.ui64_array[13] = leaf;
 
     // write
     buffer_manager->write_page(old_leaf_bb, left_p);
     buffer_manager->write_page(new_leaf_bb, right_p);
+    if(sibling_bb.valid)
+    {
+        sibling_p.ui64_array[13] = new_leaf;
+        buffer_manager->write_page(sibling_bb, sibling_p);
+    }
 
     // free arrays
     delete[] temp_keys;
@@ -414,6 +1020,11 @@ pagenum_t insert_into_leaf_after_splitting(
     {
         buffer_manager->set_delete_waited(new_leaf_bb);
         buffer_manager->write_page(old_leaf_bb, old_leaf_clone);
+        if(sibling_bb.valid)
+        {
+            sibling_p.ui64_array[13] = leaf;
+            buffer_manager->write_page(sibling_bb, sibling_p);
+        }
 
         throw e;
     }
@@ -470,7 +1081,7 @@ pagenum_t insert_into_node_after_splitting(int64_t table_id, pagenum_t root,
     page_t left_p(INTERNAL_PAGE), right_p(INTERNAL_PAGE), child_p;
 
     auto old_bb = buffer_manager->get_block(table_id, old_node, 0, &old_p);
-    auto new_bb = buffer_manager->get_new_block(table_id, 0);
+    auto new_bb = buffer_manager->get_new_block(table_id);
 
     old_clone = old_p;
 
@@ -612,7 +1223,7 @@ pagenum_t insert_into_parent(int64_t table_id, pagenum_t root, pagenum_t parent,
 pagenum_t insert_into_new_root(int64_t table_id, pagenum_t left,
     int64_t key, pagenum_t right) {
 
-    BufferBlockPointer root_bb = buffer_manager->get_new_block(table_id, 0);
+    BufferBlockPointer root_bb = buffer_manager->get_new_block(table_id);
     page_t root_p(INTERNAL_PAGE), left_p, right_p;
     try
     {
@@ -649,9 +1260,11 @@ pagenum_t insert_into_new_root(int64_t table_id, pagenum_t left,
  */
 pagenum_t start_new_tree(int64_t table_id, const record* src)
 {
-    BufferBlockPointer root = buffer_manager->get_new_block(table_id, 0);
+    bool delta = table_delta_leaves(table_id);
+    BufferBlockPointer root = buffer_manager->get_new_block(table_id);
     page_t root_p(LEAF_PAGE);
 
+    leaf_set_format(&root_p, delta, src->key);
     insert_into_leaf(&root_p, src);
     buffer_manager->write_page(root, root_p);
     
@@ -668,6 +1281,9 @@ pagenum_t start_new_tree(int64_t table_id, const record* src)
  */
 pagenum_t insert(int64_t table_id, pagenum_t root, const record* src)
 {
+    // the parents of the leaf are kept, since it may be split.
+    LatchedPath path;
+
     /* Case: the tree does not exist yet.
      * Start a new tree.
      */
@@ -768,18 +1384,16 @@ void remove_entry_from_node(page_t* n_p, int64_t key, pagenum_t child)
         // case :: n_p is leaf node
         // find target to be deleted
         i = 0;
-        while (n_p->get_pos_value<int64_t>(128 + i * 12) != key) i++;
+        i = leaf_find(*n_p, key);
 
-        uint64_t shift_s = 128 + 12 * num_keys + n_p->ui64_array[14];
-        uint64_t shift_e = n_p->get_pos_value<uint16_t>(128 + 10 + i * 12);
-        uint16_t shift_scale = n_p->get_pos_value<uint16_t>(128 + 8 + i * 12);
+        int width = leaf_slot_width(*n_p);
+        uint64_t shift_s = leaf_slot(*n_p, num_keys) + leaf_free_space(*n_p);
+        uint64_t shift_e = leaf_val_offset(*n_p, i);
+        uint16_t shift_scale = slot_stored_size(leaf_val_size(*n_p, i));
 
         // shift slots
-        for(++i; i < num_keys; i++)
-        {
-            n_p->get_pos_value<int64_t>(128 + (i - 1) * 12) = n_p->get_pos_value<int64_t>(128 + i * 12);
-            n_p->get_pos_value<int32_t>(128 + (i - 1) * 12 + 8) = n_p->get_pos_value<int32_t>(128 + i * 12 + 8);
-        }
+        memmove(n_p->c_array + leaf_slot(*n_p, i),
+            n_p->c_array + leaf_slot(*n_p, i + 1), (num_keys - i - 1) * width);
 
         // shift values
         for(uint64_t i = shift_e - 1; i >= shift_s; i--)
@@ -790,12 +1404,12 @@ void remove_entry_from_node(page_t* n_p, int64_t key, pagenum_t child)
         // modify offset of slots
         for(i = 0; i < num_keys - 1; i++)
         {
-            if(n_p->get_pos_value<uint16_t>(128 + 10 + i * 12) < shift_e)
+            if(leaf_val_offset(*n_p, i) < shift_e)
             {
-                n_p->get_pos_value<uint16_t>(128 + 10 + i * 12) += shift_scale;
+                leaf_val_offset(*n_p, i) += shift_scale;
             }
         }
-        n_p->ui64_array[14] += 12 + shift_scale;
+        leaf_free_space(*n_p) += width + shift_scale;
     }
     n_p->ui32_array[3] -= 1;
 }
@@ -820,6 +1434,7 @@ pagenum_t adjust_root(int64_t table_id, pagenum_t root,
     /* Case: empty root. It need to be deleted.
      */
     buffer_manager->set_delete_waited(root_bb);
+    hash_index_drop_page(table_id, root);
 
     // If it has a child, promote 
     // the first (only) child
@@ -871,6 +1486,10 @@ pagenum_t coalesce_nodes(int64_t table_id, pagenum_t root, BufferBlockPointer n_
     buffer_manager->get_page(n_bb, n_clone);
     buffer_manager->get_page(neighbor_bb, neighbor_clone);
 
+    // keys of the leaves move from one to the other.
+    hash_index_drop_page(table_id, n_bb.page_num);
+    hash_index_drop_page(table_id, neighbor_bb.page_num);
+
     page_t n_p = n_clone, neighbor_p = neighbor_clone;
 
     /* Starting point in the neighbor for copying
@@ -880,6 +1499,10 @@ pagenum_t coalesce_nodes(int64_t table_id, pagenum_t root, BufferBlockPointer n_
      */
 
     neighbor_insertion_index = neighbor_p.ui32_array[3];
+
+    // right sibling of n, whose left sibling becomes the neighbor.
+    page_t sibling_p;
+    BufferBlockPointer sibling_bb = BufferBlockPointer::unvalid_instance();
     
     try
     {
@@ -957,12 +1580,19 @@ pagenum_t coalesce_nodes(int64_t table_id, pagenum_t root, BufferBlockPointer n_
 
         else {
             for (i = neighbor_insertion_index, j = 0; j < n_p.ui32_array[3]; i++, j++) {
-                record rec(n_p.get_pos_value<int64_t>(128 + j * 12),
-                    n_p.get_pos_value<int16_t>(128 + 8 + j * 12),
-                    n_p.c_array + n_p.get_pos_value<int16_t>(128 + 10 + j * 12));
+                record rec(leaf_key(n_p, j), leaf_val_size(n_p, j),
+                    leaf_val(n_p, j));
                 insert_into_leaf(&neighbor_p, &rec);
             }
             neighbor_p.ui64_array[15] = n_p.ui64_array[15];
+
+            if(n_p.ui64_array[15] != 0)
+            {
+                sibling_bb = buffer_manager->get_block(table_id,
+                    n_p.ui64_array[15], 0, &sibling_p);
+                sibling_p.ui64_array[13] = neighbor_bb.page_num;
+                buffer_manager->write_page(sibling_bb, sibling_p);
+            }
         }
 
         buffer_manager->write_page(n_bb, n_p);
@@ -981,6 +1611,11 @@ pagenum_t coalesce_nodes(int64_t table_id, pagenum_t root, BufferBlockPointer n_
     {
         buffer_manager->write_page(n_bb, n_clone);
         buffer_manager->write_page(neighbor_bb, neighbor_clone);
+        if(sibling_bb.valid)
+        {
+            sibling_p.ui64_array[13] = n_bb.page_num;
+            buffer_manager->write_page(sibling_bb, sibling_p);
+        }
         
         throw e;
     }
@@ -1005,6 +1640,9 @@ pagenum_t redistribute_nodes(int64_t table_id, pagenum_t root,
     buffer_manager->get_page(n_bb, n_p);
     buffer_manager->get_page(neighbor_bb, neighbor_p);
 
+    hash_index_drop_page(table_id, n_bb.page_num);
+    hash_index_drop_page(table_id, neighbor_bb.page_num);
+
     BufferBlockPointer parent_bb = buffer_manager->get_block(
         table_id, n_p.ui64_array[0], 0, &parent_p);
 
@@ -1014,7 +1652,8 @@ pagenum_t redistribute_nodes(int64_t table_id, pagenum_t root,
     
 
     while((n_p.ui32_array[2] == 0 && n_p.ui32_array[3] < real_order)
-        || ( n_p.ui32_array[2] == 1 && n_p.si64_array[14] >= 2500))
+        || ( n_p.ui32_array[2] == 1
+            && leaf_free_space(n_p) >= LEAF_MERGE_FREE_SPACE))
     {
         /* Case: n has a neighbor to the left. 
         * Pull the neighbor's last key-pointer pair over
@@ -1047,7 +1686,8 @@ pagenum_t redistribute_nodes(int64_t table_id, pagenum_t root,
                 
                 parent_p.si64_array[16 + 2 * k_prime_index] =
                     neighbor_p.si64_array[16 + 2 * (neighbor_num_keys - 1)];
-                    
+                k_prime = parent_p.si64_array[16 + 2 * k_prime_index];
+
 
                 n_p.ui32_array[3] += 1;
                 neighbor_p.ui32_array[3] -= 1;
@@ -1056,9 +1696,9 @@ pagenum_t redistribute_nodes(int64_t table_id, pagenum_t root,
 
             else
             {
-                record rec(neighbor_p.get_pos_value<int64_t>(128 + 12 * (neighbor_num_keys - 1)),
-                    neighbor_p.get_pos_value<int16_t>(128 + 8 + 12 * (neighbor_num_keys - 1)),
-                    neighbor_p.c_array + neighbor_p.get_pos_value<int16_t>(128 + 10 + 12 * (neighbor_num_keys - 1)));
+                record rec(leaf_key(neighbor_p, neighbor_num_keys - 1),
+                    leaf_val_size(neighbor_p, neighbor_num_keys - 1),
+                    leaf_val(neighbor_p, neighbor_num_keys - 1));
 
                 insert_into_leaf(&n_p, &rec);
                 remove_entry_from_node(&neighbor_p, rec.key, 0);
@@ -1073,9 +1713,8 @@ pagenum_t redistribute_nodes(int64_t table_id, pagenum_t root,
         else {
             if(n_p.ui32_array[2] == 1)
             {
-                record rec(neighbor_p.get_pos_value<int64_t>(128),
-                    neighbor_p.get_pos_value<int16_t>(128 + 8),
-                    neighbor_p.c_array + neighbor_p.get_pos_value<int16_t>(128 + 10));
+                record rec(leaf_key(neighbor_p, 0), leaf_val_size(neighbor_p, 0),
+                    leaf_val(neighbor_p, 0));
 
                 insert_into_leaf(&n_p, &rec);
                 remove_entry_from_node(&neighbor_p, rec.key, 0);
@@ -1092,6 +1731,7 @@ pagenum_t redistribute_nodes(int64_t table_id, pagenum_t root,
                 
                 parent_p.ui64_array[16 + k_prime_index * 2]
                     = neighbor_p.si64_array[16];
+                k_prime = parent_p.si64_array[16 + k_prime_index * 2];
 
                 for(i = 0; i < neighbor_num_keys - 1; i++)
                 {
@@ -1110,6 +1750,14 @@ pagenum_t redistribute_nodes(int64_t table_id, pagenum_t root,
         }
     }
 
+    // records have moved between leaves, so the key between them changes
+    // to the first key of the right one.
+    if(n_p.ui32_array[2] == 1)
+    {
+        page_t& right_p = (neighbor_index != -1) ? n_p : neighbor_p;
+        parent_p.si64_array[16 + 2 * k_prime_index] = leaf_key(right_p, 0);
+    }
+
     buffer_manager->write_page(parent_bb, parent_p);
     buffer_manager->write_page(n_bb, n_p);
     buffer_manager->write_page(neighbor_bb, neighbor_p);
@@ -1125,6 +1773,34 @@ pagenum_t redistribute_nodes(int64_t table_id, pagenum_t root,
 }
 
 
+/* Whether the records of the leaf from_p fit in the free space of
+ * the leaf into_p, which becomes plain if some of their keys are too
+ * far from its base key.
+ */
+static bool leaf_can_take(const page_t& into_p, const page_t& from_p)
+{
+    int num_keys = from_p.ui32_array[3];
+
+    // bytes of the values of from_p
+    uint64_t need = PlainLeaf::BODY_SIZE - leaf_free_space(from_p)
+        - num_keys * leaf_slot_width(from_p);
+
+    bool fits = leaf_is_delta(into_p);
+    for(int i = 0; fits && i < num_keys; i++)
+    {
+        fits = leaf_delta_fits(into_p, leaf_key(from_p, i));
+    }
+
+    if(fits) need += 8 * num_keys;
+    else
+    {
+        need += 12 * num_keys;
+        if(leaf_is_delta(into_p)) need += 4 * into_p.ui32_array[3];
+    }
+    return leaf_free_space(into_p) >= need;
+}
+
+
 /* Deletes an entry from the B+ tree.
  * Removes the record and its key and pointer
  * from the leaf, and then makes all appropriate
@@ -1151,6 +1827,10 @@ pagenum_t delete_entry(int64_t table_id, pagenum_t root, pagenum_t n,
         remove_entry_from_node(&n_p, key, child);
         buffer_manager->write_page(n_bb, n_p);
 
+        // the value of the deleted record is dropped while the leaf is
+        // latched, so that it is never put again.
+        if(n_p.ui32_array[2] == 1) record_cache_invalidate(table_id, key);
+
         /* Case:  deletion from the root. 
         */
 
@@ -1214,7 +1894,7 @@ pagenum_t delete_entry(int64_t table_id, pagenum_t root, pagenum_t n,
             * (The simple case.)
             */
 
-            if (n_p.ui64_array[14] < 2500)
+            if (leaf_free_space(n_p) < LEAF_MERGE_FREE_SPACE)
             {
                 return root;
             }
@@ -1247,8 +1927,11 @@ pagenum_t delete_entry(int64_t table_id, pagenum_t root, pagenum_t n,
                 table_id, neighbor, 0, &neighbor_p);
             
 
-            /* Coalescence. */
-            if (neighbor_p.ui64_array[14] >= PAGE_SIZE - 128 - n_p.ui64_array[14])
+            /* Coalescence.
+             * The left leaf takes the records of the right one.
+             */
+            if ((neighbor_index == -1) ? leaf_can_take(n_p, neighbor_p)
+                : leaf_can_take(neighbor_p, n_p))
                 return coalesce_nodes(table_id, root, n_bb, neighbor_bb,
                     neighbor_index, k_prime);
 
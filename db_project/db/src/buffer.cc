@@ -1,13 +1,27 @@
 #include "../include/buffer.h"
 
 #include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
 
 #include "../include/file.h"
+#include "../include/hash_index.h"
 
 BufferManager* buffer_manager = nullptr;
 
 pthread_mutex_t buffer_manager_latch = PTHREAD_MUTEX_INITIALIZER;
 
+// page latches are owned by threads, so a thread can get a page it already
+// holds again, while other threads (even of the same trx) wait for it.
+static int latch_owner_id()
+{
+    static std::atomic<int> thread_count(0);
+    thread_local int owner_id = ++thread_count;
+    return owner_id;
+}
+
 BufferBlockPointer::BufferBlockPointer(BufferManager* from, int64_t table_id,
     pagenum_t page_num)
 : table_id(table_id), page_num(page_num), valid(1), from(from)
@@ -96,8 +110,58 @@ void BufferManager::set_delete_waited(BufferBlockPointer bbp)
     pthread_mutex_unlock(&buffer_manager_latch);
 }
 
+// number of FrameWaits of this thread
+static thread_local int frame_waits = 0;
+
+// time to wait before looking for a frame again, in microseconds
+static const int FRAME_WAIT_US = 100;
+
+FrameWait::FrameWait()
+{
+    frame_waits++;
+}
+
+FrameWait::~FrameWait()
+{
+    frame_waits--;
+}
+
 BufferBlockPointer BufferManager::get_block(int64_t table_id,
     pagenum_t page_num, int trx_id, page_t* content)
+{
+    while(true)
+    {
+        try
+        {
+            return try_get_block(table_id, page_num, trx_id, content);
+        }
+        catch(const NoSpaceException& e)
+        {
+            if(frame_waits == 0) throw;
+        }
+        usleep(FRAME_WAIT_US);
+    }
+}
+
+BufferBlockPointer BufferManager::get_new_block(int64_t table_id,
+    PAGE_TYPE page_type)
+{
+    while(true)
+    {
+        try
+        {
+            return try_get_new_block(table_id, page_type);
+        }
+        catch(const NoSpaceException& e)
+        {
+            if(frame_waits == 0) throw;
+        }
+        usleep(FRAME_WAIT_US);
+    }
+}
+
+BufferBlockPointer BufferManager::try_get_block(int64_t table_id,
+    pagenum_t page_num, int trx_id, page_t* content)
 {
     pthread_mutex_lock(&buffer_manager_latch);
 
@@ -113,12 +177,12 @@ BufferBlockPointer BufferManager::get_block(int64_t table_id,
                 // we don't need to use victim
                 victim->is_pinned--;
                 pthread_mutex_unlock(&victim->mutex);
-                pthread_cond_signal(&victim->cond);
+                pthread_cond_broadcast(&victim->cond);
             }
 
             if(pthread_mutex_trylock(&it->mutex) != 0)
             {
-                if(it->using_trx_id == trx_id)
+                if(it->using_thread_id == latch_owner_id())
                 {
                     if(content != nullptr) *content = it->frame;
                     
@@ -129,6 +193,8 @@ BufferBlockPointer BufferManager::get_block(int64_t table_id,
                 }
                 else
                 {
+                    // the block may hold another page when it is released,
+                    // so all of its waiters are woken to look again.
                     pthread_cond_wait(&it->cond, &buffer_manager_latch);
                     pthread_mutex_unlock(&buffer_manager_latch);
                     return get_block(table_id, page_num, trx_id, content);
@@ -138,7 +204,7 @@ BufferBlockPointer BufferManager::get_block(int64_t table_id,
             {
                 if(content != nullptr) *content = it->frame;
                 it->is_pinned++;
-                it->using_trx_id = trx_id;
+                it->using_thread_id = latch_owner_id();
             
                 BufferBlockPointer bb(this, table_id, page_num);
 
@@ -152,7 +218,7 @@ BufferBlockPointer BufferManager::get_block(int64_t table_id,
             if(pthread_mutex_trylock(&it->mutex) == 0)
             {
                 it->is_pinned++;
-                it->using_trx_id = trx_id;
+                it->using_thread_id = latch_owner_id();
                     
                 if(victim == nullptr)
                 {
@@ -162,7 +228,7 @@ BufferBlockPointer BufferManager::get_block(int64_t table_id,
                 {
                     victim->is_pinned--;
                     pthread_mutex_unlock(&victim->mutex);
-                    pthread_cond_signal(&victim->cond);
+                    pthread_cond_broadcast(&victim->cond);
 
                     victim = it;
                 }
@@ -170,7 +236,7 @@ BufferBlockPointer BufferManager::get_block(int64_t table_id,
                 {
                     it->is_pinned--;
                     pthread_mutex_unlock(&it->mutex);
-                    pthread_cond_signal(&it->cond);
+                    pthread_cond_broadcast(&it->cond);
                 }
             }
         }
@@ -195,11 +261,24 @@ BufferBlockPointer BufferManager::get_block(int64_t table_id,
                 victim->is_dirty = false;
             }
         }
+        // keys of the adaptive hash index are found by descending again.
+        if(victim->table_id != -1)
+        {
+            hash_index_drop_page(victim->table_id, victim->page_num);
+        }
         new_page = victim;
     }
     // if there is some empty space on list,
     else if(buffer_list_size < buffer_list_capacity)
     {
+        if(victim != nullptr)
+        {
+            // we don't need to use victim
+            victim->is_pinned--;
+            pthread_mutex_unlock(&victim->mutex);
+            pthread_cond_broadcast(&victim->cond);
+        }
+
         new_page = new BufferBlock;
         new_page->mutex = PTHREAD_MUTEX_INITIALIZER;
         new_page->cond = PTHREAD_COND_INITIALIZER;
@@ -220,7 +299,7 @@ BufferBlockPointer BufferManager::get_block(int64_t table_id,
 
         new_page->table_id = table_id;
         new_page->page_num = page_num;
-        new_page->using_trx_id = trx_id;
+        new_page->using_thread_id = latch_owner_id();
         new_page->is_dirty = false;
 
         // set pin count as 1
@@ -244,7 +323,8 @@ BufferBlockPointer BufferManager::get_block(int64_t table_id,
     throw NoSpaceException();
 }
 
-BufferBlockPointer BufferManager::get_new_block(int64_t table_id, int trx_id, PAGE_TYPE page_type)
+BufferBlockPointer BufferManager::try_get_new_block(int64_t table_id,
+    PAGE_TYPE page_type)
 {
     /*
     pthread_mutex_lock(&buffer_manager_latch);
@@ -290,7 +370,7 @@ BufferBlockPointer BufferManager::get_new_block(int64_t table_id, int trx_id, PA
             if(pthread_mutex_trylock(&it->mutex) == 0)
             {
                 it->is_pinned++;
-                it->using_trx_id = trx_id;
+                it->using_thread_id = latch_owner_id();
                     
                 if(victim == nullptr)
                 {
@@ -300,7 +380,7 @@ BufferBlockPointer BufferManager::get_new_block(int64_t table_id, int trx_id, PA
                 {
                     victim->is_pinned--;
                     pthread_mutex_unlock(&victim->mutex);
-                    pthread_cond_signal(&victim->cond);
+                    pthread_cond_broadcast(&victim->cond);
 
                     victim = it;
                 }
@@ -308,7 +388,7 @@ BufferBlockPointer BufferManager::get_new_block(int64_t table_id, int trx_id, PA
                 {
                     it->is_pinned--;
                     pthread_mutex_unlock(&it->mutex);
-                    pthread_cond_signal(&it->cond);
+                    pthread_cond_broadcast(&it->cond);
                 }
             }
             // move it to next of it
@@ -321,12 +401,17 @@ BufferBlockPointer BufferManager::get_new_block(int64_t table_id, int trx_id, PA
             throw NoSpaceException();
         }
 
-        // write victim page if dirty, and reuse victim for requested page
-        if(victim->is_dirty == true)
+        // write victim page if dirty, and reuse victim for requested page.
+        // the frame of a freed page belongs to no table, and is not written.
+        if(victim->is_dirty == true && victim->table_id != -1)
         {
             file_write_page(victim->table_id, victim->page_num,
                 &(victim->frame));
-            victim->is_dirty = false;
+        }
+        victim->is_dirty = false;
+        if(victim->table_id != -1)
+        {
+            hash_index_drop_page(victim->table_id, victim->page_num);
         }
         new_page = victim;
     }
@@ -336,13 +421,14 @@ BufferBlockPointer BufferManager::get_new_block(int64_t table_id, int trx_id, PA
 
     new_page->table_id = table_id;
     new_page->page_num = file_alloc_page(table_id);
+    sync_header(table_id);
     new_page->is_dirty = true;
     // set pin count as 0, it will be increased soon
     // at the BufferBlockPointer constructure
     new_page->is_pinned = 1;
     new_page->last_used = calling_count;
     new_page->is_delete_waited = false;
-    new_page->using_trx_id = trx_id;
+    new_page->using_thread_id = latch_owner_id();
 
 
     BufferBlockPointer bb(this, new_page->table_id, new_page->page_num);
@@ -365,6 +451,26 @@ void BufferManager::get_page(BufferBlockPointer bbp, page_t& page)
     pthread_mutex_unlock(&buffer_manager_latch);
 }
 
+const page_t* BufferManager::get_frame(const BufferBlockPointer& bbp)
+{
+    pthread_mutex_lock(&buffer_manager_latch);
+    BufferBlock* block = get_block_pointer(bbp.table_id, bbp.page_num);
+    pthread_mutex_unlock(&buffer_manager_latch);
+
+    return &block->frame;
+}
+
+bool BufferManager::peek_page(int64_t table_id, pagenum_t page_num,
+    page_t* content)
+{
+    pthread_mutex_lock(&buffer_manager_latch);
+    BufferBlock* block = get_block_pointer(table_id, page_num);
+    if(block != nullptr) *content = block->frame;
+    pthread_mutex_unlock(&buffer_manager_latch);
+
+    return block != nullptr;
+}
+
 void BufferManager::write_page(BufferBlockPointer bbp, const page_t& content)
 {
     pthread_mutex_lock(&buffer_manager_latch);
@@ -380,6 +486,8 @@ void BufferManager::free_page(int64_t table_id, pagenum_t page_num)
     BufferBlock* block = get_block_pointer(table_id, page_num);
 
     file_free_page(block->table_id, block->page_num);
+    hash_index_drop_page(block->table_id, block->page_num);
+    sync_header(block->table_id);
     block->table_id = -1;
 
     // replace it next time
@@ -411,7 +519,57 @@ void BufferManager::unpin_page(int64_t table_id, pagenum_t page_num)
     {
         if(block->is_delete_waited) free_page(table_id, page_num);
         pthread_mutex_unlock(&block->mutex);
-        pthread_cond_signal(&block->cond);
+        pthread_cond_broadcast(&block->cond);
+    }
+
+    pthread_mutex_unlock(&buffer_manager_latch);
+}
+
+void BufferManager::write_new_pages(int64_t table_id, pagenum_t first_page,
+    const page_t* pages, int count)
+{
+    // eviction writes the file under the latch too.
+    pthread_mutex_lock(&buffer_manager_latch);
+    file_write_pages(table_id, first_page, pages, count);
+    pthread_mutex_unlock(&buffer_manager_latch);
+}
+
+void BufferManager::extend_table(int64_t table_id, pagenum_t num_pages)
+{
+    pthread_mutex_lock(&buffer_manager_latch);
+
+    page_t header_page;
+    file_read_page(table_id, 0, &header_page);
+    header_page.ui64_array[2] = num_pages;
+    file_write_page(table_id, 0, &header_page);
+    sync_header(table_id);
+
+    pthread_mutex_unlock(&buffer_manager_latch);
+}
+
+void BufferManager::prefetch_pages(int64_t table_id,
+    std::vector<pagenum_t> pages)
+{
+    std::sort(pages.begin(), pages.end());
+
+    pthread_mutex_lock(&buffer_manager_latch);
+
+    // consecutive pages are prefetched at once.
+    size_t run_start = 0;
+    for(size_t i = 0; i < pages.size(); i++)
+    {
+        if(get_block_pointer(table_id, pages[i]) != nullptr)
+        {
+            run_start = i + 1;
+            continue;
+        }
+
+        if(i + 1 == pages.size() || pages[i + 1] != pages[i] + 1)
+        {
+            file_prefetch_pages(table_id, pages[run_start],
+                pages[i] - pages[run_start] + 1);
+            run_start = i + 1;
+        }
     }
 
     pthread_mutex_unlock(&buffer_manager_latch);
@@ -424,26 +582,67 @@ void BufferManager::close_tables()
 
 void BufferManager::clear_pages()
 {
-    BufferBlock* curr = buffer_list_head;
+    // dirty pages are written in runs of consecutive pages,
+    // each of which is synchronized once.
+    std::vector<BufferBlock*> dirty_blocks;
+    for(BufferBlock* curr = buffer_list_head; curr != nullptr;
+        curr = curr->list_next)
+    {
+        // freed pages have no table.
+        if(curr->is_dirty && curr->table_id != -1) dirty_blocks.push_back(curr);
+    }
 
-    while(curr != nullptr)
+    std::sort(dirty_blocks.begin(), dirty_blocks.end(),
+        [](const BufferBlock* a, const BufferBlock* b)
+        {
+            if(a->table_id != b->table_id) return a->table_id < b->table_id;
+            return a->page_num < b->page_num;
+        });
+
+    std::vector<page_t> run;
+    for(size_t i = 0; i < dirty_blocks.size(); i++)
     {
-        BufferBlock* nxt = curr->list_next;
+        run.push_back(dirty_blocks[i]->frame);
 
-        if(curr->is_dirty)
+        BufferBlock* first = dirty_blocks[i + 1 - run.size()];
+        if(i + 1 == dirty_blocks.size()
+            || dirty_blocks[i + 1]->table_id != first->table_id
+            || dirty_blocks[i + 1]->page_num != dirty_blocks[i]->page_num + 1)
         {
-            file_write_page(curr->table_id, curr->page_num, &(curr->frame));
+            file_write_pages(first->table_id, first->page_num, run.data(),
+                run.size());
+            run.clear();
         }
+    }
+
+    BufferBlock* curr = buffer_list_head;
+    while(curr != nullptr)
+    {
+        BufferBlock* nxt = curr->list_next;
         delete curr;
-        
         curr = nxt;
     }
     
     buffer_list_head = nullptr;
+    buffer_list_size = 0;
 }
 
 
 
+void BufferManager::sync_header(int64_t table_id)
+{
+    BufferBlock* header = get_block_pointer(table_id, 0);
+    if(header == nullptr) return;
+
+    // file_alloc_page() and file_free_page() change the header in the file,
+    // so the buffered one takes the free list and the number of pages from
+    // it, and keeps its root, which may not be written yet.
+    page_t header_page;
+    file_read_page(table_id, 0, &header_page);
+    header->frame.ui64_array[1] = header_page.ui64_array[1];
+    header->frame.ui64_array[2] = header_page.ui64_array[2];
+}
+
 BufferBlock* BufferManager::get_block_pointer(
     int64_t table_id, pagenum_t page_num)
 {
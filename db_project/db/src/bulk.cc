@@ -0,0 +1,152 @@
+#include "../include/bulk.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "../include/bpt.h"
+#include "../include/buffer.h"
+#include "../include/leaf.h"
+
+BulkLoader::BulkLoader(int64_t table_id, pagenum_t first_page,
+    double fill_factor)
+: table_id(table_id), fill_factor(fill_factor),
+  delta_leaves(table_delta_leaves(table_id)), next_page(first_page + 1),
+  num_records(0), last_key(0)
+{
+    level_t leaf;
+    leaf.node = page_t(LEAF_PAGE);
+    leaf_set_format(&leaf.node, delta_leaves, 0);
+    leaf.page_num = first_page;
+    levels.push_back(leaf);
+}
+
+int BulkLoader::max_internal_keys() const
+{
+    // the last key of a full node moves to the next one when it is started,
+    // so a node keeps one key at least.
+    int max_keys = fill_factor * Internal::MAX_KEYS;
+    return std::max(max_keys, 2);
+}
+
+bool BulkLoader::add_record(int64_t key, const char* value, uint16_t val_size)
+{
+    if(num_records > 0 && key <= last_key) return false;
+
+    page_t& leaf_p = levels[0].node;
+    uint64_t free_space = leaf_free_space(leaf_p);
+    uint64_t used_space = PlainLeaf::BODY_SIZE - free_space;
+    uint64_t width = leaf_slot_width(leaf_p);
+
+    // a key too far from the base of a delta leaf starts the next one.
+    bool fits = leaf_is_delta(leaf_p) == false
+        || leaf_delta_fits(leaf_p, key);
+
+    if(leaf_p.ui32_array[3] > 0 && (fits == false
+        || free_space < width + val_size
+        || used_space + width + val_size > fill_factor * PlainLeaf::BODY_SIZE))
+    {
+        pagenum_t new_page = next_page++;
+        leaf_p.ui64_array[15] = new_page;
+        start_next_node(0, new_page, key);
+    }
+
+    record new_record(key, val_size, value);
+    insert_into_leaf(&levels[0].node, &new_record);
+
+    num_records++;
+    last_key = key;
+    return true;
+}
+
+pagenum_t BulkLoader::add_child(int level, int64_t key, pagenum_t child)
+{
+    if(level == (int)levels.size())
+    {
+        // the tree grows by a new root over the rightmost node below.
+        level_t root;
+        root.node = page_t(INTERNAL_PAGE);
+        root.page_num = next_page++;
+        root.node.ui64_array[15] = levels[level - 1].page_num;
+        levels.push_back(root);
+    }
+    else if((int)levels[level].node.ui32_array[3] >= max_internal_keys())
+    {
+        // the last child of the full node goes to the new node with child,
+        // so that no node is left without a key at the end.
+        page_t& full_p = levels[level].node;
+        int num_keys = full_p.ui32_array[3];
+        int64_t moved_key = full_p.si64_array[16 + 2 * (num_keys - 1)];
+        pagenum_t last_child = full_p.ui64_array[17 + 2 * (num_keys - 1)];
+        full_p.ui32_array[3]--;
+
+        start_next_node(level, next_page++, moved_key);
+        levels[level].node.ui64_array[15] = last_child;
+    }
+
+    page_t& node_p = levels[level].node;
+    int num_keys = node_p.ui32_array[3];
+    node_p.si64_array[16 + 2 * num_keys] = key;
+    node_p.ui64_array[17 + 2 * num_keys] = child;
+    node_p.ui32_array[3]++;
+
+    return levels[level].page_num;
+}
+
+void BulkLoader::start_next_node(int level, pagenum_t new_page, int64_t key)
+{
+    pagenum_t parent = add_child(level + 1, key, new_page);
+
+    // the finished node is the last one it can be, and has its parent now.
+    level_t& curr = levels[level];
+    curr.node.ui64_array[0] = parent;
+    add_finished(curr.page_num, curr.node);
+
+    curr.node = page_t(level == 0 ? LEAF_PAGE : INTERNAL_PAGE);
+    curr.node.ui64_array[0] = parent;
+    if(level == 0)
+    {
+        curr.node.ui64_array[13] = curr.page_num;
+        leaf_set_format(&curr.node, delta_leaves, key);
+    }
+    curr.page_num = new_page;
+}
+
+void BulkLoader::add_finished(pagenum_t page_num, const page_t& page)
+{
+    finished.emplace_back(page_num, page);
+    if(finished.size() >= BULK_WRITE_PAGES) write_finished();
+}
+
+void BulkLoader::write_finished()
+{
+    std::sort(finished.begin(), finished.end(),
+        [](const std::pair<pagenum_t, page_t>& a,
+            const std::pair<pagenum_t, page_t>& b)
+        { return a.first < b.first; });
+
+    std::vector<page_t> run;
+    for(size_t i = 0; i < finished.size(); i++)
+    {
+        run.push_back(finished[i].second);
+
+        if(i + 1 == finished.size() ||
+            finished[i + 1].first != finished[i].first + 1)
+        {
+            buffer_manager->write_new_pages(table_id,
+                finished[i].first - run.size() + 1, run.data(), run.size());
+            run.clear();
+        }
+    }
+    finished.clear();
+}
+
+pagenum_t BulkLoader::finish()
+{
+    if(num_records == 0) return 0;
+
+    // rightmost nodes have their parents already, and the root has none.
+    for(auto& i : levels) finished.emplace_back(i.page_num, i.node);
+    write_finished();
+
+    return levels.back().page_num;
+}
@@ -1,272 +1,1867 @@
 #include "../include/bpt.h"
+#include "../include/bulk.h"
 #include "../include/db.h"
 #include "../include/file.h"
+#include "../include/filter.h"
+#include "../include/hash_index.h"
 #include "../include/buffer.h"
+#include "../include/index.h"
+#include "../include/key.h"
+#include "../include/key_tree.h"
+#include "../include/leaf.h"
 #include "../include/trx.h"
 #include "../include/lock_table.h"
+#include "../include/mvcc.h"
+#include "../include/overflow.h"
+#include "../include/record_cache.h"
+#include "../include/scan.h"
 
 #include <iostream>
 #include <stdint.h>
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <numeric>
 
 int64_t open_table(const char* pathname)
 {
     int result = buffer_manager->open_table(pathname);
 
+    // the filter of the table isn't kept in the file.
+    if(result >= 0)
+    {
+        page_t header_p;
+        auto header_bb = buffer_manager->get_block(result, 0, 0, &header_p);
+        if(header_p.ui64_array[4] & TABLE_KEY_FILTER) filter_build(result, 0);
+    }
     return result;
 }
 
+// build the filter of the table again, once more keys have been added to it
+// than it is sized for. it is called by writers before they latch anything.
+static void maintain_filter(int64_t table_id, int trx_id)
+{
+    if(filter_is_full(table_id) == false) return;
+
+    page_t header_p;
+    auto header_bb = buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+    if(filter_is_full(table_id)) filter_build(table_id, trx_id);
+}
+
+
+// set the root in the header page, which is latched by header_bb.
+void write_root(const BufferBlockPointer& header_bb, pagenum_t new_root)
+{
+    // the header has been changed by page allocations since it was read,
+    // so only the root is written over the current one.
+    page_t header_p;
+    buffer_manager->get_page(header_bb, header_p);
+    header_p.ui64_array[3] = new_root;
+    buffer_manager->write_page(header_bb, header_p);
+}
+
+// a value larger than MAX_INLINE_VALUE_SIZE is written into overflow pages,
+// and value and val_size are set to its stub, whose size is marked by
+// SLOT_OVERFLOW. stub should have OVERFLOW_STUB_SIZE bytes.
+static void store_value(int64_t table_id, const char** value,
+    uint16_t* val_size, char* stub, int trx_id)
+{
+    if(*val_size <= MAX_INLINE_VALUE_SIZE) return;
+
+    overflow_write(table_id, *value, *val_size, stub, trx_id);
+    *value = stub;
+    *val_size = OVERFLOW_STUB_SIZE | SLOT_OVERFLOW;
+}
+
+// free the overflow pages of the value given by store_value, which isn't
+// put into the tree.
+static void discard_value(int64_t table_id, const char* value,
+    uint16_t val_size, int trx_id)
+{
+    if(val_size & SLOT_OVERFLOW)
+    {
+        overflow_free(table_id, overflow_first_page(value), trx_id);
+    }
+}
+
+// first overflow page of the index-th record of the leaf, or 0.
+static pagenum_t overflow_of(const page_t& leaf_p, int index)
+{
+    if((leaf_val_size(leaf_p, index) & SLOT_OVERFLOW) == 0) return 0;
+    return overflow_first_page(leaf_val(leaf_p, index));
+}
+
+// copy the whole value of the index-th record of the leaf into out,
+// for the indexes of the table. returns its size.
+static uint16_t copy_value(int64_t table_id, page_t& leaf_p, int index,
+    std::vector<char>* out, int trx_id)
+{
+    std::vector<char> overflow_value;
+    uint16_t size;
+    const char* value = leaf_value(table_id, &leaf_p, index, &size,
+        &overflow_value, trx_id);
+    out->assign(value, value + size);
+    return size;
+}
+
+// returns the index of the record of key in the leaf, or -1.
+static int find_slot(page_t& leaf_p, int64_t key)
+{
+    return leaf_find(leaf_p, key);
+}
+
+// returns the smallest key greater than key, looking at the leaf which
+// has been read already, and at its siblings only if it has no such key.
+static int64_t next_key_in_leaf(int64_t table_id, page_t& leaf_p,
+    int64_t key, int trx_id)
+{
+    int num_keys = leaf_p.si32_array[3];
+    for(int i = 0; i < num_keys; i++)
+    {
+        int64_t c_key = leaf_key(leaf_p, i);
+        if(key < c_key) return c_key;
+    }
+
+    pagenum_t sibling = leaf_p.ui64_array[15];
+    if(sibling == 0) return LOCK_SUPREMUM_KEY;
+    return find_next_key(table_id, sibling, key, trx_id);
+}
+
+// insert a record which doesn't exist into the leaf found by key,
+// whose page has been read into leaf_p.
+// returns false without inserting if its gap is locked by a range scan,
+// and then next_key is set to the key which the scan locked.
+// indexed tells whether the table has indexes, which get the record, too.
+static bool insert_record(int64_t table_id, const BufferBlockPointer& header_bb,
+    pagenum_t root, bool indexed, const BufferBlockPointer& leaf_bb,
+    page_t& leaf_p, int64_t key, const char* value, uint16_t val_size,
+    int trx_id, int64_t* next_key)
+{
+    // the new record must not go into a gap locked by a range scan.
+    // the leaf is kept latched until the record is written,
+    // so that the scan can't validate the leaf in the meantime.
+    *next_key = (leaf_bb.valid == false) ? LOCK_SUPREMUM_KEY
+        : next_key_in_leaf(table_id, leaf_p, key, trx_id);
+
+    if(lock_check_gap(table_id, *next_key, trx_id)) return false;
+
+    // the key is in the filter before anyone can find it in the leaf.
+    filter_add(table_id, key);
+
+    const char* stored = value;
+    uint16_t stored_size = val_size;
+    char stub[OVERFLOW_STUB_SIZE];
+    store_value(table_id, &stored, &stored_size, stub, trx_id);
+
+    // the record didn't exist before this trx.
+    if(trx_id > 0) mvcc_add_version(table_id, key, trx_id, nullptr, 0);
+
+    record new_record(key, stored_size, stored);
+
+    // the leaf has been found already, so the tree isn't traversed again
+    // even if it must be split.
+    if(leaf_bb.valid && insert_into_leaf(&leaf_p, &new_record))
+    {
+        buffer_manager->write_page(leaf_bb, leaf_p);
+    }
+    else
+    {
+        pagenum_t new_root;
+        try
+        {
+            new_root = (leaf_bb.valid == false)
+                ? start_new_tree(table_id, &new_record)
+                : insert_into_leaf_after_splitting(table_id, root,
+                    leaf_bb.page_num, &new_record);
+        }
+        catch(const NoSpaceException& e)
+        {
+            // leaf_p hasn't been changed by insert_into_leaf.
+            if(leaf_bb.valid) buffer_manager->write_page(leaf_bb, leaf_p);
+            if(trx_id > 0) mvcc_remove_version(table_id, key, trx_id);
+            discard_value(table_id, stored, stored_size, trx_id);
+            throw;
+        }
+
+        if(root != new_root) write_root(header_bb, new_root);
+    }
+
+    if(trx_id > 0)
+    {
+        trx_add_rollback_record(trx_id, table_id, key,
+            UNDO_INSERT, nullptr, 0);
+    }
+    if(indexed)
+    {
+        index_record_changed(table_id, key, nullptr, 0, value, val_size,
+            trx_id);
+    }
+    return true;
+}
+
+int db_insert(int64_t table_id, int64_t key, const char* value,
+    uint16_t val_size, int trx_id)
+{
+    // read-only trx can't write anything.
+    if(trx_is_read_only(trx_id)) return -1;
+
+    try
+    {
+        maintain_filter(table_id, trx_id);
+
+        // the key is locked first, so that other trxs can't insert, delete,
+        // or read the record until this trx ends.
+        if(trx_id > 0)
+        {
+            lock_acquire(table_id, LOCK_RECORD_PAGE, key, trx_id,
+                LOCK_MODE_EXCLUSIVE);
+        }
+
+        // the key whose gap the new record goes into
+        int64_t next_key;
+        {
+            page_t header_p, leaf_p;
+
+            // get header page
+            auto header_bb = buffer_manager->get_block(table_id, 0, trx_id,
+                &header_p);
+            LatchedPath path;
+
+            pagenum_t root = header_p.ui64_array[3];
+
+            // the leaf is found once, and the duplicate is looked for in it.
+            BufferBlockPointer leaf_bb = find_leaf(table_id, root, key, trx_id);
+            if(leaf_bb.valid)
+            {
+                buffer_manager->get_page(leaf_bb, leaf_p);
+
+                // failed to insert, since there exists that key
+                if(find_slot(leaf_p, key) != -1) return -1;
+            }
+
+            if(insert_record(table_id, header_bb, root,
+                table_has_indexes(header_p), leaf_bb, leaf_p, key, value,
+                val_size, trx_id, &next_key)) return 0;
+        }
+
+        // wait for the scan without holding any latch, and try again.
+        lock_wait_gap(table_id, next_key, trx_id);
+        return db_insert(table_id, key, value, val_size, trx_id);
+    }
+    catch(const std::exception& e)
+    {
+        // std::cout << e.what() << std::endl;
+        if(trx_id > 0) trx_abort(trx_id);
+        return -1;
+    }
+}
+
+// insert the records of the batch from pos, whose keys are less than
+// upper_bound, into the leaf whose page has been read into leaf_p.
+// the leaf is written once, unless it is split. pos is moved to
+// the first record which isn't handled, and gap_locked is set if it must
+// wait for a range scan locking next_key. returns the number of records
+// inserted, which are put into the indexes of the table if indexed is set.
+static int insert_into_leaf_batch(int64_t table_id,
+    const BufferBlockPointer& header_bb, pagenum_t root, bool indexed,
+    const BufferBlockPointer& leaf_bb, page_t& leaf_p, int64_t upper_bound,
+    const std::vector<int64_t>& keys, const std::vector<const char*>& values,
+    const std::vector<uint16_t>& val_sizes, const std::vector<int>& order,
+    size_t* pos, int trx_id, int64_t* next_key, bool* gap_locked)
+{
+    int num_inserted = 0;
+    bool changed = false;
+    std::vector<int> inserted;
+
+    for(; *pos < order.size(); (*pos)++)
+    {
+        int i = order[*pos];
+        if(upper_bound != INT64_MAX && keys[i] >= upper_bound) break;
+
+        // the key exists already, or appears twice in the batch.
+        if(find_slot(leaf_p, keys[i]) != -1) continue;
+
+        *next_key = next_key_in_leaf(table_id, leaf_p, keys[i], trx_id);
+        if(lock_check_gap(table_id, *next_key, trx_id))
+        {
+            *gap_locked = true;
+            break;
+        }
+
+        filter_add(table_id, keys[i]);
+
+        char stub[OVERFLOW_STUB_SIZE];
+        const char* value = values[i];
+        uint16_t val_size = val_sizes[i];
+        store_value(table_id, &value, &val_size, stub, trx_id);
+
+        // the record didn't exist before this trx.
+        if(trx_id > 0) mvcc_add_version(table_id, keys[i], trx_id, nullptr, 0);
+
+        record new_record(keys[i], val_size, value);
+        bool split = (insert_into_leaf(&leaf_p, &new_record) == false);
+        if(split)
+        {
+            // the leaf is full, so it is split, and the leaf of
+            // the next records is found again.
+            buffer_manager->write_page(leaf_bb, leaf_p);
+            changed = false;
+
+            // sorted records are appended to the end of the leaf, so
+            // the left leaf is kept full instead of being split in half.
+            int num_keys = leaf_p.si32_array[3];
+            int split_size = (keys[i] > leaf_key(leaf_p, num_keys - 1))
+                ? PlainLeaf::BODY_SIZE : LEAF_SPLIT_SIZE;
+
+            pagenum_t new_root;
+            try
+            {
+                new_root = insert_into_leaf_after_splitting(table_id, root,
+                    leaf_bb.page_num, &new_record, split_size);
+            }
+            catch(const NoSpaceException& e)
+            {
+                buffer_manager->write_page(leaf_bb, leaf_p);
+                if(trx_id > 0) mvcc_remove_version(table_id, keys[i], trx_id);
+                discard_value(table_id, value, val_size, trx_id);
+                throw;
+            }
+            if(root != new_root) write_root(header_bb, new_root);
+        }
+        else changed = true;
+
+        if(trx_id > 0)
+        {
+            trx_add_rollback_record(trx_id, table_id, keys[i],
+                UNDO_INSERT, nullptr, 0);
+        }
+        if(indexed) inserted.push_back(i);
+        num_inserted++;
+
+        if(split)
+        {
+            (*pos)++;
+            break;
+        }
+    }
+
+    if(changed) buffer_manager->write_page(leaf_bb, leaf_p);
+
+    // the leaf is written before the indexes are changed.
+    for(int i : inserted)
+    {
+        index_record_changed(table_id, keys[i], nullptr, 0, values[i],
+            val_sizes[i], trx_id);
+    }
+    return num_inserted;
+}
+
+int db_insert_batch(int64_t table_id, const std::vector<int64_t>& keys,
+    const std::vector<const char*>& values,
+    const std::vector<uint16_t>& val_sizes, int trx_id)
+{
+    // read-only trx can't write anything.
+    if(trx_is_read_only(trx_id)) return -1;
+
+    // records are applied in order of keys, so that neighboring keys
+    // go into the same leaf.
+    std::vector<int> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+        [&keys](int a, int b) { return keys[a] < keys[b]; });
+
+    int num_inserted = 0;
+    try
+    {
+        maintain_filter(table_id, trx_id);
+
+        // keys are locked in order, as they are inserted.
+        if(trx_id > 0)
+        {
+            for(int i : order)
+            {
+                lock_acquire(table_id, LOCK_RECORD_PAGE, keys[i], trx_id,
+                    LOCK_MODE_EXCLUSIVE);
+            }
+        }
+
+        size_t pos = 0;
+        while(pos < order.size())
+        {
+            // the key whose gap the next record goes into
+            int64_t next_key;
+            bool gap_locked = false;
+            {
+                page_t header_p, leaf_p;
+                auto header_bb = buffer_manager->get_block(table_id, 0,
+                    trx_id, &header_p);
+                LatchedPath path;
+                pagenum_t root = header_p.ui64_array[3];
+                bool indexed = table_has_indexes(header_p);
+
+                // keys less than upper_bound belong to the leaf.
+                int64_t upper_bound;
+                BufferBlockPointer leaf_bb = find_leaf(table_id, root,
+                    keys[order[pos]], trx_id, &upper_bound);
+
+                if(leaf_bb.valid == false)
+                {
+                    // the first record makes the tree.
+                    int i = order[pos];
+                    if(insert_record(table_id, header_bb, root, indexed,
+                        leaf_bb, leaf_p, keys[i], values[i], val_sizes[i],
+                        trx_id, &next_key))
+                    {
+                        num_inserted++;
+                        pos++;
+                    }
+                    else gap_locked = true;
+                }
+                else
+                {
+                    buffer_manager->get_page(leaf_bb, leaf_p);
+                    num_inserted += insert_into_leaf_batch(table_id, header_bb,
+                        root, indexed, leaf_bb, leaf_p, upper_bound, keys, values,
+                        val_sizes, order, &pos, trx_id, &next_key, &gap_locked);
+                }
+            }
+
+            // wait for the scan without holding any latch, and go on.
+            if(gap_locked) lock_wait_gap(table_id, next_key, trx_id);
+        }
+
+        return num_inserted;
+    }
+    catch(const std::exception& e)
+    {
+        // std::cout << e.what() << std::endl;
+        if(trx_id > 0) trx_abort(trx_id);
+        return -1;
+    }
+}
+
+int db_bulk_load(int64_t table_id, bulk_next_t next, void* arg,
+    double fill_factor)
+{
+    if(fill_factor <= 0 || fill_factor > 1) return -1;
+
+    try
+    {
+        // no one can change the tree while it is built.
+        page_t header_p;
+        auto header_bb = buffer_manager->get_block(table_id, 0, 0, &header_p);
+        if(header_p.ui64_array[3] != 0) return -1;
+
+        // pages are put after the last page of the file, and become part of
+        // the table only when the root is set.
+        BulkLoader loader(table_id, header_p.ui64_array[2], fill_factor);
+
+        int64_t key;
+        const char* value;
+        uint16_t val_size;
+        while(next(arg, &key, &value, &val_size))
+        {
+            // pages are not allocated from the file while the tree is built,
+            // so there is no room for overflow pages.
+            if(val_size > MAX_INLINE_VALUE_SIZE) return -1;
+
+            // records are not sorted.
+            if(loader.add_record(key, value, val_size) == false) return -1;
+        }
+
+        pagenum_t root = loader.finish();
+        if(root == 0) return 0;
+
+        buffer_manager->extend_table(table_id, loader.next_page);
+        write_root(header_bb, root);
+
+        for(int i = 0; i < MAX_INDEXES; i++)
+        {
+            if(index_definition(header_p, i) != 0) index_build(table_id, i, 0);
+        }
+        if(header_p.ui64_array[4] & TABLE_KEY_FILTER) filter_build(table_id, 0);
+
+        return loader.num_records;
+    }
+    catch(const std::exception& e)
+    {
+        // std::cout << e.what() << std::endl;
+        return -1;
+    }
+}
+
+int db_find(int64_t table_id, int64_t key, char * ret_val,
+    uint16_t* val_size, int trx_id)
+{
+    // read-only trx doesn't lock, but reads its snapshot.
+    if(trx_is_read_only(trx_id))
+    {
+        return db_find_snapshot(table_id, key, ret_val, val_size, trx_id);
+    }
+
+    try
+    {
+        // the record is locked before the tree is traversed, since
+        // the tree may change while the lock is waited for.
+        if(trx_id > 0)
+        {
+            lock_acquire(table_id, LOCK_RECORD_PAGE, key, trx_id,
+                LOCK_MODE_SHARED);
+        }
+        if(filter_may_contain(table_id, key) == false) return -1;
+        if(record_cache_get(table_id, key, ret_val, val_size)) return 0;
+
+        // get header page
+        page_t header_p;
+        buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+
+        // extract root page number from root
+        pagenum_t root = header_p.ui64_array[3];
+
+        // the leaf is kept latched while the record is copied.
+        int i;
+        BufferBlockPointer leaf_bb = find_leaf_hashed(table_id, root, key,
+            trx_id, &i);
+        if(i < 0) return -1;
+
+        // a value in overflow pages is read while the leaf is latched.
+        page_t leaf_p;
+        buffer_manager->get_page(leaf_bb, leaf_p);
+        std::vector<char> overflow_value;
+        const char* value = leaf_value(table_id, &leaf_p, i, val_size,
+            &overflow_value, trx_id);
+        memcpy(ret_val, value, *val_size);
+
+        record_cache_put(table_id, key, value, *val_size);
+        return 0;
+    }
+    catch(const std::exception& e)
+    {
+        trx_abort(trx_id);
+        // std::cout << e.what() << std::endl;
+        return -1;
+    }
+}
+
+int db_find_snapshot(int64_t table_id, int64_t key, char * ret_val,
+    uint16_t* val_size, int trx_id)
+{
+    ReadView view;
+    if(trx_get_read_view(trx_id, &view) == false) return -1;
+
+    try
+    {
+        // get header page
+        page_t header_p, leaf_p;
+        buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+
+        // extract root page number from root
+        pagenum_t root = header_p.ui64_array[3];
+
+        int i;
+        BufferBlockPointer leaf_bb = find_leaf_hashed(table_id, root, key,
+            trx_id, &i);
+        if(leaf_bb.valid == false)
+        {
+            return mvcc_read(view, table_id, key, nullptr, 0, ret_val, val_size);
+        }
+
+        // the leaf is kept latched while versions are looked up,
+        // so that the record and its versions are consistent.
+        buffer_manager->get_page(leaf_bb, leaf_p);
+
+        if(i >= 0)
+        {
+            std::vector<char> overflow_value;
+            uint16_t size;
+            const char* value = leaf_value(table_id, &leaf_p, i, &size,
+                &overflow_value, trx_id);
+
+            return mvcc_read(view, table_id, key, value, size, ret_val,
+                val_size);
+        }
+        return mvcc_read(view, table_id, key, nullptr, 0, ret_val, val_size);
+    }
+    catch(const std::exception& e)
+    {
+        // std::cout << e.what() << std::endl;
+        return -1;
+    }
+}
+
+int db_read_value(int64_t table_id, int64_t key, uint16_t offset, char* buf,
+    uint16_t len, uint16_t* read_size, int trx_id)
+{
+    // the version of read-only trx may not be in the page.
+    if(trx_is_read_only(trx_id))
+    {
+        // the version is copied whole, so a buffer large enough for any
+        // value is kept per thread instead of being allocated every call.
+        static thread_local std::vector<char> value(MAX_VALUE_SIZE);
+        uint16_t size;
+        if(db_find_snapshot(table_id, key, value.data(), &size, trx_id) != 0)
+        {
+            return -1;
+        }
+
+        *read_size = (offset < size) ? std::min<int>(len, size - offset) : 0;
+        memcpy(buf, value.data() + offset, *read_size);
+        return 0;
+    }
+
+    try
+    {
+        if(trx_id > 0)
+        {
+            lock_acquire(table_id, LOCK_RECORD_PAGE, key, trx_id,
+                LOCK_MODE_SHARED);
+        }
+        if(filter_may_contain(table_id, key) == false) return -1;
+        if(record_cache_read(table_id, key, offset, buf, len, read_size))
+        {
+            return 0;
+        }
+
+        page_t header_p;
+        buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+        pagenum_t root = header_p.ui64_array[3];
+
+        int i;
+        BufferBlockPointer leaf_bb = find_leaf_hashed(table_id, root, key,
+            trx_id, &i);
+        if(i < 0) return -1;
+
+        // the leaf is kept latched, so that the overflow pages aren't freed.
+        const page_t* leaf = buffer_manager->get_frame(leaf_bb);
+
+        uint16_t slot_size = leaf_val_size(*leaf, i);
+        const char* value = leaf_val(*leaf, i);
+        uint16_t size = (slot_size & SLOT_OVERFLOW)
+            ? overflow_value_size(value) : slot_size;
+
+        *read_size = (offset < size) ? std::min<int>(len, size - offset) : 0;
+        if(slot_size & SLOT_OVERFLOW)
+        {
+            overflow_read(table_id, value, offset, *read_size, buf, trx_id);
+        }
+        else memcpy(buf, value + offset, *read_size);
+        return 0;
+    }
+    catch(const std::exception& e)
+    {
+        // std::cout << e.what() << std::endl;
+        if(trx_id > 0) trx_abort(trx_id);
+        return -1;
+    }
+}
+
+int db_find_many(int64_t table_id, const std::vector<int64_t>& keys,
+    char* values, size_t values_size, std::vector<int>* offsets,
+    std::vector<uint16_t>* val_sizes, int trx_id, bool prefetch)
+{
+    // read-only trx reads the snapshot, as db_find does.
+    ReadView view;
+    bool is_snapshot = trx_is_read_only(trx_id);
+    if(is_snapshot && trx_get_read_view(trx_id, &view) == false) return -1;
+
+    int num_keys = keys.size();
+    std::vector<int> order(num_keys);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+        [&keys](int a, int b) { return keys[a] < keys[b]; });
+
+    std::vector<int64_t> sorted_keys(num_keys);
+    for(int i = 0; i < num_keys; i++) sorted_keys[i] = keys[order[i]];
+
+    offsets->assign(num_keys, -1);
+    val_sizes->assign(num_keys, 0);
+
+    size_t used_size = 0;
+    int num_found = 0;
+    bool is_full = false;
+    std::vector<char> version(is_snapshot ? MAX_VALUE_SIZE : 0);
+    std::vector<char> overflow_value;
+
+    // copy the value of the i-th sorted key into values.
+    auto put_value = [&](int i, const char* page_val, uint16_t page_size)
+    {
+        const char* value = page_val;
+        uint16_t size = page_size;
+        if(is_snapshot)
+        {
+            if(mvcc_read(view, table_id, sorted_keys[i], page_val, page_size,
+                version.data(), &size) != 0) return;
+            value = version.data();
+        }
+        else if(page_val == nullptr) return;
+
+        if(used_size + size > values_size)
+        {
+            is_full = true;
+            return;
+        }
+
+        memcpy(values + used_size, value, size);
+        (*offsets)[order[i]] = used_size;
+        (*val_sizes)[order[i]] = size;
+        used_size += size;
+        num_found++;
+    };
+
+    try
+    {
+        // records are locked in order of keys, as db_find locks them.
+        if(trx_id > 0)
+        {
+            for(int i = 0; i < num_keys; i++)
+            {
+                if(i > 0 && sorted_keys[i] == sorted_keys[i - 1]) continue;
+                lock_acquire(table_id, LOCK_RECORD_PAGE, sorted_keys[i],
+                    trx_id, LOCK_MODE_SHARED);
+            }
+        }
+
+        page_t header_p;
+        buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+        pagenum_t root = header_p.ui64_array[3];
+
+        // versions of deleted records may be read from the empty tree.
+        if(root == 0)
+        {
+            for(int i = 0; i < num_keys && is_full == false; i++)
+            {
+                put_value(i, nullptr, 0);
+            }
+        }
+
+        // keys which are surely not in the table are not looked up,
+        // unless their old versions may be read.
+        std::vector<int> lookup;
+        std::vector<int64_t> lookup_keys;
+        for(int i = 0; i < num_keys; i++)
+        {
+            if(is_snapshot || filter_may_contain(table_id, sorted_keys[i]))
+            {
+                lookup.push_back(i);
+                lookup_keys.push_back(sorted_keys[i]);
+            }
+        }
+
+        find_leaves_many(table_id, root, lookup_keys.data(), lookup.size(),
+            prefetch, [&](page_t& leaf_p, int begin, int end)
+            {
+                // keys are sorted, so slots are looked up from the last one.
+                int num_slots = leaf_p.si32_array[3], slot = 0;
+                for(int j = begin; j < end && is_full == false; j++)
+                {
+                    int i = lookup[j];
+                    while(slot < num_slots
+                        && leaf_key(leaf_p, slot) < sorted_keys[i]) slot++;
+
+                    if(slot < num_slots
+                        && leaf_key(leaf_p, slot) == sorted_keys[i])
+                    {
+                        uint16_t size;
+                        const char* value = leaf_value(table_id, &leaf_p, slot,
+                            &size, &overflow_value, trx_id);
+                        put_value(i, value, size);
+                    }
+                    else put_value(i, nullptr, 0);
+                }
+            }, trx_id);
+
+        return is_full ? -1 : num_found;
+    }
+    catch(const std::exception& e)
+    {
+        // std::cout << e.what() << std::endl;
+        if(trx_id > 0) trx_abort(trx_id);
+        return -1;
+    }
+}
+
+// indexed is set if the table has indexes, which are changed by
+// update_with_split only.
+BufferBlockPointer update_phase_1(int64_t table_id, int64_t key, int trx_id,
+    bool* indexed)
+{
+    page_t header_p, leaf_p;
+    
+    // get header page
+    auto header_bb = buffer_manager->get_block(table_id, 0,
+        trx_id, &header_p);
+
+    // extract root page number from root
+    pagenum_t root = header_p.ui64_array[3];
+    *indexed = table_has_indexes(header_p);
+    BufferBlockPointer leaf_bb = find_leaf(table_id, root, key, trx_id);
+    if(leaf_bb.valid == false) return BufferBlockPointer::unvalid_instance();
+
+    // get leaf page
+    buffer_manager->get_page(leaf_bb, leaf_p);
+
+    if(leaf_find(leaf_p, key) >= 0) return leaf_bb;
+
+    // if there is empty tree
+    return BufferBlockPointer::unvalid_instance(); 
+}
+
+// copy the value of the index-th record of the leaf for rollback and
+// for older snapshots. returns nullptr if it is changed out of trx.
+static char* keep_old_value(int64_t table_id, int64_t key,
+    page_t& leaf_p, int index, int trx_id)
+{
+    // the whole value is kept, since its overflow pages are freed.
+    std::vector<char> overflow_value;
+    uint16_t size;
+    const char* value = leaf_value(table_id, &leaf_p, index, &size,
+        &overflow_value, trx_id);
+
+    char* old_val = trx_alloc_undo(trx_id, size);
+    if(old_val != nullptr)
+    {
+        memcpy(old_val, value, size);
+
+        // old version must be kept before the new one can be read.
+        mvcc_add_version(table_id, key, trx_id, old_val, size);
+    }
+    return old_val;
+}
+
+// write the value over the index-th record of the leaf, whose size may
+// differ from the old one. if the leaf can't hold the new value,
+// the record is taken out and inserted again, splitting the leaf.
+// header_bb must be latched, since the tree may change. the value must
+// have been stored by store_value, and old_chain is set to the overflow
+// pages of the old value, which the caller frees.
+static void replace_record(int64_t table_id, const BufferBlockPointer& header_bb,
+    pagenum_t root, const BufferBlockPointer& leaf_bb, page_t& leaf_p,
+    int index, int64_t key, const char* value, uint16_t val_size,
+    char** old_val, uint16_t* old_val_size, pagenum_t* old_chain, int trx_id)
+{
+    *old_chain = overflow_of(leaf_p, index);
+    *old_val = keep_old_value(table_id, key, leaf_p, index, trx_id);
+    *old_val_size = (*old_chain == 0)
+        ? leaf_val_size(leaf_p, index)
+        : overflow_value_size(leaf_val(leaf_p, index));
+
+    if(update_in_leaf(&leaf_p, index, value, val_size))
+    {
+        buffer_manager->write_page(leaf_bb, leaf_p);
+        record_cache_invalidate(table_id, key);
+        return;
+    }
+
+    // the leaf stays latched, so that no one sees it without the record.
+    page_t leaf_clone = leaf_p;
+    remove_entry_from_node(&leaf_p, key, 0);
+    buffer_manager->write_page(leaf_bb, leaf_p);
+
+    record new_record(key, val_size, value);
+    try
+    {
+        pagenum_t new_root = insert(table_id, root, &new_record);
+        if(root != new_root) write_root(header_bb, new_root);
+        record_cache_invalidate(table_id, key);
+    }
+    catch(const NoSpaceException& e)
+    {
+        buffer_manager->write_page(leaf_bb, leaf_clone);
+        if(*old_val != nullptr) mvcc_remove_version(table_id, key, trx_id);
+        throw;
+    }
+}
+
+// returns 1 without changing anything if the leaf doesn't have enough
+// free space for the new value.
+int update_phase_2(int64_t table_id, pagenum_t leaf, int64_t key,
+    const char* value, uint16_t new_val_size, char** old_val,
+    uint16_t* old_val_size, pagenum_t* old_chain, int trx_id)
+{
+    page_t leaf_p;
+    BufferBlockPointer leaf_bb
+        = buffer_manager->get_block(table_id, leaf, trx_id, &leaf_p);
+
+    int i = find_slot(leaf_p, key);
+    if(i == -1) return -1;
+
+    uint16_t old_stored_size = slot_stored_size(leaf_val_size(leaf_p, i));
+    if(leaf_free_space(leaf_p) + old_stored_size
+        < slot_stored_size(new_val_size)) return 1;
+
+    *old_chain = overflow_of(leaf_p, i);
+    *old_val = keep_old_value(table_id, key, leaf_p, i, trx_id);
+    *old_val_size = (*old_chain == 0) ? old_stored_size
+        : overflow_value_size(leaf_val(leaf_p, i));
+    update_in_leaf(&leaf_p, i, value, new_val_size);
+
+    buffer_manager->write_page(leaf_bb, leaf_p);
+    record_cache_invalidate(table_id, key);
+    return 0;
+}
+
+// version of update_phase_2 for the value which doesn't fit in the leaf,
+// or the record of a table with indexes. it holds the header latch, since
+// the leaf is split, or the indexes are changed. value is the new value
+// given by the user, which is stored as stored.
+static int update_with_split(int64_t table_id, int64_t key, const char* value,
+    uint16_t val_size, const char* stored, uint16_t stored_size,
+    char** old_val, uint16_t* old_val_size, pagenum_t* old_chain, int trx_id)
+{
+    page_t header_p, leaf_p;
+    auto header_bb = buffer_manager->get_block(table_id, 0, trx_id,
+        &header_p);
+    LatchedPath path;
+    pagenum_t root = header_p.ui64_array[3];
+
+    BufferBlockPointer leaf_bb = find_leaf(table_id, root, key, trx_id);
+    if(leaf_bb.valid == false) return -1;
+
+    buffer_manager->get_page(leaf_bb, leaf_p);
+    int i = find_slot(leaf_p, key);
+    if(i == -1) return -1;
+
+    bool indexed = table_has_indexes(header_p);
+    std::vector<char> indexed_value;
+    uint16_t indexed_size = 0;
+    if(indexed)
+    {
+        indexed_size = copy_value(table_id, leaf_p, i, &indexed_value, trx_id);
+    }
+
+    replace_record(table_id, header_bb, root, leaf_bb, leaf_p, i, key,
+        stored, stored_size, old_val, old_val_size, old_chain, trx_id);
+
+    if(indexed)
+    {
+        index_record_changed(table_id, key, indexed_value.data(),
+            indexed_size, value, val_size, trx_id);
+    }
+    return 0;
+}
+
+// change the value of the record, in its leaf if there is enough space.
+// overflow pages of the new value are made before the leaf is latched,
+// and the ones of the old value are freed after it is released.
+static int write_record(int64_t table_id, int64_t key, const char* value,
+    uint16_t new_val_size, char** old_val, uint16_t* old_val_size, int trx_id)
+{
+    const char* stored = value;
+    uint16_t stored_size = new_val_size;
+    char stub[OVERFLOW_STUB_SIZE];
+    store_value(table_id, &stored, &stored_size, stub, trx_id);
+
+    int result;
+    pagenum_t old_chain = 0;
+    try
+    {
+        {
+            bool indexed;
+            BufferBlockPointer leaf_bb = update_phase_1(table_id, key, trx_id,
+                &indexed);
+            result = (leaf_bb.valid == 0) ? -1
+                : indexed ? 1
+                : update_phase_2(table_id, leaf_bb.page_num, key, stored,
+                    stored_size, old_val, old_val_size, &old_chain, trx_id);
+        }
+
+        // the leaf is released, since the header must be latched before it.
+        if(result == 1)
+        {
+            result = update_with_split(table_id, key, value, new_val_size,
+                stored, stored_size, old_val, old_val_size, &old_chain,
+                trx_id);
+        }
+    }
+    catch(const NoSpaceException& e)
+    {
+        discard_value(table_id, stored, stored_size, trx_id);
+        throw;
+    }
+
+    if(result != 0) discard_value(table_id, stored, stored_size, trx_id);
+    else if(old_chain != 0) overflow_free(table_id, old_chain, trx_id);
+    return result;
+}
+
+int db_update(int64_t table_id, int64_t key, char* value, uint16_t new_val_size,
+    uint16_t* old_val_size, int trx_id)
+{
+    char* old_value = nullptr;
+
+    // read-only trx can't write anything.
+    if(trx_is_read_only(trx_id)) return -1;
+
+    // the new value is written as its size says, so an empty one is
+    // rejected. (every size of uint16_t is not over MAX_VALUE_SIZE)
+    if(new_val_size == 0) return -1;
+
+    try
+    {
+        // the record is locked before it is found, so that it can't be
+        // moved to other leaf by the time it is updated.
+        if(trx_id > 0)
+        {
+            lock_acquire(table_id, LOCK_RECORD_PAGE, key, trx_id,
+                LOCK_MODE_EXCLUSIVE);
+        }
+        if(filter_may_contain(table_id, key) == false) return -1;
+
+        int result = write_record(table_id, key, value, new_val_size,
+            &old_value, old_val_size, trx_id);
+        if(result == 0 && old_value != nullptr)
+        {
+            trx_add_rollback_record(trx_id, table_id, key, UNDO_UPDATE,
+                old_value, *old_val_size);
+        }
+
+        return result;
+    }
+    catch(const std::exception& e)
+    {
+        // std::cout << e.what() << std::endl;
+        trx_abort(trx_id);
+        return -1;
+    }
+}
+
+int db_upsert(int64_t table_id, int64_t key, const char* value,
+    uint16_t val_size, int trx_id)
+{
+    // read-only trx can't write anything.
+    if(trx_is_read_only(trx_id)) return -1;
+
+    try
+    {
+        maintain_filter(table_id, trx_id);
+
+        if(trx_id > 0)
+        {
+            lock_acquire(table_id, LOCK_RECORD_PAGE, key, trx_id,
+                LOCK_MODE_EXCLUSIVE);
+        }
+
+        int64_t next_key;
+        {
+            page_t header_p, leaf_p;
+            auto header_bb = buffer_manager->get_block(table_id, 0, trx_id,
+                &header_p);
+            LatchedPath path;
+            pagenum_t root = header_p.ui64_array[3];
+
+            // the same leaf is used whether the record exists or not.
+            BufferBlockPointer leaf_bb = find_leaf(table_id, root, key, trx_id);
+            int i = -1;
+            if(leaf_bb.valid)
+            {
+                buffer_manager->get_page(leaf_bb, leaf_p);
+                i = find_slot(leaf_p, key);
+            }
+
+            if(i != -1)
+            {
+                char stub[OVERFLOW_STUB_SIZE];
+                const char* stored = value;
+                uint16_t stored_size = val_size;
+                store_value(table_id, &stored, &stored_size, stub, trx_id);
+
+                bool indexed = table_has_indexes(header_p);
+                std::vector<char> indexed_value;
+                uint16_t indexed_size = 0;
+                if(indexed)
+                {
+                    indexed_size = copy_value(table_id, leaf_p, i,
+                        &indexed_value, trx_id);
+                }
+
+                char* old_value;
+                uint16_t old_val_size;
+                pagenum_t old_chain;
+                try
+                {
+                    replace_record(table_id, header_bb, root, leaf_bb, leaf_p,
+                        i, key, stored, stored_size, &old_value, &old_val_size,
+                        &old_chain, trx_id);
+                }
+                catch(const NoSpaceException& e)
+                {
+                    discard_value(table_id, stored, stored_size, trx_id);
+                    throw;
+                }
+
+                // the leaf is latched, so no one is reading the old pages.
+                if(old_chain != 0) overflow_free(table_id, old_chain, trx_id);
+
+                if(old_value != nullptr)
+                {
+                    trx_add_rollback_record(trx_id, table_id, key, UNDO_UPDATE,
+                        old_value, old_val_size);
+                }
+                if(indexed)
+                {
+                    index_record_changed(table_id, key, indexed_value.data(),
+                        indexed_size, value, val_size, trx_id);
+                }
+                return 0;
+            }
+
+            if(insert_record(table_id, header_bb, root,
+                table_has_indexes(header_p), leaf_bb, leaf_p, key, value,
+                val_size, trx_id, &next_key)) return 0;
+        }
+
+        // wait for the scan without holding any latch, and try again.
+        lock_wait_gap(table_id, next_key, trx_id);
+        return db_upsert(table_id, key, value, val_size, trx_id);
+    }
+    catch(const std::exception& e)
+    {
+        // std::cout << e.what() << std::endl;
+        if(trx_id > 0) trx_abort(trx_id);
+        return -1;
+    }
+}
+
+void db_undo_update(int64_t table_id, int64_t key, const char* value,
+    uint16_t val_size)
+{
+    // the old value may have a different size.
+    char* old_value;
+    uint16_t old_val_size;
+    write_record(table_id, key, value, val_size, &old_value, &old_val_size, 0);
+}
+
+void db_undo_insert(int64_t table_id, int64_t key)
+{
+    db_delete(table_id, key, 0);
+}
+
+void db_undo_delete(int64_t table_id, int64_t key, const char* value,
+    uint16_t val_size, int trx_id)
+{
+    // the key whose gap the record goes back into
+    int64_t next_key;
+    {
+        page_t header_p, leaf_p;
+        auto header_bb = buffer_manager->get_block(table_id, 0, 0, &header_p);
+        LatchedPath path;
+
+        pagenum_t root = header_p.ui64_array[3];
+        BufferBlockPointer leaf_bb = find_leaf(table_id, root, key, 0);
+        if(leaf_bb.valid) buffer_manager->get_page(leaf_bb, leaf_p);
+
+        // the record must not come back into a gap locked by a range scan,
+        // as for insert_record. the delete has locked the next key, so
+        // the gap is not locked by other trx unless it has been changed
+        // by this trx.
+        next_key = (leaf_bb.valid == false) ? LOCK_SUPREMUM_KEY
+            : next_key_in_leaf(table_id, leaf_p, key, 0);
+
+        if(lock_check_gap(table_id, next_key, trx_id) == false)
+        {
+            const char* stored = value;
+            uint16_t stored_size = val_size;
+            char stub[OVERFLOW_STUB_SIZE];
+            store_value(table_id, &stored, &stored_size, stub, 0);
+
+            filter_add(table_id, key);
+
+            record new_record(key, stored_size, stored);
+            if(leaf_bb.valid && insert_into_leaf(&leaf_p, &new_record))
+            {
+                buffer_manager->write_page(leaf_bb, leaf_p);
+            }
+            else
+            {
+                pagenum_t new_root = (leaf_bb.valid == false)
+                    ? start_new_tree(table_id, &new_record)
+                    : insert_into_leaf_after_splitting(table_id, root,
+                        leaf_bb.page_num, &new_record);
+                if(root != new_root) write_root(header_bb, new_root);
+            }
+
+            if(table_has_indexes(header_p))
+            {
+                index_record_changed(table_id, key, nullptr, 0, value,
+                    val_size, 0);
+            }
+            return;
+        }
+    }
+
+    // wait for the scan without holding any latch, and try again.
+    lock_wait_gap(table_id, next_key, trx_id);
+    db_undo_delete(table_id, key, value, val_size, trx_id);
+}
+
+// locks the key after the record of key: the record with a shared lock, so
+// that it stays, and the gap below it with an exclusive lock, so that no
+// range scan reads the range without the record while rollback may put it
+// back. locks are not waited for while latched, so the next key is looked
+// up again after they are taken, until it hasn't changed meanwhile.
+static void lock_next_key(int64_t table_id, int64_t key, int trx_id)
+{
+    bool locked = false;
+    int64_t locked_key = 0;
+    while(true)
+    {
+        int64_t next_key;
+        {
+            page_t header_p, leaf_p;
+            buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+
+            BufferBlockPointer leaf_bb = find_leaf(table_id,
+                header_p.ui64_array[3], key, trx_id);
+            if(leaf_bb.valid == false) return;
+
+            buffer_manager->get_page(leaf_bb, leaf_p);
+            if(find_slot(leaf_p, key) == -1) return;
+
+            next_key = next_key_in_leaf(table_id, leaf_p, key, trx_id);
+        }
+        if(locked && next_key == locked_key) return;
 
-int db_insert(int64_t table_id, int64_t key, const char* value,
-    uint16_t val_size)
+        if(next_key != LOCK_SUPREMUM_KEY)
+        {
+            lock_acquire(table_id, LOCK_RECORD_PAGE, next_key, trx_id,
+                LOCK_MODE_SHARED);
+        }
+        lock_acquire(table_id, LOCK_GAP_PAGE, next_key, trx_id,
+            LOCK_MODE_EXCLUSIVE);
+        locked = true, locked_key = next_key;
+    }
+}
+
+// lock_next tells whether the next key is locked, which is not done for
+// the ids of byte-string keys, whose gaps are in order of the keys.
+static int delete_record(int64_t table_id, int64_t key, int trx_id,
+    bool lock_next)
 {
+    // read-only trx can't write anything.
+    if(trx_is_read_only(trx_id)) return -1;
+
     try
     {
-        page_t header_p;
+        // other trxs can't read, update or insert the key until this trx ends.
+        if(trx_id > 0)
+        {
+            lock_acquire(table_id, LOCK_RECORD_PAGE, key, trx_id,
+                LOCK_MODE_EXCLUSIVE);
+        }
+        if(filter_may_contain(table_id, key) == false) return -1;
 
+        // no other trx can insert a key before the next key or delete it
+        // while this is held, so it stays the next key until the trx ends.
+        if(trx_id > 0 && lock_next) lock_next_key(table_id, key, trx_id);
+
+        page_t header_p, leaf_p;
         // get header page
-        auto header_bb = buffer_manager->get_block(table_id, 0, 0, &header_p);
+        auto header_bb = buffer_manager->get_block(table_id, 0, trx_id,
+            &header_p);
+        LatchedPath path;
+        // extract root page number from root
+        pagenum_t root = header_p.ui64_array[3];
 
-        // record to insert
-        record new_record(key, val_size, value);
+        BufferBlockPointer leaf_bb = find_leaf(table_id, root, key, trx_id);
+        if(leaf_bb.valid == false) return -1;
 
-        pagenum_t root = header_p.ui64_array[3];
+        buffer_manager->get_page(leaf_bb, leaf_p);
+
+        int i = leaf_find(leaf_p, key);
+
+        // if we could'm find corresponding record,
+        if(i < 0) return -1;
 
-        // initially, checks there are already recode whose key is same with now.
-        record* find_result = find_record(table_id, root, key, 0);
-        if(find_result != nullptr)
+        // keep the deleted record for rollback and for older snapshots.
+        char* old_value = nullptr;
+        uint16_t old_val_size = 0;
+        if(trx_id > 0)
         {
-            // it there exists that key, delete result
-            delete find_result;
+            std::vector<char> overflow_value;
+            const char* value = leaf_value(table_id, &leaf_p, i, &old_val_size,
+                &overflow_value, trx_id);
 
-            // failed to insert
-            return -1;
+            old_value = trx_alloc_undo(trx_id, old_val_size);
+            memcpy(old_value, value, old_val_size);
+            mvcc_add_version(table_id, key, trx_id, old_value, old_val_size);
         }
+        pagenum_t old_chain = overflow_of(leaf_p, i);
 
-        pagenum_t new_root = insert(table_id, root, &new_record);
-        if(root != new_root)
+        bool indexed = table_has_indexes(header_p);
+        std::vector<char> indexed_value;
+        uint16_t indexed_size = 0;
+        if(indexed)
         {
-            header_p.ui64_array[3] = new_root;
-            buffer_manager->write_page(header_bb, header_p);
+            indexed_size = copy_value(table_id, leaf_p, i, &indexed_value,
+                trx_id);
         }
 
+        pagenum_t key_leaf = leaf_bb.page_num;
+        leaf_bb = BufferBlockPointer::unvalid_instance();
+
+        pagenum_t new_root = delete_entry(table_id, root, key_leaf, key, trx_id);
+        
+        // if root has been changed, write it
+        if(root != new_root) write_root(header_bb, new_root);
+
+        if(old_chain != 0) overflow_free(table_id, old_chain, trx_id);
+
+        if(trx_id > 0)
+        {
+            trx_add_rollback_record(trx_id, table_id, key, UNDO_DELETE,
+                old_value, old_val_size);
+        }
+        if(indexed)
+        {
+            index_record_changed(table_id, key, indexed_value.data(),
+                indexed_size, nullptr, 0, trx_id);
+        }
         return 0;
     }
-    catch(const NoSpaceException& e)
+    catch(const std::exception& e)
     {
         // std::cout << e.what() << std::endl;
+        if(trx_id > 0) trx_abort(trx_id);
         return -1;
     }
 }
 
-int db_find(int64_t table_id, int64_t key, char * ret_val,
-    uint16_t* val_size, int trx_id)
+int db_delete(int64_t table_id, int64_t key, int trx_id)
+{
+    return delete_record(table_id, key, trx_id, true);
+}
+
+int db_scan (int64_t table_id, int64_t begin_key, int64_t end_key, 
+    std::vector<int64_t> * keys, std::vector<char*> * values,
+    std::vector<uint16_t> * val_sizes, int trx_id)
 {
     try
     {
         // get header page
         page_t header_p;
         buffer_manager->get_block(table_id, 0, trx_id, &header_p);
-
         // extract root page number from root
         pagenum_t root = header_p.ui64_array[3];
 
-        // find recode
-        record* rec = find_record(table_id, root, key, trx_id);
-
-        if(rec == nullptr)
+        // read-only trx reads the range in its snapshot, without locks.
+        if(trx_is_read_only(trx_id))
         {
-            // if failure, return -1
-            return -1;
-        }
-        else
-        {
-            // set value we find
-            *val_size = rec->size;
-            for(int i = 0; i < rec->size; i++) ret_val[i] = rec->content[i];
-            
-            // deallocate rec pointer
-            delete[] rec->content;
-            delete rec;
-            
+            ReadView view;
+            if(trx_get_read_view(trx_id, &view) == false) return -1;
+
+            find_range_snapshot(table_id, root, begin_key, end_key, keys,
+                values, val_sizes, view);
             return 0;
         }
+
+        find_range(table_id, root, begin_key, end_key, keys, values,
+            val_sizes, trx_id);
+        return 0;
     }
     catch(const std::exception& e)
     {
-        trx_abort(trx_id);
         // std::cout << e.what() << std::endl;
+        if(trx_id != 0) trx_abort(trx_id);
         return -1;
     }
 }
 
-BufferBlockPointer update_phase_1(int64_t table_id, int64_t key, int trx_id)
+
+ScanCursor* db_scan_open(int64_t table_id, int64_t begin_key, int64_t end_key,
+    int trx_id, bool descending)
 {
-    page_t header_p, leaf_p;
+    // no page is read until the first record is asked.
+    return new ScanCursor(table_id, begin_key, end_key, trx_id, descending);
+}
 
-    // get header page
-    auto header_bb = buffer_manager->get_block(table_id, 0,
-        trx_id, &header_p);
+int db_scan_next(ScanCursor* cursor, int64_t* key, const char** value,
+    uint16_t* val_size)
+{
+    try
+    {
+        return cursor->next(key, value, val_size) ? 0 : 1;
+    }
+    catch(const std::exception& e)
+    {
+        cursor->close();
+        cursor->finished = true;
+        if(cursor->trx_id != 0) trx_abort(cursor->trx_id);
+        return -1;
+    }
+}
 
-    // extract root page number from root
-    pagenum_t root = header_p.ui64_array[3];
-    BufferBlockPointer leaf_bb = find_leaf(table_id, root, key, trx_id);
-    if(leaf_bb.valid == false) return BufferBlockPointer::unvalid_instance();
+void db_scan_close(ScanCursor* cursor)
+{
+    cursor->close();
+    delete cursor;
+}
 
-    // get leaf page
-    buffer_manager->get_page(leaf_bb, leaf_p);
+// visit the records in [begin_key, end_key] in the order of the cursor,
+// until visit returns false. returns 0, or -1 if the trx is aborted.
+static int visit_range(int64_t table_id, int64_t begin_key, int64_t end_key,
+    int trx_id, bool descending,
+    const std::function<bool(int64_t key, const char* value,
+        uint16_t val_size)>& visit)
+{
+    ScanCursor cursor(table_id, begin_key, end_key, trx_id, descending);
 
-    int num_keys = leaf_p.si32_array[3];
-    for (int i = 0; i < num_keys; i++)
+    int result;
+    int64_t key;
+    const char* value;
+    uint16_t val_size;
+    while((result = db_scan_next(&cursor, &key, &value, &val_size)) == 0)
+    {
+        if(visit(key, value, val_size) == false) break;
+    }
+    return (result == -1) ? -1 : 0;
+}
+
+int db_count(int64_t table_id, int64_t begin_key, int64_t end_key,
+    int64_t* count, int trx_id)
+{
+    *count = 0;
+    return visit_range(table_id, begin_key, end_key, trx_id, false,
+        [&](int64_t, const char*, uint16_t)
+        {
+            (*count)++;
+            return true;
+        });
+}
+
+int db_sum(int64_t table_id, int64_t begin_key, int64_t end_key,
+    int64_t* sum, int trx_id)
+{
+    bool is_numeric = true;
+    *sum = 0;
+    int result = visit_range(table_id, begin_key, end_key, trx_id, false,
+        [&](int64_t, const char* value, uint16_t val_size)
+        {
+            if(val_size != sizeof(int64_t))
+            {
+                is_numeric = false;
+                return false;
+            }
+
+            // values in the page may not be aligned.
+            int64_t number;
+            memcpy(&number, value, sizeof(number));
+            *sum += number;
+            return true;
+        });
+    return is_numeric ? result : -1;
+}
+
+int db_min_key(int64_t table_id, int64_t begin_key, int64_t end_key,
+    int64_t* key, int trx_id)
+{
+    bool found = false;
+    int result = visit_range(table_id, begin_key, end_key, trx_id, false,
+        [&](int64_t c_key, const char*, uint16_t)
+        {
+            *key = c_key;
+            found = true;
+            return false;
+        });
+    return found ? result : -1;
+}
+
+int db_max_key(int64_t table_id, int64_t begin_key, int64_t end_key,
+    int64_t* key, int trx_id)
+{
+    bool found = false;
+    int result = visit_range(table_id, begin_key, end_key, trx_id, true,
+        [&](int64_t c_key, const char*, uint16_t)
+        {
+            *key = c_key;
+            found = true;
+            return false;
+        });
+    return found ? result : -1;
+}
+
+// at most this many keys which may have been left without a record are
+// looked at by each change of byte-string keys.
+#define RECLAIM_KEYS_PER_CHANGE 4
+
+// take the keys left without a record out of the tree of keys, once
+// nothing can refer to their ids: no trx holds or waits for a lock on the
+// id, which it may still write the record under, and no old version is
+// kept, which a snapshot may still read through the key. the ones which
+// are still referred to are looked at again later.
+static void reclaim_keys()
+{
+    FrameWait frame_wait;
+
+    for(int i = 0; i < RECLAIM_KEYS_PER_CHANGE; i++)
     {
-        if(leaf_p.get_pos_value<int64_t>(128 + i * 12) == key)
+        int64_t table_id, id;
+        std::string key;
+        if(key_tree_take_unused(&table_id, &key, &id) == false) return;
+
+        // records are inserted under the header latch, so none is
+        // inserted under the id until the key is taken out.
+        page_t header_p;
+        auto header_bb = buffer_manager->get_block(table_id, 0, 0, &header_p);
+
+        if(lock_is_used(table_id, id) || mvcc_has_versions(table_id, id))
         {
-            return leaf_bb;
+            key_tree_add_unused(table_id, key.data(), key.size(), id);
+            continue;
         }
-    }
 
-    // if there is empty tree
-    return BufferBlockPointer::unvalid_instance(); 
+        bool exists;
+        {
+            BufferBlockPointer leaf_bb = find_leaf(table_id,
+                header_p.ui64_array[3], id, 0);
+            exists = leaf_bb.valid
+                && leaf_find(*buffer_manager->get_frame(leaf_bb), id) != -1;
+        }
+        if(exists == false)
+        {
+            key_tree_remove(table_id, key.data(), key.size(), id);
+        }
+    }
 }
 
-int update_phase_2(int64_t table_id, pagenum_t leaf, int64_t key, char* value,
-    uint16_t new_val_size, char** old_val, uint16_t* old_val_size,
-    uint16_t* offset, int trx_id)
+int db_insert_key(int64_t table_id, const char* key, uint16_t key_size,
+    const char* value, uint16_t val_size, int trx_id)
 {
-    page_t leaf_p;
-    BufferBlockPointer leaf_bb
-        = buffer_manager->get_block(table_id, leaf, trx_id, &leaf_p);
-    int num_keys = leaf_p.si32_array[3], i;
+    // read-only trx can't write anything.
+    if(trx_is_read_only(trx_id)) return -1;
+    if(key_size > KEY_MAX_SIZE) return -1;
 
-    for (i = 0; i < num_keys; i++)
+    while(true)
     {
-        if(leaf_p.get_pos_value<int64_t>(128 + i * 12) == key)
+        int64_t id = -1, gap, found;
+        try
         {
-            *old_val_size = leaf_p.get_pos_value<uint16_t>(128 + i * 12 + 8);
-            *old_val = new char[*old_val_size];
-            *offset = leaf_p.get_pos_value<uint16_t>(128 + i * 12 + 10);
+            // wait for the scan without holding any latch, and try again.
+            id = key_tree_insert(table_id, key, key_size, trx_id, &gap);
+            if(id < 0)
+            {
+                lock_wait_gap(table_id, gap, trx_id);
+                continue;
+            }
 
-            for(uint16_t j = 0; j < new_val_size; j++)
+            // the key may be taken out of the tree before the record is
+            // inserted. once the id is locked, it isn't, so the key is
+            // looked up again after that.
+            if(trx_id > 0)
             {
-                (*old_val)[j] = leaf_p.c_array[j + (*offset)];
-                leaf_p.c_array[j + (*offset)] = value[j];
+                lock_acquire(table_id, LOCK_RECORD_PAGE, id, trx_id,
+                    LOCK_MODE_EXCLUSIVE);
+                if(key_tree_find(table_id, key, key_size, &found, trx_id)
+                    == false || found != id) continue;
             }
-            buffer_manager->write_page(leaf_bb, leaf_p);
-            // get lock
-            return 0;
         }
+        catch(const std::exception& e)
+        {
+            // std::cout << e.what() << std::endl;
+            if(trx_id > 0) trx_abort(trx_id);
+            if(id >= 0) key_tree_add_unused(table_id, key, key_size, id);
+            return -1;
+        }
+
+        // no latch is held, so the record is inserted as any other one,
+        // waiting for the locks it needs.
+        int result = db_insert(table_id, id, value, val_size, trx_id);
+
+        // without a lock, the key is looked up after the record is
+        // inserted instead, and the record is taken back if the key has
+        // been taken out of the tree meanwhile.
+        if(trx_id == 0 && result == 0
+            && (key_tree_find(table_id, key, key_size, &found, 0) == false
+                || found != id))
+        {
+            db_delete(table_id, id, 0);
+            continue;
+        }
+
+        // a failed insert leaves the key unused, and so does the rollback
+        // of the trx.
+        if(trx_id > 0 || result != 0)
+        {
+            key_tree_add_unused(table_id, key, key_size, id);
+        }
+        reclaim_keys();
+        return result;
     }
-    
-    return -1;
 }
 
-int db_update(int64_t table_id, int64_t key, char* value, uint16_t new_val_size,
-    uint16_t* old_val_size, int trx_id)
+int db_find_key(int64_t table_id, const char* key, uint16_t key_size,
+    char* ret_val, uint16_t* val_size, int trx_id)
 {
-    char* old_value;
-    uint16_t offset;
+    int64_t id;
     try
     {
-        pagenum_t leaf;
+        if(key_tree_find(table_id, key, key_size, &id, trx_id) == false)
         {
-            BufferBlockPointer leaf_bb = update_phase_1(table_id, key, trx_id);
-            if(leaf_bb.valid == 0) return -1;
-            leaf = leaf_bb.page_num;
+            return -1;
         }
+    }
+    catch(const std::exception& e)
+    {
+        // std::cout << e.what() << std::endl;
+        if(trx_id > 0) trx_abort(trx_id);
+        return -1;
+    }
+    return db_find(table_id, id, ret_val, val_size, trx_id);
+}
 
-        lock_acquire(table_id, leaf, key, trx_id, LOCK_MODE_EXCLUSIVE);
-
-        int result = update_phase_2(table_id, leaf, key, value, new_val_size,
-            &old_value, old_val_size, &offset, trx_id);
-        // TODO
-        trx_add_rollback_record(
-            trx_id, table_id, leaf, offset, old_value, *old_val_size);
+int db_delete_key(int64_t table_id, const char* key, uint16_t key_size,
+    int trx_id)
+{
+    // read-only trx can't write anything.
+    if(trx_is_read_only(trx_id)) return -1;
 
-        return result;
+    int64_t id;
+    try
+    {
+        if(key_tree_find(table_id, key, key_size, &id, trx_id) == false)
+        {
+            return -1;
+        }
     }
     catch(const std::exception& e)
     {
         // std::cout << e.what() << std::endl;
-        trx_abort(trx_id);
+        if(trx_id > 0) trx_abort(trx_id);
         return -1;
     }
+
+    // the key keeps its id until nothing refers to it, so that it is found
+    // again on rollback, and by the snapshots which have read it. a scan
+    // locks the id, so no gap lock is needed for the record to come back.
+    int result = delete_record(table_id, id, trx_id, false);
+    if(result == 0) key_tree_add_unused(table_id, key, key_size, id);
+    reclaim_keys();
+    return result;
 }
 
-void db_update_with_page(int table_id, pagenum_t page_num, uint16_t offset,
-    const char* value, uint16_t val_size, int trx_id)
+int db_scan_keys(int64_t table_id, const char* begin_key,
+    uint16_t begin_size, const char* end_key, uint16_t end_size,
+    std::vector<std::string>* keys, std::vector<char*>* values,
+    std::vector<uint16_t>* val_sizes, int trx_id)
 {
-    page_t leaf_p;
-    BufferBlockPointer leaf_bb = buffer_manager->get_block(
-        table_id, page_num, trx_id, &leaf_p);
+    std::vector<std::string> found_keys, check_keys;
+    std::vector<int64_t> ids, check_ids;
+    int64_t next_id, check_next_id;
+    try
+    {
+        key_tree_scan(table_id, begin_key, begin_size, end_key, end_size,
+            &found_keys, &ids, &next_id, trx_id);
+
+        // each key of the range and the first one after it get a next-key
+        // lock on their ids, as find_range_locking does. the locks are
+        // taken without any latch, and the range is read again until it
+        // hasn't changed meanwhile.
+        while(trx_id > 0)
+        {
+            for(int64_t id : ids)
+            {
+                lock_acquire(table_id, LOCK_RECORD_PAGE, id, trx_id,
+                    LOCK_MODE_SHARED);
+                lock_acquire(table_id, LOCK_GAP_PAGE, key_gap(id), trx_id,
+                    LOCK_MODE_SHARED);
+            }
+            if(next_id >= 0)
+            {
+                lock_acquire(table_id, LOCK_RECORD_PAGE, next_id, trx_id,
+                    LOCK_MODE_SHARED);
+            }
+            lock_acquire(table_id, LOCK_GAP_PAGE, key_gap(next_id), trx_id,
+                LOCK_MODE_SHARED);
+
+            check_keys.clear(), check_ids.clear();
+            key_tree_scan(table_id, begin_key, begin_size, end_key, end_size,
+                &check_keys, &check_ids, &check_next_id, trx_id);
+            if(check_ids == ids && check_next_id == next_id) break;
+
+            found_keys.swap(check_keys), ids.swap(check_ids);
+            next_id = check_next_id;
+        }
+    }
+    catch(const std::exception& e)
+    {
+        // std::cout << e.what() << std::endl;
+        if(trx_id > 0) trx_abort(trx_id);
+        return -1;
+    }
 
-    for(uint16_t i = 0; i < val_size; i++)
+    // records are read by their ids, skipping the ones of deleted keys.
+    std::vector<char> value(MAX_VALUE_SIZE);
+    for(size_t i = 0; i < ids.size(); i++)
     {
-        leaf_p.c_array[offset + i] = value[i];
+        uint16_t val_size;
+        if(db_find(table_id, ids[i], value.data(), &val_size, trx_id) != 0)
+        {
+            // the trx has been aborted by a deadlock.
+            if(trx_id > 0 && trx_get(trx_id) == nullptr) return -1;
+            continue;
+        }
+
+        auto copied = new char[val_size];
+        memcpy(copied, value.data(), val_size);
+
+        keys->push_back(std::move(found_keys[i]));
+        values->push_back(copied);
+        val_sizes->push_back(val_size);
     }
-    buffer_manager->write_page(leaf_bb, leaf_p);
+    return 0;
+}
+
+void db_set_scan_readahead(int num_leaves)
+{
+    scan_readahead_window = std::max(num_leaves, 0);
+}
+
+void db_set_adaptive_hash(bool enable)
+{
+    hash_index_enable(enable);
+}
+
+void db_adaptive_hash_stats(uint64_t* hits, uint64_t* misses)
+{
+    hash_index_stats(hits, misses);
+}
+
+void db_set_record_cache(size_t capacity)
+{
+    record_cache_resize(capacity);
 }
 
+void db_record_cache_stats(uint64_t* hits, uint64_t* misses)
+{
+    record_cache_stats(hits, misses);
+}
 
-int db_delete(int64_t table_id, int64_t key)
+int db_set_delta_leaves(int64_t table_id, bool enable)
 {
     try
     {
         page_t header_p;
-        // get header page
         auto header_bb = buffer_manager->get_block(table_id, 0, 0, &header_p);
-        // extract root page number from root
-        pagenum_t root = header_p.ui64_array[3];
 
+        if(enable) header_p.ui64_array[4] |= TABLE_DELTA_LEAVES;
+        else header_p.ui64_array[4] &= ~(uint64_t)TABLE_DELTA_LEAVES;
+        buffer_manager->write_page(header_bb, header_p);
+        return 0;
+    }
+    catch(const std::exception& e)
+    {
+        // std::cout << e.what() << std::endl;
+        return -1;
+    }
+}
 
-        pagenum_t key_leaf = find_leaf(table_id, root, key, 0).page_num;
-        record* key_record = find_record(table_id, root, key, 0);
+int db_set_key_filter(int64_t table_id, bool enable)
+{
+    try
+    {
+        page_t header_p;
+        auto header_bb = buffer_manager->get_block(table_id, 0, 0, &header_p);
 
-        // if we find corresponding record
-        if (key_record != nullptr && key_leaf != 0) {
-            pagenum_t new_root = delete_entry(table_id, root, key_leaf, key, 0);
-            
-            // if root has been changed, write it
-            if(root != new_root)
-            {
-                header_p.ui64_array[3] = new_root;
-                buffer_manager->write_page(header_bb, header_p);
-            }
-            return 0;
-        }
-        // if we could'm find corresponding record,
-        else
-        {
-            return -1;
-        }
+        if(enable) header_p.ui64_array[4] |= TABLE_KEY_FILTER;
+        else header_p.ui64_array[4] &= ~(uint64_t)TABLE_KEY_FILTER;
+        buffer_manager->write_page(header_bb, header_p);
+
+        if(enable) filter_build(table_id, 0);
+        else filter_drop(table_id);
+        return 0;
     }
-    catch(const NoSpaceException& e)
+    catch(const std::exception& e)
     {
         // std::cout << e.what() << std::endl;
         return -1;
     }
 }
 
-int db_scan (int64_t table_id, int64_t begin_key, int64_t end_key, 
-    std::vector<int64_t> * keys, std::vector<char*> * values,  std::vector<uint16_t> * val_sizes)
+int db_create_index(int64_t table_id, uint16_t offset,
+    uint16_t include_offset, uint16_t include_size)
 {
+    if(include_size > MAX_INDEX_INCLUDED_SIZE) return -1;
+
+    int index_id = -1;
     try
     {
-        // get header page
+        // writers wait for the header while the index is built.
         page_t header_p;
         auto header_bb = buffer_manager->get_block(table_id, 0, 0, &header_p);
-        // extract root page number from root
-        pagenum_t root = header_p.ui64_array[3];
 
-        find_range(table_id, root, begin_key, end_key, keys, values, val_sizes);
-        return 0;
+        for(int i = 0; i < MAX_INDEXES && index_id == -1; i++)
+        {
+            if(index_definition(header_p, i) == 0) index_id = i;
+        }
+        if(index_id == -1) return -1;
+
+        header_p.ui64_array[INDEX_HEADER_SLOT + 2 * index_id] = 0;
+        header_p.ui64_array[INDEX_HEADER_SLOT + 2 * index_id + 1]
+            = index_make_definition(offset, include_offset, include_size);
+        buffer_manager->write_page(header_bb, header_p);
+
+        index_build(table_id, index_id, 0);
+        return index_id;
     }
-    catch(const NoSpaceException& e)
+    catch(const std::exception& e)
     {
         // std::cout << e.what() << std::endl;
+        // the index is dropped, and the pages it had are left unused.
+        if(index_id != -1)
+        {
+            page_t header_p;
+            auto header_bb = buffer_manager->get_block(table_id, 0, 0,
+                &header_p);
+            header_p.ui64_array[INDEX_HEADER_SLOT + 2 * index_id] = 0;
+            header_p.ui64_array[INDEX_HEADER_SLOT + 2 * index_id + 1] = 0;
+            buffer_manager->write_page(header_bb, header_p);
+        }
         return -1;
     }
 }
 
+int db_index_find(int64_t table_id, int index_id, int32_t low, int32_t high,
+    std::vector<int64_t>* keys, std::vector<std::string>* included)
+{
+    if(index_id < 0 || index_id >= MAX_INDEXES || low > high) return -1;
+
+    try
+    {
+        {
+            page_t header_p;
+            buffer_manager->get_block(table_id, 0, 0, &header_p);
+            if(index_definition(header_p, index_id) == 0) return -1;
+        }
+
+        // entries of [low, high] have any primary key in their lower bits.
+        ScanCursor cursor(table_id, index_key(low, 0),
+            index_key(high, UINT32_MAX), 0);
+        cursor.root_slot = INDEX_HEADER_SLOT + 2 * index_id;
+
+        int64_t ikey;
+        const char* entry;
+        uint16_t entry_size;
+        while(cursor.next(&ikey, &entry, &entry_size))
+        {
+            for(uint32_t offset = 0; offset < entry_size; )
+            {
+                int64_t key;
+                const char* bytes;
+                uint16_t size;
+                offset = index_item(entry, offset, &key, &bytes, &size);
+
+                keys->push_back(key);
+                if(included != nullptr) included->emplace_back(bytes, size);
+            }
+        }
+        return 0;
+    }
+    catch(const std::exception& e)
+    {
+        // std::cout << e.what() << std::endl;
+        return -1;
+    }
+}
 
 int init_db(int num_buf)
 {
@@ -276,6 +1871,17 @@ int init_db(int num_buf)
 
 int shutdown_db()
 {
+    // changes of unfinished trxs are undone while the tables are open.
+    trx_abort_all();
+
+    // write the dirty pages before the files are closed.
+    buffer_manager->clear_pages();
     buffer_manager->close_tables();
+    filter_clear();
+    hash_index_clear();
+    record_cache_clear();
+    mvcc_clear();
+    lock_table_clear();
+    key_tree_clear();
     return 0;
 }
\ No newline at end of file
@@ -1,12 +1,15 @@
 #include <map>
 #include <memory.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <stdexcept>
 #include <exception>
 #include <iostream>
 #include <cstdio>
 
 #include "../include/file.h"
+#include "../include/leaf.h"
+#include "../include/overflow.h"
 
 constexpr uint64_t MAGIC_NUMBER = 2022;
 
@@ -26,7 +29,7 @@ page_t::page_t(PAGE_TYPE type)
 		clear();
 		ui32_array[2] = 1; // is_leaf = true
 		ui32_array[3] = 0; // number of keys = 0;
-		ui64_array[112 / 8] = PAGE_SIZE - 128; // amount of free space
+		ui64_array[PlainLeaf::FREE_SPACE_OFFSET / 8] = PlainLeaf::BODY_SIZE; // amount of free space
 		break;
 
 	case INTERNAL_PAGE:
@@ -35,6 +38,11 @@ page_t::page_t(PAGE_TYPE type)
 		ui32_array[3] = 0; // number of keys = 0;
 		break;
 
+	case OVERFLOW_PAGE:
+		clear();
+		ui32_array[2] = 2; // neither leaf nor internal
+		break;
+
 	default:
 		break;
 	}
@@ -49,9 +57,9 @@ void page_t::print_page(PAGE_TYPE type)
 			uint32_t num_keys = ui32_array[3];
 			for(uint32_t i = 0; i < num_keys; i++)
 			{
-				uint16_t size = get_pos_value<uint16_t>(128 + 8 + i * 12);
-				uint16_t offset = get_pos_value<uint16_t>(128 + 10 + i * 12);
-				std::cout << get_pos_value<int64_t>(128 + i * 12) << ", ";
+				uint16_t size = slot_stored_size(leaf_val_size(*this, i));
+				uint16_t offset = leaf_val_offset(*this, i);
+				std::cout << leaf_key(*this, i) << ", ";
 				std::cout << size << ", ";
 				std::cout << offset << " : ";
 
@@ -69,8 +77,16 @@ void page_t::print_page(PAGE_TYPE type)
 			for(uint32_t i = 0; i < num_keys; i++)
 				std::cout << "|" << si64_array[16 + i * 2] << "|o"
 				<< si64_array[17 + i * 2];
-			break;}
 			puts("");
+			break;}
+
+		case OVERFLOW_PAGE:
+			std::cout << "next " << ui64_array[0] << ", ";
+			std::cout << ui32_array[3] << " bytes\n";
+			break;
+
+		default:
+			break;
 	}
 	std::cout << "==========================================" << std::endl;
 }
@@ -140,6 +156,7 @@ int64_t file_open_table_file(const char* pathname)
 	file_read_page(fd, 0, &header_page);
 	if (header_page.ui64_array[0] != MAGIC_NUMBER)
 	{
+		Table_files.erase(fd);
 		fclose(db_file);
 		db_file = nullptr;
 		return -1;
@@ -237,6 +254,41 @@ void file_write_page(int64_t table_id, pagenum_t page_number, const struct page_
 	}
 }
 
+// Write count in-memory pages(src) to the consecutive on-disk pages
+// from first_page, synchronizing them only once
+void file_write_pages(int64_t table_id, pagenum_t first_page,
+	const struct page_t* src, int count)
+{
+	auto file_it = Table_files.find(table_id);
+	if (file_it == Table_files.end())
+	{
+		throw std::out_of_range("Wrong table id!");
+	}
+
+	FILE* file = file_it->second;
+	fseek(file, first_page * PAGE_SIZE, SEEK_SET);
+	fwrite(src, sizeof(page_t), count, file);
+
+	// Synchronize the pages on disk and the pages in memory.
+	if(fsync(table_id) != 0)
+	{
+		throw std::runtime_error("Failed to synchronize disk and memory.");
+	}
+}
+
+// Let the OS read count on-disk pages from first_page in the background
+void file_prefetch_pages(int64_t table_id, pagenum_t first_page, int count)
+{
+	if (Table_files.find(table_id) == Table_files.end())
+	{
+		throw std::out_of_range("Wrong table id!");
+	}
+
+	// it is only a hint, so failure is ignored.
+	posix_fadvise(table_id, first_page * PAGE_SIZE, (off_t)count * PAGE_SIZE,
+		POSIX_FADV_WILLNEED);
+}
+
 // Close the database file
 void file_close_table_files()
 {
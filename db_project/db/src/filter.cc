@@ -0,0 +1,189 @@
+#include "../include/filter.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "../include/bpt.h"
+#include "../include/buffer.h"
+#include "../include/leaf.h"
+
+struct key_filter_t
+{
+    // number of bits, which is a power of two
+    uint64_t num_bits;
+    std::unique_ptr<std::atomic<uint64_t>[]> bits;
+
+    // number of keys it is sized for, and the number added
+    size_t capacity;
+    std::atomic<size_t> num_keys;
+};
+
+struct filter_slot_t
+{
+    // table which has taken the slot, or -1
+    std::atomic<int64_t> table_id{-1};
+    std::atomic<key_filter_t*> filter{nullptr};
+
+    // filters replaced by newer ones, which readers may still be using.
+    // they are freed when the tables are closed. (each is half the size
+    // of the next, so they take less memory than the one in use)
+    std::vector<std::unique_ptr<key_filter_t>> retired;
+};
+
+// slots of the tables, found by probing from the table id. the latch is
+// taken only to build and drop filters.
+filter_slot_t Filter_slots[FILTER_MAX_TABLES];
+pthread_mutex_t filter_latch = PTHREAD_MUTEX_INITIALIZER;
+
+// number of tables with filters, so that others don't look for theirs.
+std::atomic<int> Num_filters(0);
+
+// find the slot of the table. if there is none, a free slot is taken when
+// take is true, which is done under the latch.
+static filter_slot_t* find_slot(int64_t table_id, bool take)
+{
+    for(int i = 0; i < FILTER_MAX_TABLES; i++)
+    {
+        filter_slot_t& slot
+            = Filter_slots[((uint64_t)table_id + i) % FILTER_MAX_TABLES];
+        int64_t slot_table_id = slot.table_id.load(std::memory_order_acquire);
+
+        if(slot_table_id == table_id) return &slot;
+        if(slot_table_id == -1)
+        {
+            if(take == false) return nullptr;
+            slot.table_id.store(table_id, std::memory_order_release);
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+static key_filter_t* get_filter(int64_t table_id)
+{
+    if(Num_filters.load(std::memory_order_acquire) == 0) return nullptr;
+
+    filter_slot_t* slot = find_slot(table_id, false);
+    if(slot == nullptr) return nullptr;
+    return slot->filter.load(std::memory_order_acquire);
+}
+
+// the latch should be held.
+static void retire_filter(filter_slot_t* slot, key_filter_t* filter)
+{
+    if(filter == nullptr) return;
+    slot->retired.emplace_back(filter);
+    Num_filters--;
+}
+
+// hash of the key, whose halves give the probes by double hashing.
+static uint64_t filter_hash(int64_t key)
+{
+    uint64_t x = (uint64_t)key + 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static void add_key(key_filter_t* filter, int64_t key)
+{
+    uint64_t hash = filter_hash(key);
+    uint64_t step = (hash >> 32) | 1;
+    for(int i = 0; i < FILTER_NUM_PROBES; i++, hash += step)
+    {
+        uint64_t bit = hash & (filter->num_bits - 1);
+        filter->bits[bit / 64].fetch_or(1ULL << (bit % 64),
+            std::memory_order_release);
+    }
+    filter->num_keys.fetch_add(1, std::memory_order_relaxed);
+}
+
+void filter_build(int64_t table_id, int trx_id)
+{
+    page_t header_p;
+    buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+    pagenum_t root = header_p.ui64_array[3];
+
+    std::vector<int64_t> keys;
+    visit_leaves(table_id, root, [&keys](page_t& leaf_p)
+        {
+            int num_keys = leaf_p.si32_array[3];
+            for(int i = 0; i < num_keys; i++)
+            {
+                keys.push_back(leaf_key(leaf_p, i));
+            }
+        }, trx_id);
+
+    std::unique_ptr<key_filter_t> filter(new key_filter_t);
+    filter->capacity = std::max<size_t>(keys.size() * 2, FILTER_MIN_KEYS);
+    filter->num_bits = 64;
+    while(filter->num_bits < filter->capacity * FILTER_BITS_PER_KEY)
+    {
+        filter->num_bits *= 2;
+    }
+    filter->bits.reset(new std::atomic<uint64_t>[filter->num_bits / 64]());
+    filter->num_keys = 0;
+    for(int64_t key : keys) add_key(filter.get(), key);
+
+    pthread_mutex_lock(&filter_latch);
+    filter_slot_t* slot = find_slot(table_id, true);
+    if(slot != nullptr)
+    {
+        Num_filters++;
+        retire_filter(slot, slot->filter.exchange(filter.release()));
+    }
+    pthread_mutex_unlock(&filter_latch);
+}
+
+void filter_drop(int64_t table_id)
+{
+    pthread_mutex_lock(&filter_latch);
+    filter_slot_t* slot = find_slot(table_id, false);
+    if(slot != nullptr) retire_filter(slot, slot->filter.exchange(nullptr));
+    pthread_mutex_unlock(&filter_latch);
+}
+
+void filter_clear()
+{
+    pthread_mutex_lock(&filter_latch);
+    for(auto& slot : Filter_slots)
+    {
+        delete slot.filter.exchange(nullptr);
+        slot.retired.clear();
+        slot.table_id = -1;
+    }
+    Num_filters = 0;
+    pthread_mutex_unlock(&filter_latch);
+}
+
+void filter_add(int64_t table_id, int64_t key)
+{
+    key_filter_t* filter = get_filter(table_id);
+    if(filter != nullptr) add_key(filter, key);
+}
+
+bool filter_may_contain(int64_t table_id, int64_t key)
+{
+    key_filter_t* filter = get_filter(table_id);
+    if(filter == nullptr) return true;
+
+    uint64_t hash = filter_hash(key);
+    uint64_t step = (hash >> 32) | 1;
+    for(int i = 0; i < FILTER_NUM_PROBES; i++, hash += step)
+    {
+        uint64_t bit = hash & (filter->num_bits - 1);
+        uint64_t word = filter->bits[bit / 64].load(std::memory_order_acquire);
+        if((word & (1ULL << (bit % 64))) == 0) return false;
+    }
+    return true;
+}
+
+bool filter_is_full(int64_t table_id)
+{
+    key_filter_t* filter = get_filter(table_id);
+    return filter != nullptr && filter->num_keys.load() > filter->capacity;
+}
@@ -0,0 +1,201 @@
+#include "../include/hash_index.h"
+
+#include <pthread.h>
+
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+struct hash_entry_t
+{
+    pagenum_t leaf;
+    int slot;
+};
+
+struct table_hash_index_t
+{
+    std::unordered_map<int64_t, hash_entry_t> entries;
+
+    // keys whose entries may be on each leaf. (an entry may have been
+    // made again on another leaf)
+    std::unordered_map<pagenum_t, std::vector<int64_t>> keys_of_leaf;
+
+    // number of lookups of the keys without entries
+    std::unordered_map<int64_t, int> lookups;
+};
+
+struct alignas(64) hash_partition_t
+{
+    pthread_mutex_t latch = PTHREAD_MUTEX_INITIALIZER;
+
+    // indexes by table id, of the keys in this partition
+    std::unordered_map<int64_t, table_hash_index_t> tables;
+
+    // number of entries of all tables, so that pages are dropped without
+    // the latch while there is none.
+    std::atomic<size_t> num_entries{0};
+
+    // counted under the latch, instead of in shared counters.
+    uint64_t hits = 0, misses = 0;
+};
+
+hash_partition_t Hash_partitions[HASH_INDEX_PARTITIONS];
+
+std::atomic<bool> Hash_index_enabled(true);
+
+static hash_partition_t& partition_of(int64_t table_id, int64_t key)
+{
+    uint64_t x = (uint64_t)key * 0x9e3779b97f4a7c15ULL + (uint64_t)table_id;
+    return Hash_partitions[(x ^ (x >> 32)) % HASH_INDEX_PARTITIONS];
+}
+
+// the latch should be held.
+static void clear_table(hash_partition_t& partition, table_hash_index_t& index)
+{
+    partition.num_entries -= index.entries.size();
+    index.entries.clear();
+    index.keys_of_leaf.clear();
+}
+
+void hash_index_enable(bool enable)
+{
+    Hash_index_enabled = enable;
+    if(enable == false) hash_index_clear();
+}
+
+bool hash_index_find(int64_t table_id, int64_t key, pagenum_t* leaf,
+    int* slot)
+{
+    if(Hash_index_enabled.load(std::memory_order_relaxed) == false)
+    {
+        return false;
+    }
+
+    hash_partition_t& partition = partition_of(table_id, key);
+    if(partition.num_entries.load(std::memory_order_acquire) == 0)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&partition.latch);
+    bool found = false;
+    auto index = partition.tables.find(table_id);
+    if(index != partition.tables.end())
+    {
+        auto it = index->second.entries.find(key);
+        if(it != index->second.entries.end())
+        {
+            *leaf = it->second.leaf;
+            *slot = it->second.slot;
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&partition.latch);
+    return found;
+}
+
+bool hash_index_check(int64_t table_id, int64_t key, pagenum_t leaf)
+{
+    hash_partition_t& partition = partition_of(table_id, key);
+
+    pthread_mutex_lock(&partition.latch);
+    bool valid = false;
+    auto index = partition.tables.find(table_id);
+    if(index != partition.tables.end())
+    {
+        auto it = index->second.entries.find(key);
+        valid = it != index->second.entries.end() && it->second.leaf == leaf;
+    }
+    if(valid) partition.hits++;
+    pthread_mutex_unlock(&partition.latch);
+
+    return valid;
+}
+
+void hash_index_looked_up(int64_t table_id, int64_t key, pagenum_t leaf,
+    int slot)
+{
+    if(Hash_index_enabled.load(std::memory_order_relaxed) == false) return;
+    hash_partition_t& partition = partition_of(table_id, key);
+
+    pthread_mutex_lock(&partition.latch);
+    partition.misses++;
+    table_hash_index_t& index = partition.tables[table_id];
+
+    if(++index.lookups[key] >= HASH_INDEX_HOT_LOOKUPS)
+    {
+        index.lookups.erase(key);
+        if(index.entries.size()
+            >= HASH_INDEX_MAX_ENTRIES / HASH_INDEX_PARTITIONS)
+        {
+            clear_table(partition, index);
+        }
+
+        if(index.entries.count(key) == 0) partition.num_entries++;
+        index.entries[key] = { leaf, slot };
+        index.keys_of_leaf[leaf].push_back(key);
+    }
+    else if(index.lookups.size()
+        > HASH_INDEX_MAX_ENTRIES / HASH_INDEX_PARTITIONS)
+    {
+        index.lookups.clear();
+    }
+    pthread_mutex_unlock(&partition.latch);
+}
+
+void hash_index_drop_page(int64_t table_id, pagenum_t page_num)
+{
+    // keys of the page may be in any partition.
+    for(hash_partition_t& partition : Hash_partitions)
+    {
+        if(partition.num_entries.load(std::memory_order_acquire) == 0)
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&partition.latch);
+        auto index = partition.tables.find(table_id);
+        if(index != partition.tables.end())
+        {
+            auto keys = index->second.keys_of_leaf.find(page_num);
+            if(keys != index->second.keys_of_leaf.end())
+            {
+                for(int64_t key : keys->second)
+                {
+                    auto it = index->second.entries.find(key);
+                    if(it != index->second.entries.end()
+                        && it->second.leaf == page_num)
+                    {
+                        index->second.entries.erase(it);
+                        partition.num_entries--;
+                    }
+                }
+                index->second.keys_of_leaf.erase(keys);
+            }
+        }
+        pthread_mutex_unlock(&partition.latch);
+    }
+}
+
+void hash_index_clear()
+{
+    for(hash_partition_t& partition : Hash_partitions)
+    {
+        pthread_mutex_lock(&partition.latch);
+        partition.tables.clear();
+        partition.num_entries = 0;
+        pthread_mutex_unlock(&partition.latch);
+    }
+}
+
+void hash_index_stats(uint64_t* hits, uint64_t* misses)
+{
+    *hits = *misses = 0;
+    for(hash_partition_t& partition : Hash_partitions)
+    {
+        pthread_mutex_lock(&partition.latch);
+        *hits += partition.hits;
+        *misses += partition.misses;
+        pthread_mutex_unlock(&partition.latch);
+    }
+}
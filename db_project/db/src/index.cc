@@ -0,0 +1,239 @@
+#include "../include/index.h"
+#include "../include/bpt.h"
+#include "../include/buffer.h"
+#include "../include/leaf.h"
+#include "../include/overflow.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+bool table_has_indexes(const page_t& header)
+{
+    for(int i = 0; i < MAX_INDEXES; i++)
+    {
+        if(index_definition(header, i) != 0) return true;
+    }
+    return false;
+}
+
+// read the attribute of the index from the value. returns false if
+// there is no value, or it is too short to have the attribute.
+static bool value_attribute(uint64_t definition, const char* value,
+    uint16_t val_size, int32_t* attribute)
+{
+    if(value == nullptr || definition == 0) return false;
+
+    uint64_t offset = index_offset(definition);
+    if(offset + sizeof(int32_t) > val_size) return false;
+
+    memcpy(attribute, value + offset, sizeof(int32_t));
+    return true;
+}
+
+// the bytes of the value included in the index.
+static std::string value_included(uint64_t definition, const char* value,
+    uint16_t val_size)
+{
+    uint16_t offset = index_include_offset(definition);
+    if(value == nullptr || offset >= val_size) return std::string();
+
+    return std::string(value + offset,
+        std::min<uint32_t>(index_include_size(definition), val_size - offset));
+}
+
+uint32_t index_item(const char* entry, uint32_t offset, int64_t* key,
+    const char** included, uint16_t* included_size)
+{
+    memcpy(key, entry + offset, 8);
+    memcpy(included_size, entry + offset + 8, 2);
+    *included = entry + offset + INDEX_ITEM_HEADER_SIZE;
+    return offset + INDEX_ITEM_HEADER_SIZE + *included_size;
+}
+
+static void add_item(std::string* entry, int64_t key,
+    const std::string& included)
+{
+    uint16_t size = included.size();
+    entry->append((const char*)&key, 8);
+    entry->append((const char*)&size, 2);
+    entry->append(included);
+}
+
+static void remove_item(std::string* entry, int64_t key)
+{
+    for(uint32_t offset = 0; offset < entry->size(); )
+    {
+        int64_t c_key;
+        const char* included;
+        uint16_t size;
+        uint32_t next = index_item(entry->data(), offset, &c_key, &included,
+            &size);
+        if(c_key == key)
+        {
+            entry->erase(offset, next - offset);
+            return;
+        }
+        offset = next;
+    }
+}
+
+static void write_index_root(int64_t table_id, int index_id, pagenum_t root,
+    int trx_id)
+{
+    // the header is read again, since pages have been allocated.
+    page_t header_p;
+    auto header_bb = buffer_manager->get_block(table_id, 0, trx_id,
+        &header_p);
+    header_p.ui64_array[INDEX_HEADER_SLOT + 2 * index_id] = root;
+    buffer_manager->write_page(header_bb, header_p);
+}
+
+// take the entry of ikey out of the index into entry. returns the new root.
+static pagenum_t take_entry(int64_t table_id, pagenum_t root, int64_t ikey,
+    std::string* entry, int trx_id)
+{
+    record* rec = find_record(table_id, root, ikey, trx_id);
+    if(rec == nullptr) return root;
+
+    entry->assign(rec->content, rec->size);
+    delete[] rec->content;
+    delete rec;
+
+    pagenum_t leaf = find_leaf(table_id, root, ikey, trx_id).page_num;
+    return delete_entry(table_id, root, leaf, ikey, 0);
+}
+
+// put the entry of ikey, which doesn't exist, into the index.
+static pagenum_t put_entry(int64_t table_id, pagenum_t root, int64_t ikey,
+    const std::string& entry)
+{
+    if(entry.empty()) return root;
+
+    // records sharing the lower 32 bits of their keys and the attribute
+    // are rare, so an entry is never put into overflow pages.
+    if(entry.size() > MAX_INLINE_VALUE_SIZE)
+    {
+        throw std::length_error("too many records in an index entry");
+    }
+
+    record new_record(ikey, entry.size(), entry.data());
+    return insert(table_id, root, &new_record);
+}
+
+static void index_add(int64_t table_id, int index_id, pagenum_t root,
+    int32_t attribute, int64_t key, const std::string& included, int trx_id)
+{
+    int64_t ikey = index_key(attribute, key);
+
+    std::string entry;
+    pagenum_t new_root = take_entry(table_id, root, ikey, &entry, trx_id);
+    add_item(&entry, key, included);
+    new_root = put_entry(table_id, new_root, ikey, entry);
+
+    if(root != new_root) write_index_root(table_id, index_id, new_root, trx_id);
+}
+
+static void index_remove(int64_t table_id, int index_id, pagenum_t root,
+    int32_t attribute, int64_t key, int trx_id)
+{
+    int64_t ikey = index_key(attribute, key);
+
+    std::string entry;
+    pagenum_t new_root = take_entry(table_id, root, ikey, &entry, trx_id);
+    remove_item(&entry, key);
+    new_root = put_entry(table_id, new_root, ikey, entry);
+
+    if(root != new_root) write_index_root(table_id, index_id, new_root, trx_id);
+}
+
+void index_record_changed(int64_t table_id, int64_t key,
+    const char* old_value, uint16_t old_size, const char* new_value,
+    uint16_t new_size, int trx_id)
+{
+    for(int i = 0; i < MAX_INDEXES; i++)
+    {
+        // the root is read again for each change, since it may move.
+        page_t header_p;
+        buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+
+        uint64_t definition = index_definition(header_p, i);
+        if(definition == 0) continue;
+
+        int32_t old_attr, new_attr;
+        bool had = value_attribute(definition, old_value, old_size, &old_attr);
+        bool has = value_attribute(definition, new_value, new_size, &new_attr);
+
+        // the entry stays if neither the attribute nor the included bytes
+        // are changed.
+        std::string included = value_included(definition, new_value,
+            new_size);
+        if(had && has && old_attr == new_attr && included
+            == value_included(definition, old_value, old_size)) continue;
+
+        if(had)
+        {
+            index_remove(table_id, i, index_root(header_p, i), old_attr, key,
+                trx_id);
+            buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+        }
+        if(has)
+        {
+            index_add(table_id, i, index_root(header_p, i), new_attr, key,
+                included, trx_id);
+        }
+    }
+}
+
+void index_build(int64_t table_id, int index_id, int trx_id)
+{
+    page_t header_p;
+    buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+    uint64_t definition = index_definition(header_p, index_id);
+
+    // entries are collected from the leaves first, so that no leaf is
+    // latched while the index is changed.
+    std::vector<std::tuple<int64_t, int64_t, std::string>> entries;
+    visit_leaves(table_id, header_p.ui64_array[3], [&](page_t& leaf_p)
+        {
+            int num_keys = leaf_p.si32_array[3];
+            for(int i = 0; i < num_keys; i++)
+            {
+                std::vector<char> overflow_value;
+                uint16_t size;
+                const char* value = leaf_value(table_id, &leaf_p, i, &size,
+                    &overflow_value, trx_id);
+
+                int32_t attribute;
+                if(value_attribute(definition, value, size, &attribute))
+                {
+                    int64_t key = leaf_key(leaf_p, i);
+                    entries.emplace_back(index_key(attribute, key), key,
+                        value_included(definition, value, size));
+                }
+            }
+        }, trx_id);
+
+    // entries are inserted in order, each with all of its records.
+    std::sort(entries.begin(), entries.end());
+
+    pagenum_t root = index_root(header_p, index_id);
+    for(size_t begin = 0; begin < entries.size(); )
+    {
+        int64_t ikey = std::get<0>(entries[begin]);
+        std::string entry;
+        size_t end = begin;
+        for(; end < entries.size() && std::get<0>(entries[end]) == ikey; end++)
+        {
+            add_item(&entry, std::get<1>(entries[end]),
+                std::get<2>(entries[end]));
+        }
+
+        root = put_entry(table_id, root, ikey, entry);
+        begin = end;
+    }
+    write_index_root(table_id, index_id, root, trx_id);
+}
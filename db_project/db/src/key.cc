@@ -0,0 +1,31 @@
+#include "../include/key.h"
+
+#include <cstring>
+
+void key_encode_int64(std::string* out, int64_t value)
+{
+    uint64_t bits = (uint64_t)value ^ (1ULL << 63);
+    for(int shift = 56; shift >= 0; shift -= 8)
+    {
+        out->push_back((char)(bits >> shift));
+    }
+}
+
+void key_encode_bytes(std::string* out, const char* data, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        out->push_back(data[i]);
+        if(data[i] == 0) out->push_back((char)0xFF);
+    }
+    out->push_back(0);
+    out->push_back(1);
+}
+
+int key_compare(const char* a, uint16_t a_size, const char* b,
+    uint16_t b_size)
+{
+    int result = memcmp(a, b, (a_size < b_size) ? a_size : b_size);
+    if(result != 0) return result;
+    return (int)a_size - (int)b_size;
+}
@@ -0,0 +1,482 @@
+#include "../include/key_tree.h"
+#include "../include/buffer.h"
+#include "../include/layout.h"
+#include "../include/lock_table.h"
+
+#include <pthread.h>
+
+#include <cstring>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct key_entry_t
+{
+    std::string key;
+
+    // id of the record in a leaf, or the child in an internal node
+    uint64_t pointer;
+};
+
+static bool is_leaf(const page_t& node)
+{
+    return node.ui32_array[2] == 1;
+}
+
+static int num_keys(const page_t& node)
+{
+    return node.ui32_array[3];
+}
+
+// index-th child of the internal node, where 0 is the leftmost one.
+static pagenum_t child_at(const page_t& node, int index)
+{
+    return (index == 0) ? node.ui64_array[15]
+        : KeyNode::pointer(node, index - 1);
+}
+
+// child of the internal node which has key.
+static pagenum_t child_of(const page_t& node, const KeyBytes& key)
+{
+    return child_at(node,
+        layout_upper_bound<KeyNode>(node, num_keys(node), key));
+}
+
+static std::vector<key_entry_t> read_entries(const page_t& node)
+{
+    std::vector<key_entry_t> entries;
+    for(int i = 0; i < num_keys(node); i++)
+    {
+        KeyBytes key = KeyNode::raw_key(node, i);
+        entries.push_back({std::string(key.data, key.size),
+            KeyNode::pointer(node, i)});
+    }
+    return entries;
+}
+
+// bytes which the entries in [begin, end) take in a node.
+static size_t entries_size(const std::vector<key_entry_t>& entries,
+    size_t begin, size_t end)
+{
+    size_t size = 0;
+    for(size_t i = begin; i < end; i++)
+    {
+        size += KeyNode::SLOT_WIDTH + entries[i].key.size();
+    }
+    return size;
+}
+
+// make the node of the entries in [begin, end), which must fit in it.
+// first is the next leaf of a leaf, or the leftmost child of an internal
+// node.
+static void write_entries(page_t* node, bool leaf, uint64_t first,
+    const std::vector<key_entry_t>& entries, size_t begin, size_t end)
+{
+    node->clear();
+    node->ui32_array[2] = leaf;
+    node->ui32_array[3] = end - begin;
+    node->ui64_array[15] = first;
+
+    uint32_t offset = PAGE_SIZE;
+    for(size_t i = begin; i < end; i++)
+    {
+        const std::string& key = entries[i].key;
+        offset -= key.size();
+        memcpy(node->c_array + offset, key.data(), key.size());
+
+        int slot = KeyNode::slot(i - begin);
+        node->get_pos_value<uint16_t>(slot) = offset;
+        node->get_pos_value<uint16_t>(slot + 2) = key.size();
+        node->get_pos_value<uint64_t>(slot + 4) = entries[i].pointer;
+    }
+    node->ui64_array[KeyNode::FREE_SPACE_OFFSET / 8]
+        = offset - KeyNode::slot(end - begin);
+}
+
+// entries before the returned index are kept in the left node, which
+// takes about half of the bytes. each side keeps at least min_right.
+static size_t split_point(const std::vector<key_entry_t>& entries,
+    size_t min_right)
+{
+    size_t half = entries_size(entries, 0, entries.size()) / 2;
+    size_t mid = 0, size = 0;
+    while(mid < entries.size() && size < half)
+    {
+        size += KeyNode::SLOT_WIDTH + entries[mid++].key.size();
+    }
+    if(mid < 1) mid = 1;
+    if(mid > entries.size() - min_right) mid = entries.size() - min_right;
+    return mid;
+}
+
+// the header is latched first, and released once the root is latched,
+// so the leaf is reached from the root which was read.
+static BufferBlockPointer find_key_leaf(int64_t table_id,
+    const KeyBytes& key, page_t* node_p, int trx_id)
+{
+    page_t header_p;
+    auto header_bb = buffer_manager->get_block(table_id, 0, trx_id,
+        &header_p);
+    pagenum_t root = header_p.ui64_array[KEY_TREE_HEADER_SLOT];
+    if(root == 0) return BufferBlockPointer::unvalid_instance();
+
+    BufferBlockPointer node_bb = buffer_manager->get_block(table_id, root,
+        trx_id, node_p);
+    header_bb = BufferBlockPointer::unvalid_instance();
+
+    // the child is latched before its parent is released.
+    while(is_leaf(*node_p) == false)
+    {
+        node_bb = buffer_manager->get_block(table_id,
+            child_of(*node_p, key), trx_id, node_p);
+    }
+    return node_bb;
+}
+
+bool key_tree_find(int64_t table_id, const char* key, uint16_t key_size,
+    int64_t* id, int trx_id)
+{
+    KeyBytes target = {key, key_size};
+    page_t leaf_p;
+    BufferBlockPointer leaf_bb = find_key_leaf(table_id, target, &leaf_p,
+        trx_id);
+    if(leaf_bb.valid == false) return false;
+
+    int i = layout_lower_bound<KeyNode>(leaf_p, num_keys(leaf_p), target);
+    if(i == num_keys(leaf_p)
+        || KeyCompare<KeyBytes>::less(target, KeyNode::raw_key(leaf_p, i)))
+    {
+        return false;
+    }
+
+    *id = KeyNode::pointer(leaf_p, i);
+    return true;
+}
+
+/* Writers keep the header and the nodes from the root to the leaf latched,
+ * which are latched from the top as readers do. The new nodes are made in
+ * memory, and written only after every new page has been allocated, so
+ * NoSpaceException leaves the tree as it was.
+ */
+int64_t key_tree_insert(int64_t table_id, const char* key, uint16_t key_size,
+    int trx_id, int64_t* gap)
+{
+    KeyBytes target = {key, key_size};
+    page_t header_p;
+    auto header_bb = buffer_manager->get_block(table_id, 0, trx_id,
+        &header_p);
+    pagenum_t root = header_p.ui64_array[KEY_TREE_HEADER_SLOT];
+    int64_t id = header_p.si64_array[KEY_TREE_HEADER_SLOT + 1];
+
+    std::vector<BufferBlockPointer> path;
+    std::vector<page_t> pages;
+    for(pagenum_t node = root; node != 0; )
+    {
+        pages.emplace_back();
+        path.push_back(buffer_manager->get_block(table_id, node, trx_id,
+            &pages.back()));
+        node = is_leaf(pages.back()) ? 0 : child_of(pages.back(), target);
+    }
+
+    // id of the key after the new one, whose gap it goes into.
+    int64_t next_id = -1;
+    if(path.empty() == false)
+    {
+        const page_t& leaf_p = pages.back();
+        int i = layout_lower_bound<KeyNode>(leaf_p, num_keys(leaf_p), target);
+        if(i < num_keys(leaf_p)
+            && KeyCompare<KeyBytes>::less(target,
+                KeyNode::raw_key(leaf_p, i)) == false)
+        {
+            return KeyNode::pointer(leaf_p, i);
+        }
+
+        // no leaf but the root is left empty, so the next key is in this
+        // leaf or the first one of the next leaf, which is latched after
+        // this one as scans do.
+        if(i < num_keys(leaf_p)) next_id = KeyNode::pointer(leaf_p, i);
+        else if(leaf_p.ui64_array[15] != 0)
+        {
+            page_t next_p;
+            auto next_bb = buffer_manager->get_block(table_id,
+                leaf_p.ui64_array[15], trx_id, &next_p);
+            if(num_keys(next_p) > 0) next_id = KeyNode::pointer(next_p, 0);
+        }
+    }
+
+    // the tree is kept latched until the key is in it, so that a scan
+    // can't read the gap in the meantime.
+    *gap = key_gap(next_id);
+    if(lock_check_gap(table_id, *gap, trx_id)) return -1;
+
+    // pages to be written, and the entry to be put into each level.
+    std::vector<std::pair<BufferBlockPointer, page_t>> writes;
+    key_entry_t up = {std::string(key, key_size), (uint64_t)id};
+    bool pending = true;
+
+    for(int level = (int)path.size() - 1; level >= 0; level--)
+    {
+        page_t& node_p = pages[level];
+        bool leaf = is_leaf(node_p);
+        uint64_t first = node_p.ui64_array[15];
+
+        std::vector<key_entry_t> entries = read_entries(node_p);
+        KeyBytes up_key = {up.key.data(), (uint16_t)up.key.size()};
+        int index = layout_upper_bound<KeyNode>(node_p, num_keys(node_p),
+            up_key);
+        entries.insert(entries.begin() + index, up);
+
+        if(KeyNode::HEADER_SIZE + entries_size(entries, 0, entries.size())
+            <= PAGE_SIZE)
+        {
+            write_entries(&node_p, leaf, first, entries, 0, entries.size());
+            writes.emplace_back(path[level], node_p);
+            pending = false;
+            break;
+        }
+
+        // the first key of the right node goes up, and an internal node
+        // keeps its child as the leftmost one of the right node.
+        size_t mid = split_point(entries, leaf ? 1 : 2);
+        page_t right_p;
+        BufferBlockPointer right_bb = buffer_manager->get_new_block(table_id);
+        if(leaf)
+        {
+            write_entries(&node_p, true, right_bb.page_num, entries, 0, mid);
+            write_entries(&right_p, true, first, entries, mid,
+                entries.size());
+        }
+        else
+        {
+            write_entries(&node_p, false, first, entries, 0, mid);
+            write_entries(&right_p, false, entries[mid].pointer, entries,
+                mid + 1, entries.size());
+        }
+        up = {entries[mid].key, right_bb.page_num};
+        writes.emplace_back(path[level], node_p);
+        writes.emplace_back(std::move(right_bb), right_p);
+    }
+
+    // the tree is empty, or its root has been split.
+    if(pending)
+    {
+        page_t root_p;
+        BufferBlockPointer root_bb = buffer_manager->get_new_block(table_id);
+        if(path.empty()) write_entries(&root_p, true, 0, {up}, 0, 1);
+        else write_entries(&root_p, false, root, {up}, 0, 1);
+        root = root_bb.page_num;
+        writes.emplace_back(std::move(root_bb), root_p);
+    }
+
+    for(auto& [bb, page] : writes) buffer_manager->write_page(bb, page);
+
+    // the header is read again, since pages have been allocated.
+    buffer_manager->get_page(header_bb, header_p);
+    header_p.ui64_array[KEY_TREE_HEADER_SLOT] = root;
+    header_p.si64_array[KEY_TREE_HEADER_SLOT + 1] = id + 1;
+    buffer_manager->write_page(header_bb, header_p);
+    return id;
+}
+
+void key_tree_scan(int64_t table_id, const char* begin_key,
+    uint16_t begin_size, const char* end_key, uint16_t end_size,
+    std::vector<std::string>* keys, std::vector<int64_t>* ids,
+    int64_t* next_id, int trx_id)
+{
+    KeyBytes begin = {begin_key, begin_size}, end = {end_key, end_size};
+    *next_id = -1;
+
+    page_t leaf_p;
+    BufferBlockPointer leaf_bb = find_key_leaf(table_id, begin, &leaf_p,
+        trx_id);
+    if(leaf_bb.valid == false) return;
+
+    int i = layout_lower_bound<KeyNode>(leaf_p, num_keys(leaf_p), begin);
+    while(true)
+    {
+        for(; i < num_keys(leaf_p); i++)
+        {
+            KeyBytes key = KeyNode::raw_key(leaf_p, i);
+            if(KeyCompare<KeyBytes>::less(end, key))
+            {
+                *next_id = KeyNode::pointer(leaf_p, i);
+                return;
+            }
+
+            keys->emplace_back(key.data, key.size);
+            ids->push_back(KeyNode::pointer(leaf_p, i));
+        }
+
+        // the next leaf is latched before this one is released.
+        pagenum_t next = leaf_p.ui64_array[15];
+        if(next == 0) return;
+        leaf_bb = buffer_manager->get_block(table_id, next, trx_id, &leaf_p);
+        i = 0;
+    }
+}
+
+/* A leaf is unlinked from the leaves and its parent when its last key is
+ * taken out, and so is a parent left without children, so the pages of
+ * keys which have gone are used again. Nodes are not merged otherwise.
+ * The header and the path are latched as key_tree_insert does.
+ */
+bool key_tree_remove(int64_t table_id, const char* key, uint16_t key_size,
+    int64_t id)
+{
+    // the tree must not be left halfway changed.
+    FrameWait frame_wait;
+
+    KeyBytes target = {key, key_size};
+    page_t header_p;
+    auto header_bb = buffer_manager->get_block(table_id, 0, 0, &header_p);
+    pagenum_t root = header_p.ui64_array[KEY_TREE_HEADER_SLOT];
+
+    // nodes from the root, and the child taken at each internal one.
+    std::vector<BufferBlockPointer> path;
+    std::vector<page_t> pages;
+    std::vector<int> indexes;
+    for(pagenum_t node = root; node != 0; )
+    {
+        pages.emplace_back();
+        path.push_back(buffer_manager->get_block(table_id, node, 0,
+            &pages.back()));
+        if(is_leaf(pages.back())) break;
+
+        indexes.push_back(layout_upper_bound<KeyNode>(pages.back(),
+            num_keys(pages.back()), target));
+        node = child_at(pages.back(), indexes.back());
+    }
+    if(path.empty()) return false;
+
+    page_t& leaf_p = pages.back();
+    int i = layout_lower_bound<KeyNode>(leaf_p, num_keys(leaf_p), target);
+    if(i == num_keys(leaf_p)
+        || KeyCompare<KeyBytes>::less(target, KeyNode::raw_key(leaf_p, i))
+        || KeyNode::pointer(leaf_p, i) != (uint64_t)id)
+    {
+        return false;
+    }
+
+    std::vector<key_entry_t> entries = read_entries(leaf_p);
+    entries.erase(entries.begin() + i);
+    uint64_t next = leaf_p.ui64_array[15];
+    if(entries.empty() == false)
+    {
+        write_entries(&leaf_p, true, next, entries, 0, entries.size());
+        buffer_manager->write_page(path.back(), leaf_p);
+        return true;
+    }
+
+    // the empty leaf is released before the leaf on its left is latched,
+    // since scans latch the leaves from the left. that leaf is the
+    // rightmost one under the child left of the path, at the lowest node
+    // where the path doesn't take the leftmost child.
+    pagenum_t leaf = path.back().page_num;
+    path.pop_back(), pages.pop_back();
+    for(int level = (int)path.size() - 1; level >= 0; level--)
+    {
+        if(indexes[level] == 0) continue;
+
+        page_t node_p;
+        BufferBlockPointer node_bb = buffer_manager->get_block(table_id,
+            child_at(pages[level], indexes[level] - 1), 0, &node_p);
+        while(is_leaf(node_p) == false)
+        {
+            node_bb = buffer_manager->get_block(table_id,
+                child_at(node_p, num_keys(node_p)), 0, &node_p);
+        }
+        node_p.ui64_array[15] = next;
+        buffer_manager->write_page(node_bb, node_p);
+        break;
+    }
+
+    // no one can reach the leaf now but the scans which are in it.
+    buffer_manager->set_delete_waited(
+        buffer_manager->get_block(table_id, leaf, 0));
+
+    // the child is taken out of its parent, which is freed if it has no
+    // other child. a root left with one child gives its place to it.
+    pagenum_t new_root = 0;
+    for(int level = (int)path.size() - 1; level >= 0; level--)
+    {
+        page_t& node_p = pages[level];
+        entries = read_entries(node_p);
+        if(entries.empty())
+        {
+            buffer_manager->set_delete_waited(path[level]);
+            continue;
+        }
+
+        uint64_t first = node_p.ui64_array[15];
+        if(indexes[level] == 0)
+        {
+            first = entries[0].pointer;
+            entries.erase(entries.begin());
+        }
+        else entries.erase(entries.begin() + indexes[level] - 1);
+
+        new_root = root;
+        if(level == 0 && entries.empty())
+        {
+            new_root = first;
+            buffer_manager->set_delete_waited(path[level]);
+        }
+        else
+        {
+            write_entries(&node_p, false, first, entries, 0, entries.size());
+            buffer_manager->write_page(path[level], node_p);
+        }
+        break;
+    }
+
+    // the header is read again, since pages have been freed.
+    if(new_root != root)
+    {
+        buffer_manager->get_page(header_bb, header_p);
+        header_p.ui64_array[KEY_TREE_HEADER_SLOT] = new_root;
+        buffer_manager->write_page(header_bb, header_p);
+    }
+    return true;
+}
+
+struct unused_key_t
+{
+    int64_t table_id;
+    std::string key;
+    int64_t id;
+};
+
+std::deque<unused_key_t> Unused_keys;
+pthread_mutex_t unused_keys_latch = PTHREAD_MUTEX_INITIALIZER;
+
+void key_tree_add_unused(int64_t table_id, const char* key,
+    uint16_t key_size, int64_t id)
+{
+    pthread_mutex_lock(&unused_keys_latch);
+    Unused_keys.push_back({table_id, std::string(key, key_size), id});
+    pthread_mutex_unlock(&unused_keys_latch);
+}
+
+bool key_tree_take_unused(int64_t* table_id, std::string* key, int64_t* id)
+{
+    pthread_mutex_lock(&unused_keys_latch);
+    bool result = (Unused_keys.empty() == false);
+    if(result)
+    {
+        *table_id = Unused_keys.front().table_id;
+        *key = std::move(Unused_keys.front().key);
+        *id = Unused_keys.front().id;
+        Unused_keys.pop_front();
+    }
+    pthread_mutex_unlock(&unused_keys_latch);
+
+    return result;
+}
+
+void key_tree_clear()
+{
+    pthread_mutex_lock(&unused_keys_latch);
+    Unused_keys.clear();
+    pthread_mutex_unlock(&unused_keys_latch);
+}
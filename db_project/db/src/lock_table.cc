@@ -15,11 +15,15 @@ struct lock_list_t
   lock_t* head;
   lock_t* tail;
 
+  // next list in the same entry of lock table
+  lock_list_t* next_list;
+
   lock_list_t(int64_t table_id, pagenum_t page_id)
   {
     this->table_id = table_id;
     this->page_id = page_id;
     this->head = this->tail = nullptr;
+    this->next_list = nullptr;
   };
 };
 
@@ -27,9 +31,12 @@ template<uint32_t INIT_SIZE = 7>
 struct lock_table_t
 {
   uint64_t size;
+
+  // number of lists in the table
+  uint64_t num_lists;
   std::vector<lock_list_t*> table;
 
-  lock_table_t() : table(INIT_SIZE, nullptr), size(INIT_SIZE)
+  lock_table_t() : table(INIT_SIZE, nullptr), size(INIT_SIZE), num_lists(0)
   {
     
   }
@@ -49,68 +56,72 @@ struct lock_table_t
 
   void extend()
   {
-    
     size_t next_size = size * INIT_SIZE;
-    // extend size of table
-    table.resize(next_size);
-
-    for(size_t i = size; i < next_size; i++) table[i] = nullptr;
+    std::vector<lock_list_t*> next_table(next_size, nullptr);
 
+    // move every list of each entry to its new entry
     for(size_t i = 0; i < size; i++)
     {
-      // if there was a list in this entry
-      if(table[i] != nullptr)
+      lock_list_t* it = table[i];
+      while(it != nullptr)
       {
-        size_t entry_num = hash_f(next_size, table[i]->table_id, table[i]->page_id);
-        // this list should change the entry
-        if(entry_num != i)
-        {
-          // change place
-          table[entry_num] = table[i];
-          
-          // set originally used entry as nullptr
-          table[i] = nullptr; 
-        }
+        lock_list_t* next = it->next_list;
+        size_t entry_num = hash_f(next_size, it->table_id, it->page_id);
+
+        it->next_list = next_table[entry_num];
+        next_table[entry_num] = it;
+        it = next;
       }
     }
+
+    table.swap(next_table);
     size = next_size;
   }
 
   lock_list_t* get_list(int64_t table_id, pagenum_t page_id)
   {
-    while(1)
+    size_t index = hash_f(size, table_id, page_id);
+
+    // find the list for this <table_id, page_id> pair
+    for(lock_list_t* it = table[index]; it != nullptr; it = it->next_list)
     {
-      size_t index = hash_f(size, table_id, page_id);
+      if(it->table_id == table_id && it->page_id == page_id) return it;
+    }
 
-      // if this entry is emtpy,
-      if(table[index] == nullptr)
-      {
-        // then allocate this entry for this <table_id, page_id> pair
-        table[index] = new lock_list_t(table_id, page_id);
-        return table[index];
-      }
+    // if there is no list, allocate new one.
+    // table is extended (costly) when the entries become crowded.
+    if(++num_lists > size)
+    {
+      extend();
+      index = hash_f(size, table_id, page_id);
+    }
 
-      // if this entry is already allocated for this <table_id, page_id> pair
-      if(table[index]->table_id == table_id && table[index]->page_id == page_id)
-      {
-        return table[index];
-      }
-      
-      // if this entry is already allocated for other <table_id, page_id> pair
-      else
+    lock_list_t* new_list = new lock_list_t(table_id, page_id);
+    new_list->next_list = table[index];
+    table[index] = new_list;
+    return new_list;
+  }
+
+  // free every list, and make the table as it was at first.
+  void clear()
+  {
+    for(auto &i : table)
+    {
+      while(i != nullptr)
       {
-        // then entend table (costly)
-        extend();
+        lock_list_t* next = i->next_list;
+        delete i;
+        i = next;
       }
     }
+    table.assign(INIT_SIZE, nullptr);
+    size = INIT_SIZE;
+    num_lists = 0;
   }
 
   ~lock_table_t()
   {
-    for(auto &i : table)
-    {
-      if(i != nullptr) delete i;
-    }
+    clear();
   }
 
 };
@@ -126,16 +137,66 @@ int init_lock_table()
   return 0;
 }
 
+void lock_table_clear()
+{
+  pthread_mutex_lock(&lock_table_latch);
+  Lock_table.clear();
+  pthread_mutex_unlock(&lock_table_latch);
+}
+
+// list id of the lock on the key. record locks are hashed by the key,
+// regardless of the page the record is in now.
+static pagenum_t lock_bucket(pagenum_t page_id, int64_t key)
+{
+  if(page_id == LOCK_GAP_PAGE) return LOCK_GAP_PAGE;
+  return LOCK_RECORD_PAGE + (uint64_t)key % LOCK_RECORD_BUCKETS;
+}
+
+// makes curr_trx(nullptr if not in a trx) wait until the lock of other
+// trx is released. returns false without waiting if the wait makes a
+// cycle. (latch should be held)
+static bool wait_for_release(Transaction* curr_trx, lock_t* it)
+{
+  // waiting trx takes part in deadlock detection.
+  if(curr_trx != nullptr)
+  {
+    curr_trx->waiting_trx = it->owner_trx;
+    if(trx_check_deadlock(curr_trx) == true)
+    {
+      curr_trx->waiting_trx = nullptr;
+      return false;
+    }
+    it->next_trx.push_back(curr_trx);
+  }
+
+  // lock_release touches the trxs in next_trx, so they don't leave
+  // before that, even on a spurious wake-up.
+  it->successor_cnt++;
+  while(it->is_end == false)
+  {
+    pthread_cond_wait(&(it->cond), &lock_table_latch);
+  }
+  it->successor_cnt--;
+  if(it->successor_cnt == 0) pthread_cond_broadcast(&(it->delete_cond));
+
+  if(curr_trx != nullptr) curr_trx->waiting_trx = nullptr;
+  return true;
+}
+
 lock_t* lock_acquire(int64_t table_id, pagenum_t page_id, int64_t key,
     int trx_id, int lock_mode)
 {
+  // pointer refers to trx instance for this trx_id
+  Transaction* curr_trx = trx_get(trx_id);
+
+  // the trx has already been aborted.
+  if(curr_trx == nullptr) throw DeadlockDetectException();
+
   // create new lock_t object
+  page_id = lock_bucket(page_id, key);
   lock_t* lock_object = new lock_t(lock_mode, table_id, page_id, key);
 
-  pthread_mutex_lock(&trx_table_latch);
-
-  // pointer refers to trx instance for this trx_id
-  Transaction* curr_trx = trx_manager.trx_table[trx_id];
+  pthread_mutex_lock(&curr_trx->trx_latch);
 
   for(auto it = curr_trx->lock_ptr; it != nullptr; it = it->trx_next)
   {
@@ -144,30 +205,28 @@ lock_t* lock_acquire(int64_t table_id, pagenum_t page_id, int64_t key,
     {
       if(it->lock_mode == LOCK_MODE_EXCLUSIVE || lock_mode == LOCK_MODE_SHARED)
       {
-        // if this is not acquired yet, wait until it is acquired.
-        if(it->is_acquired == false)
-        {
-          it->successor_cnt++;
-          pthread_cond_wait(&it->acq_cond, &trx_table_latch);
-          it->successor_cnt--;
-        }
-          
-        if(it->is_acquired == false)
-        {
-          if(it->successor_cnt <= 0) pthread_cond_broadcast(&(it->delete_cond));
-          
-          delete lock_object;
-          pthread_mutex_unlock(&trx_table_latch);
-          throw DeadlockDetectException();
-        }
-        else
+        delete lock_object;
+
+        // is_acquired is set and signaled under lock_table_latch, so it is
+        // waited for under the same latch.
+        pthread_mutex_lock(&lock_table_latch);
+        pthread_mutex_unlock(&curr_trx->trx_latch);
+
+        // if this is not acquired yet, wait until it is acquired, or
+        // released by the abort of this trx.
+        it->successor_cnt++;
+        while(it->is_acquired == false && it->is_end == false)
         {
-          if(it->successor_cnt <= 0) pthread_cond_broadcast(&(it->delete_cond));
-          
-          delete lock_object;
-          pthread_mutex_unlock(&trx_table_latch);
-          return it;
+          pthread_cond_wait(&it->acq_cond, &lock_table_latch);
         }
+        it->successor_cnt--;
+        if(it->successor_cnt == 0) pthread_cond_broadcast(&(it->delete_cond));
+
+        bool acquired = it->is_acquired && it->is_end == false;
+        pthread_mutex_unlock(&lock_table_latch);
+
+        if(acquired == false) throw DeadlockDetectException();
+        return it;
       }
     }
   }
@@ -180,7 +239,7 @@ lock_t* lock_acquire(int64_t table_id, pagenum_t page_id, int64_t key,
   // set remained attribute
   lock_object->owner_trx = curr_trx;
   lock_object->owner_trx_id = trx_id;
-  pthread_mutex_unlock(&trx_table_latch);
+  pthread_mutex_unlock(&curr_trx->trx_latch);
   
 
   pthread_mutex_lock(&lock_table_latch);
@@ -226,38 +285,20 @@ lock_t* lock_acquire(int64_t table_id, pagenum_t page_id, int64_t key,
             it = it->prev_pointer;
             continue;
           }
-          curr_trx->waiting_trx = it->owner_trx;
-
-          if(trx_check_deadlock(curr_trx) == true)
+          if(wait_for_release(curr_trx, it) == false)
           {
             throw DeadlockDetectException();
           }
-
-          it->next_trx.push_back(curr_trx);
-          it->successor_cnt++;
-          pthread_cond_wait(&(it->cond), &lock_table_latch); 
-
-          it->successor_cnt--;
-          if(it->successor_cnt == 0) pthread_cond_broadcast(&(it->delete_cond));
           break;
         }
         else if(lock_mode == LOCK_MODE_EXCLUSIVE)
         {
           if(flag && it->lock_mode == LOCK_MODE_EXCLUSIVE) break;
-          curr_trx->waiting_trx = it->owner_trx;
-
-          if(trx_check_deadlock(curr_trx) == true)
+          if(wait_for_release(curr_trx, it) == false)
           {
             throw DeadlockDetectException();
           }
 
-          it->successor_cnt++;
-          it->next_trx.push_back(curr_trx);
-          pthread_cond_wait(&(it->cond), &lock_table_latch); 
-
-          it->successor_cnt--;
-          if(it->successor_cnt == 0) pthread_cond_broadcast(&(it->delete_cond));
-
           if(it->lock_mode == LOCK_MODE_EXCLUSIVE) break;
           else flag = 1;
         }
@@ -316,7 +357,7 @@ int lock_release(lock_t* lock_obj)
   lock_list_t* lock_list =
     Lock_table.get_list(lock_obj->table_id, lock_obj->page_id);
 
-  if(lock_obj->successor_cnt > 0)
+  while(lock_obj->successor_cnt > 0)
   {
     pthread_cond_wait(&(lock_obj->delete_cond), &lock_table_latch); 
   }
@@ -338,3 +379,70 @@ int lock_release(lock_t* lock_obj)
   pthread_mutex_unlock(&lock_table_latch);
   return 0;
 }
+
+// find a lock of other trx on the gap below key. (latch should be held)
+// a lock which is still waited for is skipped: its scan hasn't read the gap
+// yet, and it may be waiting for trx_id itself, e.g. for its rollback.
+lock_t* find_gap_lock(int64_t table_id, int64_t key, int trx_id)
+{
+  lock_list_t* lock_list = Lock_table.get_list(table_id, LOCK_GAP_PAGE);
+
+  for(lock_t* it = lock_list->head; it != nullptr; it = it->next_pointer)
+  {
+    if(it->is_end == false && it->is_acquired && it->key == key
+      && it->owner_trx_id != trx_id)
+    {
+      return it;
+    }
+  }
+  return nullptr;
+}
+
+bool lock_is_used(int64_t table_id, int64_t key)
+{
+  pthread_mutex_lock(&lock_table_latch);
+  lock_list_t* lock_list = Lock_table.get_list(table_id,
+    lock_bucket(LOCK_RECORD_PAGE, key));
+
+  bool result = false;
+  for(lock_t* it = lock_list->head; it != nullptr; it = it->next_pointer)
+  {
+    if(it->is_end == false && it->key == key)
+    {
+      result = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&lock_table_latch);
+
+  return result;
+}
+
+bool lock_check_gap(int64_t table_id, int64_t key, int trx_id)
+{
+  pthread_mutex_lock(&lock_table_latch);
+  bool result = (find_gap_lock(table_id, key, trx_id) != nullptr);
+  pthread_mutex_unlock(&lock_table_latch);
+
+  return result;
+}
+
+void lock_wait_gap(int64_t table_id, int64_t key, int trx_id)
+{
+  Transaction* curr_trx = (trx_id > 0) ? trx_get(trx_id) : nullptr;
+
+  pthread_mutex_lock(&lock_table_latch);
+
+  lock_t* it;
+  while((it = find_gap_lock(table_id, key, trx_id)) != nullptr)
+  {
+    // wait until the holder releases it, same as a lock request does
+    if(wait_for_release(curr_trx, it) == false)
+    {
+      pthread_mutex_unlock(&lock_table_latch);
+      throw DeadlockDetectException();
+    }
+  }
+
+  pthread_mutex_unlock(&lock_table_latch);
+}
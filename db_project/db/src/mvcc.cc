@@ -0,0 +1,281 @@
+#include "../include/mvcc.h"
+
+#include <pthread.h>
+#include <cstring>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "../include/trx.h"
+
+// undo images of a committed trx, which may be still read by old views
+struct trx_history_t
+{
+    uint64_t    commit_no;
+    int         trx_id;
+    std::vector<rollback_record_t> records;
+
+    // the undo images of records are allocated from it.
+    UndoArena   arena;
+};
+
+pthread_mutex_t version_latch = PTHREAD_MUTEX_INITIALIZER;
+
+// the last commit number given to a trx
+std::atomic<uint64_t> Commit_no(0);
+
+// version chains of records which have old versions, by <table id, key>
+std::map<std::pair<int64_t, int64_t>, version_chain_t> Version_chains;
+
+// committed trxs in order of their commit numbers
+std::deque<trx_history_t> Trx_history;
+
+size_t Num_versions = 0;
+
+bool ReadView::sees(int writer_trx_id, uint64_t writer_commit_no) const
+{
+    // changes made out of trx, or made by itself are always visible.
+    if(writer_trx_id == 0 || writer_trx_id == creator_trx_id) return true;
+
+    return writer_commit_no != 0 && writer_commit_no <= snapshot_no;
+}
+
+void mvcc_init_view(ReadView* view, int trx_id)
+{
+    view->creator_trx_id = trx_id;
+    view->snapshot_no = Commit_no.load();
+}
+
+uint64_t mvcc_snapshot_no()
+{
+    return Commit_no.load();
+}
+
+void mvcc_add_version(int64_t table_id, int64_t key, int trx_id,
+    const char* prev_val, uint16_t val_size)
+{
+    pthread_mutex_lock(&version_latch);
+
+    version_chain_t& chain = Version_chains[{table_id, key}];
+    chain.versions.push_back({prev_val, val_size,
+        chain.head_trx_id, chain.head_commit_no, trx_id});
+
+    chain.head_trx_id = trx_id;
+    chain.head_commit_no = 0;
+    Num_versions++;
+
+    pthread_mutex_unlock(&version_latch);
+}
+
+void mvcc_remove_version(int64_t table_id, int64_t key, int trx_id)
+{
+    pthread_mutex_lock(&version_latch);
+
+    auto it = Version_chains.find({table_id, key});
+    if(it != Version_chains.end())
+    {
+        version_chain_t& chain = it->second;
+        if(chain.versions.empty() == false
+            && chain.versions.back().superseded_by == trx_id)
+        {
+            chain.head_trx_id = chain.versions.back().writer_trx_id;
+            chain.head_commit_no = chain.versions.back().writer_commit_no;
+            chain.versions.pop_back();
+            Num_versions--;
+        }
+
+        // if there is no old version, the version in the page
+        // is visible to every view.
+        if(chain.versions.empty()) Version_chains.erase(it);
+    }
+
+    pthread_mutex_unlock(&version_latch);
+}
+
+int mvcc_read(const ReadView& view, int64_t table_id, int64_t key,
+    const char* page_val, uint16_t page_size, char* ret_val,
+    uint16_t* val_size)
+{
+    pthread_mutex_lock(&version_latch);
+
+    const char* value = page_val;
+    uint16_t size = page_size;
+
+    auto it = Version_chains.find({table_id, key});
+    if(it != Version_chains.end()
+        && view.sees(it->second.head_trx_id, it->second.head_commit_no) == false)
+    {
+        // go back to the newest version the view can see.
+        value = nullptr;
+        auto& versions = it->second.versions;
+        for(auto i = versions.rbegin(); i != versions.rend(); i++)
+        {
+            if(view.sees(i->writer_trx_id, i->writer_commit_no))
+            {
+                value = i->value;
+                size = i->size;
+                break;
+            }
+        }
+    }
+
+    int result = -1;
+    if(value != nullptr)
+    {
+        memcpy(ret_val, value, size);
+        *val_size = size;
+        result = 0;
+    }
+
+    pthread_mutex_unlock(&version_latch);
+    return result;
+}
+
+int mvcc_read_range(const ReadView& view, int64_t table_id, int64_t key_start,
+    int64_t key_end, std::vector<int64_t>* keys, std::vector<char*>* values,
+    std::vector<uint16_t>* val_sizes)
+{
+    int num_found = 0;
+
+    pthread_mutex_lock(&version_latch);
+
+    auto it = Version_chains.lower_bound({table_id, key_start});
+    auto end = Version_chains.upper_bound({table_id, key_end});
+    for(; it != end; it++)
+    {
+        // the version in the page is visible, so it is read from the page.
+        if(view.sees(it->second.head_trx_id, it->second.head_commit_no))
+        {
+            continue;
+        }
+
+        auto& versions = it->second.versions;
+        for(auto i = versions.rbegin(); i != versions.rend(); i++)
+        {
+            if(view.sees(i->writer_trx_id, i->writer_commit_no) == false)
+            {
+                continue;
+            }
+
+            if(i->value != nullptr)
+            {
+                char* value = new char[i->size];
+                memcpy(value, i->value, i->size);
+
+                keys->push_back(it->first.second);
+                values->push_back(value);
+                val_sizes->push_back(i->size);
+                num_found++;
+            }
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&version_latch);
+    return num_found;
+}
+
+void mvcc_commit(Transaction* trx)
+{
+    // read-only trx has nothing to be stamped.
+    if(trx->rollback_records.empty()) return;
+
+    pthread_mutex_lock(&version_latch);
+
+    uint64_t commit_no = Commit_no.load() + 1;
+    for(auto& i : trx->rollback_records)
+    {
+        auto it = Version_chains.find({i.table_id, i.key});
+        if(it == Version_chains.end()) continue;
+
+        version_chain_t& chain = it->second;
+        if(chain.head_trx_id == trx->trx_id) chain.head_commit_no = commit_no;
+        for(auto& version : chain.versions)
+        {
+            if(version.writer_trx_id == trx->trx_id)
+            {
+                version.writer_commit_no = commit_no;
+            }
+        }
+    }
+
+    // undo images are owned by history from now on.
+    Trx_history.push_back({commit_no, trx->trx_id,
+        std::move(trx->rollback_records), std::move(trx->undo_arena)});
+    trx->rollback_records.clear();
+
+    // new views can see this trx only after all of its versions are stamped.
+    Commit_no.store(commit_no);
+
+    pthread_mutex_unlock(&version_latch);
+}
+
+void mvcc_purge(uint64_t horizon)
+{
+    pthread_mutex_lock(&version_latch);
+
+    while(Trx_history.empty() == false
+        && Trx_history.front().commit_no <= horizon)
+    {
+        trx_history_t& history = Trx_history.front();
+
+        for(auto& i : history.records)
+        {
+            auto it = Version_chains.find({i.table_id, i.key});
+            if(it != Version_chains.end())
+            {
+                // every view can see this trx, so the version overwritten
+                // by this trx and older versions are no longer needed.
+                auto& versions = it->second.versions;
+                for(size_t j = versions.size(); j > 0; j--)
+                {
+                    if(versions[j - 1].superseded_by == history.trx_id)
+                    {
+                        versions.erase(versions.begin(), versions.begin() + j);
+                        Num_versions -= j;
+                        break;
+                    }
+                }
+
+                if(versions.empty()) Version_chains.erase(it);
+            }
+        }
+
+        // undo images are freed at once with the arena.
+        Trx_history.pop_front();
+    }
+
+    pthread_mutex_unlock(&version_latch);
+}
+
+void mvcc_clear()
+{
+    pthread_mutex_lock(&version_latch);
+
+    // undo images are freed with the arenas of the history.
+    Version_chains.clear();
+    Trx_history.clear();
+    Num_versions = 0;
+
+    pthread_mutex_unlock(&version_latch);
+}
+
+bool mvcc_has_versions(int64_t table_id, int64_t key)
+{
+    pthread_mutex_lock(&version_latch);
+    bool result = Version_chains.count({table_id, key}) != 0;
+    pthread_mutex_unlock(&version_latch);
+
+    return result;
+}
+
+size_t mvcc_num_versions()
+{
+    pthread_mutex_lock(&version_latch);
+    size_t result = Num_versions;
+    pthread_mutex_unlock(&version_latch);
+
+    return result;
+}
@@ -0,0 +1,124 @@
+#include "../include/overflow.h"
+
+#include <cstring>
+
+#include "../include/buffer.h"
+#include "../include/leaf.h"
+
+/* Pages are written from the last one, so that each page knows the next
+ * one when it is written, and only one of them is latched at a time.
+ * The chain is reachable by no one until the stub is written into a leaf.
+ */
+void overflow_write(int64_t table_id, const char* value, uint16_t size,
+    char* stub, int trx_id)
+{
+    BufferBlockPointer header_bb = buffer_manager->get_block(table_id, 0,
+        trx_id);
+
+    uint32_t rest = size - OVERFLOW_PREFIX_SIZE;
+    int num_pages = (rest + OVERFLOW_PAGE_DATA - 1) / OVERFLOW_PAGE_DATA;
+
+    pagenum_t next = 0;
+    try
+    {
+        for(int i = num_pages - 1; i >= 0; i--)
+        {
+            uint32_t start = i * OVERFLOW_PAGE_DATA;
+            uint32_t len = (rest - start < OVERFLOW_PAGE_DATA)
+                ? rest - start : OVERFLOW_PAGE_DATA;
+
+            page_t page(OVERFLOW_PAGE);
+            page.ui64_array[0] = next;
+            page.ui32_array[3] = len;
+            memcpy(page.c_array + 16, value + OVERFLOW_PREFIX_SIZE + start,
+                len);
+
+            BufferBlockPointer bb = buffer_manager->get_new_block(table_id,
+                OVERFLOW_PAGE);
+            buffer_manager->write_page(bb, page);
+            next = bb.page_num;
+        }
+    }
+    catch(const NoSpaceException& e)
+    {
+        overflow_free(table_id, next, trx_id);
+        throw;
+    }
+
+    *reinterpret_cast<pagenum_t*>(stub) = next;
+    *reinterpret_cast<uint16_t*>(stub + 8) = size;
+    memcpy(stub + 10, value, OVERFLOW_PREFIX_SIZE);
+}
+
+void overflow_free(int64_t table_id, pagenum_t first_page, int trx_id)
+{
+    BufferBlockPointer header_bb = buffer_manager->get_block(table_id, 0,
+        trx_id);
+
+    page_t page;
+    for(pagenum_t n = first_page; n != 0; n = page.ui64_array[0])
+    {
+        // the page is freed when it is released.
+        BufferBlockPointer bb = buffer_manager->get_block(table_id, n,
+            trx_id, &page);
+        buffer_manager->set_delete_waited(bb);
+    }
+}
+
+/* The prefix is copied from the stub, and the pages before offset
+ * are only passed by their links.
+ */
+void overflow_read(int64_t table_id, const char* stub, uint32_t offset,
+    uint32_t len, char* dest, int trx_id)
+{
+    if(offset < OVERFLOW_PREFIX_SIZE)
+    {
+        uint32_t n = (OVERFLOW_PREFIX_SIZE - offset < len)
+            ? OVERFLOW_PREFIX_SIZE - offset : len;
+        memcpy(dest, stub + 10 + offset, n);
+        dest += n;
+        offset += n;
+        len -= n;
+    }
+
+    // offset of the first byte of page n in the value.
+    uint32_t page_start = OVERFLOW_PREFIX_SIZE;
+    pagenum_t n = overflow_first_page(stub);
+    while(len > 0 && n != 0)
+    {
+        BufferBlockPointer bb = buffer_manager->get_block(table_id, n, trx_id);
+        const page_t* page = buffer_manager->get_frame(bb);
+        uint32_t page_len = page->ui32_array[3];
+
+        if(offset < page_start + page_len)
+        {
+            uint32_t from = offset - page_start;
+            uint32_t m = (page_len - from < len) ? page_len - from : len;
+            memcpy(dest, page->c_array + 16 + from, m);
+            dest += m;
+            offset += m;
+            len -= m;
+        }
+
+        page_start += page_len;
+        n = page->ui64_array[0];
+    }
+}
+
+const char* leaf_value(int64_t table_id, const page_t* leaf, int index,
+    uint16_t* size, std::vector<char>* buf, int trx_id)
+{
+    uint16_t slot_size = leaf_val_size(*leaf, index);
+    const char* value = leaf_val(*leaf, index);
+
+    if((slot_size & SLOT_OVERFLOW) == 0)
+    {
+        *size = slot_size;
+        return value;
+    }
+
+    *size = overflow_value_size(value);
+    buf->resize(*size);
+    overflow_read(table_id, value, 0, *size, buf->data(), trx_id);
+    return buf->data();
+}
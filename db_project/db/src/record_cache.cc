@@ -0,0 +1,184 @@
+#include "../include/record_cache.h"
+
+#include <pthread.h>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+struct cached_record_t
+{
+    std::pair<int64_t, int64_t> id;
+    std::string value;
+};
+
+struct alignas(64) cache_partition_t
+{
+    pthread_mutex_t latch = PTHREAD_MUTEX_INITIALIZER;
+
+    // values from the one read last
+    std::list<cached_record_t> cached_records;
+
+    // values by <table id, key>
+    std::map<std::pair<int64_t, int64_t>,
+        std::list<cached_record_t>::iterator> records;
+
+    // bytes of the values, so that values are dropped without the latch
+    // while there is none.
+    std::atomic<size_t> size{0};
+
+    // counted under the latch, instead of in shared counters.
+    uint64_t hits = 0, misses = 0;
+};
+
+cache_partition_t Cache_partitions[RECORD_CACHE_PARTITIONS];
+
+// capacity of each partition
+std::atomic<size_t> Partition_capacity(0);
+
+static cache_partition_t& partition_of(int64_t table_id, int64_t key)
+{
+    uint64_t x = (uint64_t)key * 0x9e3779b97f4a7c15ULL + (uint64_t)table_id;
+    return Cache_partitions[(x ^ (x >> 32)) % RECORD_CACHE_PARTITIONS];
+}
+
+// the latch should be held.
+static void erase_record(cache_partition_t& partition,
+    std::list<cached_record_t>::iterator it)
+{
+    partition.size -= it->value.size();
+    partition.records.erase(it->id);
+    partition.cached_records.erase(it);
+}
+
+// the latch should be held.
+static void shrink_to(cache_partition_t& partition, size_t capacity)
+{
+    while(partition.size > capacity)
+    {
+        erase_record(partition, std::prev(partition.cached_records.end()));
+    }
+}
+
+void record_cache_resize(size_t capacity)
+{
+    Partition_capacity = capacity / RECORD_CACHE_PARTITIONS;
+    for(cache_partition_t& partition : Cache_partitions)
+    {
+        pthread_mutex_lock(&partition.latch);
+        shrink_to(partition, Partition_capacity);
+        pthread_mutex_unlock(&partition.latch);
+    }
+}
+
+// find the value, and make it the one read last. the latch should be held.
+static const std::string* find_value(cache_partition_t& partition,
+    int64_t table_id, int64_t key)
+{
+    auto it = partition.records.find({table_id, key});
+    if(it == partition.records.end())
+    {
+        partition.misses++;
+        return nullptr;
+    }
+
+    partition.hits++;
+    partition.cached_records.splice(partition.cached_records.begin(),
+        partition.cached_records, it->second);
+    return &it->second->value;
+}
+
+bool record_cache_get(int64_t table_id, int64_t key, char* value,
+    uint16_t* val_size)
+{
+    if(Partition_capacity.load(std::memory_order_relaxed) == 0) return false;
+
+    cache_partition_t& partition = partition_of(table_id, key);
+    pthread_mutex_lock(&partition.latch);
+    const std::string* cached = find_value(partition, table_id, key);
+    if(cached != nullptr)
+    {
+        *val_size = cached->size();
+        memcpy(value, cached->data(), cached->size());
+    }
+    pthread_mutex_unlock(&partition.latch);
+    return cached != nullptr;
+}
+
+bool record_cache_read(int64_t table_id, int64_t key, uint16_t offset,
+    char* buf, uint16_t len, uint16_t* read_size)
+{
+    if(Partition_capacity.load(std::memory_order_relaxed) == 0) return false;
+
+    cache_partition_t& partition = partition_of(table_id, key);
+    pthread_mutex_lock(&partition.latch);
+    const std::string* cached = find_value(partition, table_id, key);
+    if(cached != nullptr)
+    {
+        *read_size = (offset < cached->size())
+            ? std::min<size_t>(len, cached->size() - offset) : 0;
+        memcpy(buf, cached->data() + offset, *read_size);
+    }
+    pthread_mutex_unlock(&partition.latch);
+    return cached != nullptr;
+}
+
+void record_cache_put(int64_t table_id, int64_t key, const char* value,
+    uint16_t val_size)
+{
+    size_t capacity = Partition_capacity.load(std::memory_order_relaxed);
+    if(val_size > capacity) return;
+
+    cache_partition_t& partition = partition_of(table_id, key);
+    pthread_mutex_lock(&partition.latch);
+
+    auto it = partition.records.find({table_id, key});
+    if(it != partition.records.end()) erase_record(partition, it->second);
+
+    partition.cached_records.push_front({{table_id, key},
+        std::string(value, val_size)});
+    partition.records[{table_id, key}] = partition.cached_records.begin();
+    partition.size += val_size;
+    shrink_to(partition, capacity);
+
+    pthread_mutex_unlock(&partition.latch);
+}
+
+void record_cache_invalidate(int64_t table_id, int64_t key)
+{
+    cache_partition_t& partition = partition_of(table_id, key);
+    if(partition.size.load(std::memory_order_acquire) == 0) return;
+
+    pthread_mutex_lock(&partition.latch);
+    auto it = partition.records.find({table_id, key});
+    if(it != partition.records.end()) erase_record(partition, it->second);
+    pthread_mutex_unlock(&partition.latch);
+}
+
+void record_cache_clear()
+{
+    for(cache_partition_t& partition : Cache_partitions)
+    {
+        pthread_mutex_lock(&partition.latch);
+        partition.cached_records.clear();
+        partition.records.clear();
+        partition.size = 0;
+        pthread_mutex_unlock(&partition.latch);
+    }
+}
+
+void record_cache_stats(uint64_t* hits, uint64_t* misses)
+{
+    *hits = *misses = 0;
+    for(cache_partition_t& partition : Cache_partitions)
+    {
+        pthread_mutex_lock(&partition.latch);
+        *hits += partition.hits;
+        *misses += partition.misses;
+        pthread_mutex_unlock(&partition.latch);
+    }
+}
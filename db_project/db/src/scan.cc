@@ -0,0 +1,527 @@
+#include "../include/scan.h"
+
+#include <cstring>
+#include <vector>
+
+#include "../include/bpt.h"
+#include "../include/buffer.h"
+#include "../include/leaf.h"
+#include "../include/lock_table.h"
+#include "../include/mvcc.h"
+#include "../include/overflow.h"
+#include "../include/trx.h"
+
+int scan_readahead_window = SCAN_READAHEAD_WINDOW;
+
+ScanCursor::ScanCursor(int64_t table_id, int64_t key_start, int64_t key_end,
+    int trx_id, bool descending)
+: table_id(table_id), key_start(key_start), key_end(key_end),
+  trx_id(trx_id), descending(descending), root_slot(3),
+  leaf_bb(BufferBlockPointer::unvalid_instance()), leaf(nullptr),
+  next_leaf(0), prev_leaf(0), index(0),
+  resume_key(descending ? key_end : key_start), next_key_locked(false),
+  sequential_leaves(0), readahead_left(0), is_last(false),
+  finished(key_end < key_start), is_snapshot(false)
+{
+}
+
+pagenum_t ScanCursor::get_root()
+{
+    page_t header_p;
+    buffer_manager->get_block(table_id, 0, trx_id, &header_p);
+    return header_p.ui64_array[root_slot];
+}
+
+bool ScanCursor::next(int64_t* key, const char** value, uint16_t* val_size)
+{
+    while(finished == false)
+    {
+        if(is_snapshot)
+        {
+            if(index < (int)keys.size())
+            {
+                int i = descending ? keys.size() - 1 - index : index;
+                *key = keys[i];
+                *value = values.data() + offsets[i];
+                *val_size = val_sizes[i];
+                index++;
+                return true;
+            }
+
+            if(is_last) finished = true;
+            else read_leaf_snapshot();
+            continue;
+        }
+
+        if(leaf_bb.valid == false)
+        {
+            read_leaf();
+            continue;
+        }
+
+        int num_keys = leaf->si32_array[3];
+        while(index < num_keys)
+        {
+            int i = descending ? num_keys - 1 - index : index;
+            index++;
+
+            int64_t c_key = leaf_key(*leaf, i);
+            if(descending ? resume_key < c_key : c_key < resume_key) continue;
+            if(descending ? c_key < key_start : key_end < c_key)
+            {
+                finished = true;
+                break;
+            }
+
+            *key = c_key;
+            *value = leaf_value(table_id, leaf, i, val_size, &overflow_value,
+                trx_id);
+
+            // the value stays in the leaf(or in overflow_value)
+            // until the next call.
+            if(c_key == (descending ? key_start : key_end)) finished = true;
+            else resume_key = descending ? c_key - 1 : c_key + 1;
+            return true;
+        }
+
+        if(finished == false)
+        {
+            if(is_last) finished = true;
+            else next_leaf_or_finish();
+        }
+    }
+
+    close();
+    return false;
+}
+
+void ScanCursor::close()
+{
+    leaf_bb = BufferBlockPointer::unvalid_instance();
+    leaf = nullptr;
+}
+
+void ScanCursor::read_leaf()
+{
+    if(trx_is_read_only(trx_id))
+    {
+        is_snapshot = true;
+        if(trx_get_read_view(trx_id, &view) == false)
+        {
+            throw std::runtime_error("no read view");
+        }
+        read_leaf_snapshot();
+        return;
+    }
+
+    if(trx_id > 0)
+    {
+        read_leaf_locking();
+        return;
+    }
+
+    page_t n_p;
+    BufferBlockPointer n_bb = get_next_leaf(&n_p);
+    bool sequential = n_bb.valid;
+    if(n_bb.valid == false)
+    {
+        n_bb = find_leaf(table_id, get_root(), resume_key, trx_id);
+    }
+    if(n_bb.valid == false)
+    {
+        finished = true;
+        return;
+    }
+
+    leaf_bb = std::move(n_bb);
+    leaf = buffer_manager->get_frame(leaf_bb);
+    index = 0;
+    on_leaf(leaf_bb.page_num, leaf->ui64_array[0], sequential);
+}
+
+BufferBlockPointer ScanCursor::get_next_leaf(page_t* leaf_p)
+{
+    if(next_leaf == 0) return BufferBlockPointer::unvalid_instance();
+
+    BufferBlockPointer n_bb = buffer_manager->get_block(table_id, next_leaf,
+        trx_id, leaf_p);
+    next_leaf = 0;
+
+    // the leaf may have been split or merged after prev_leaf is released.
+    pagenum_t back_link = descending ?
+        leaf_p->ui64_array[15] : leaf_p->ui64_array[13];
+    if(leaf_p->ui32_array[2] != 1 || back_link != prev_leaf)
+    {
+        return BufferBlockPointer::unvalid_instance();
+    }
+    return n_bb;
+}
+
+void ScanCursor::next_leaf_or_finish()
+{
+    pagenum_t sibling = descending ?
+        leaf->ui64_array[13] : leaf->ui64_array[15];
+    if(sibling == 0)
+    {
+        finished = true;
+        return;
+    }
+
+    if(descending == false && trx_id == 0)
+    {
+        // the right sibling is latched before the current leaf is released.
+        BufferBlockPointer n_bb = buffer_manager->get_block(table_id, sibling,
+            trx_id);
+        leaf_bb = std::move(n_bb);
+        leaf = buffer_manager->get_frame(leaf_bb);
+        index = 0;
+        on_leaf(leaf_bb.page_num, leaf->ui64_array[0], true);
+        return;
+    }
+
+    // locks are requested, or the left sibling is latched,
+    // without holding the latch.
+    prev_leaf = leaf_bb.page_num;
+    close();
+    next_leaf = sibling;
+}
+
+bool ScanCursor::keys_to_lock(page_t* leaf_p, std::vector<int64_t>* lock_keys)
+{
+    if(descending == false)
+    {
+        return range_keys_in_leaf(leaf_p, resume_key, key_end, lock_keys);
+    }
+
+    // the first key after the range is locked by lock_next_key.
+    lock_keys->clear();
+    for(int i = leaf_p->si32_array[3] - 1; i >= 0; i--)
+    {
+        int64_t c_key = leaf_key(*leaf_p, i);
+        if(resume_key < c_key) continue;
+        if(c_key < key_start) return true;
+
+        lock_keys->push_back(c_key);
+    }
+    return leaf_p->ui64_array[13] == 0;
+}
+
+// find the smallest key greater than key in the tree,
+// or LOCK_SUPREMUM_KEY if there is no such key.
+static int64_t first_key_after(int64_t table_id, pagenum_t root, int64_t key,
+    int trx_id)
+{
+    BufferBlockPointer n_bb = find_leaf(table_id, root, key, trx_id);
+    while(n_bb.valid)
+    {
+        const page_t* n_p = buffer_manager->get_frame(n_bb);
+        for(int i = 0; i < n_p->si32_array[3]; i++)
+        {
+            int64_t c_key = leaf_key(*n_p, i);
+            if(key < c_key) return c_key;
+        }
+
+        pagenum_t sibling = n_p->ui64_array[15];
+        if(sibling == 0) break;
+
+        BufferBlockPointer sibling_bb = buffer_manager->get_block(table_id,
+            sibling, trx_id);
+        n_bb = std::move(sibling_bb);
+    }
+    return LOCK_SUPREMUM_KEY;
+}
+
+/* Locks the first key after the range and the gap below it, before a
+ * descending scan reads its first leaf, as find_range_locking does when
+ * it reaches the end of the range. The key is looked up again after the
+ * locks are granted, in case a key was inserted before it.
+ */
+void ScanCursor::lock_next_key()
+{
+    while(true)
+    {
+        int64_t next_key = first_key_after(table_id, get_root(), key_end,
+            trx_id);
+
+        if(next_key != LOCK_SUPREMUM_KEY)
+        {
+            lock_acquire(table_id, LOCK_RECORD_PAGE, next_key, trx_id,
+                LOCK_MODE_SHARED);
+        }
+        lock_acquire(table_id, LOCK_GAP_PAGE, next_key, trx_id,
+            LOCK_MODE_SHARED);
+
+        if(first_key_after(table_id, get_root(), key_end, trx_id) == next_key)
+        {
+            return;
+        }
+    }
+}
+
+// let the window leaves after leaf(or before it, if descending) among the
+// children of parent be read in the background. returns their number.
+static int read_ahead(int64_t table_id, pagenum_t leaf, pagenum_t parent,
+    int window, bool descending)
+{
+    // the parent may be changed, since it isn't latched, but only the
+    // page numbers are taken from it as a hint.
+    page_t parent_p;
+    if(parent == 0 || buffer_manager->peek_page(table_id, parent,
+        &parent_p) == false) return 0;
+
+    int num_keys = parent_p.ui32_array[3];
+    if(parent_p.ui32_array[2] != 0 || num_keys > Internal::MAX_KEYS)
+    {
+        return 0;
+    }
+
+    auto child = [&](int i)
+    {
+        return (i == 0) ? parent_p.ui64_array[15]
+            : parent_p.ui64_array[17 + 2 * (i - 1)];
+    };
+
+    int pos = 0;
+    while(pos <= num_keys && child(pos) != leaf) pos++;
+    if(pos > num_keys) return 0;
+
+    std::vector<pagenum_t> pages;
+    for(int i = 1; i <= window; i++)
+    {
+        int j = descending ? pos - i : pos + i;
+        if(j < 0 || j > num_keys) break;
+        pages.push_back(child(j));
+    }
+
+    if(pages.empty() == false) buffer_manager->prefetch_pages(table_id, pages);
+    return pages.size();
+}
+
+void ScanCursor::on_leaf(pagenum_t leaf_num, pagenum_t parent, bool sequential)
+{
+    if(sequential == false)
+    {
+        sequential_leaves = 0;
+        readahead_left = 0;
+        return;
+    }
+
+    sequential_leaves++;
+    if(readahead_left > 0) readahead_left--;
+
+    // the next window is asked for before the last one is used up.
+    if(scan_readahead_window > 0
+        && sequential_leaves >= SCAN_READAHEAD_TRIGGER
+        && readahead_left <= scan_readahead_window / 2)
+    {
+        readahead_left = read_ahead(table_id, leaf_num, parent,
+            scan_readahead_window, descending);
+    }
+}
+
+/* Latches the leaf to read next, after its records in the range and
+ * the first key after them get next-key locks, as find_range_locking
+ * does. If the leaf has changed while the locks are acquired, the leaf
+ * with resume_key is found again from the root.
+ */
+void ScanCursor::read_leaf_locking()
+{
+    std::vector<int64_t> lock_keys, check_keys;
+    page_t n_p;
+
+    if(descending && next_key_locked == false)
+    {
+        lock_next_key();
+        next_key_locked = true;
+    }
+
+    pagenum_t n;
+    {
+        BufferBlockPointer n_bb = get_next_leaf(&n_p);
+        n = n_bb.valid ? n_bb.page_num : 0;
+    }
+    bool sequential = (n != 0);
+
+    while(true)
+    {
+        if(n == 0)
+        {
+            sequential = false;
+            {
+                BufferBlockPointer n_bb = find_leaf(table_id, get_root(),
+                    resume_key, trx_id);
+                n = n_bb.valid ? n_bb.page_num : 0;
+            }
+
+            if(n == 0)
+            {
+                // empty tree: only the supremum can protect the range
+                lock_acquire(table_id, LOCK_GAP_PAGE, LOCK_SUPREMUM_KEY,
+                    trx_id, LOCK_MODE_SHARED);
+
+                if(get_root() == 0)
+                {
+                    finished = true;
+                    return;
+                }
+                continue;
+            }
+        }
+
+        buffer_manager->get_block(table_id, n, trx_id, &n_p);
+        if(n_p.ui32_array[2] != 1)
+        {
+            n = 0;
+            continue;
+        }
+
+        bool range_ends = keys_to_lock(&n_p, &lock_keys);
+
+        for(int64_t c_key : lock_keys)
+        {
+            if(c_key != LOCK_SUPREMUM_KEY)
+            {
+                lock_acquire(table_id, LOCK_RECORD_PAGE, c_key, trx_id,
+                    LOCK_MODE_SHARED);
+            }
+            lock_acquire(table_id, LOCK_GAP_PAGE, c_key, trx_id,
+                LOCK_MODE_SHARED);
+        }
+
+        // read the leaf again, and check nothing has changed.
+        BufferBlockPointer n_bb = buffer_manager->get_block(
+            table_id, n, trx_id, &n_p);
+
+        if(n_p.ui32_array[2] != 1
+            || keys_to_lock(&n_p, &check_keys) != range_ends
+            || check_keys != lock_keys)
+        {
+            n = 0;
+            continue;
+        }
+
+        leaf_bb = std::move(n_bb);
+        leaf = buffer_manager->get_frame(leaf_bb);
+        index = 0;
+        is_last = range_ends;
+        on_leaf(n, leaf->ui64_array[0], sequential);
+        return;
+    }
+}
+
+/* Copies the versions visible to the read view, of the records from
+ * resume_key to the bound of its leaf in the direction of the cursor,
+ * merged with the ones deleted after the snapshot, as find_range_snapshot
+ * does for the whole range. No latch is kept after that, so the next leaf
+ * is always found from the root.
+ */
+void ScanCursor::read_leaf_snapshot()
+{
+    std::vector<char> version(MAX_VALUE_SIZE);
+    uint16_t version_size;
+
+    std::vector<int64_t> page_keys, old_keys;
+    std::vector<int> page_offsets;
+    std::vector<uint16_t> page_sizes, old_sizes;
+    std::vector<char*> old_values;
+    std::vector<char> page_values;
+
+    // keys in [low_key, high_key] are read from this leaf.
+    int64_t low_key = descending ? key_start : resume_key;
+    int64_t high_key = descending ? resume_key : key_end;
+    is_last = true;
+
+    {
+        int64_t upper_bound = INT64_MAX, lower_bound = INT64_MIN;
+        BufferBlockPointer n_bb = find_leaf(table_id, get_root(), resume_key,
+            trx_id, &upper_bound, &lower_bound);
+
+        // keys between the separators belong to this leaf, even if
+        // they are not in it now.
+        if(descending == false && upper_bound != INT64_MAX
+            && upper_bound <= key_end)
+        {
+            high_key = upper_bound - 1;
+            is_last = false;
+        }
+        if(descending && lower_bound != INT64_MIN && key_start < lower_bound)
+        {
+            low_key = lower_bound;
+            is_last = false;
+        }
+
+        if(n_bb.valid)
+        {
+            const page_t* n_p = buffer_manager->get_frame(n_bb);
+            int num_keys = n_p->si32_array[3];
+
+            // every leaf but the first is next to the one read before.
+            on_leaf(n_bb.page_num, n_p->ui64_array[0],
+                resume_key != (descending ? key_end : key_start));
+
+            for(int i = 0; i < num_keys; i++)
+            {
+                int64_t c_key = leaf_key(*n_p, i);
+                if(c_key < low_key) continue;
+                if(high_key < c_key) break;
+
+                uint16_t c_size;
+                const char* c_value = leaf_value(table_id, n_p, i, &c_size,
+                    &overflow_value, trx_id);
+                if(mvcc_read(view, table_id, c_key, c_value, c_size,
+                    version.data(), &version_size) != 0) continue;
+
+                page_keys.push_back(c_key);
+                page_offsets.push_back(page_values.size());
+                page_sizes.push_back(version_size);
+                page_values.insert(page_values.end(), version.data(),
+                    version.data() + version_size);
+            }
+        }
+    }
+
+    mvcc_read_range(view, table_id, low_key, high_key,
+        &old_keys, &old_values, &old_sizes);
+
+    keys.clear();
+    offsets.clear();
+    val_sizes.clear();
+    values.clear();
+    index = 0;
+
+    // the visible version of a key is the same in both of them.
+    size_t i = 0, j = 0;
+    while(i < page_keys.size() || j < old_keys.size())
+    {
+        bool from_page = (j == old_keys.size()
+            || (i < page_keys.size() && page_keys[i] <= old_keys[j]));
+
+        if(from_page)
+        {
+            if(j < old_keys.size() && page_keys[i] == old_keys[j])
+            {
+                delete[] old_values[j++];
+            }
+            const char* value = page_values.data() + page_offsets[i];
+
+            keys.push_back(page_keys[i]);
+            offsets.push_back(values.size());
+            val_sizes.push_back(page_sizes[i]);
+            values.insert(values.end(), value, value + page_sizes[i++]);
+        }
+        else
+        {
+            keys.push_back(old_keys[j]);
+            offsets.push_back(values.size());
+            val_sizes.push_back(old_sizes[j]);
+            values.insert(values.end(), old_values[j],
+                old_values[j] + old_sizes[j]);
+            delete[] old_values[j++];
+        }
+    }
+
+    if(is_last == false)
+    {
+        resume_key = descending ? low_key - 1 : high_key + 1;
+    }
+}
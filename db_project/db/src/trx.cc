@@ -2,78 +2,289 @@
 
 #include <pthread.h>
 
+#include <algorithm>
 #include <vector>
-#include <map>
 
+#include "../include/buffer.h"
 #include "../include/lock_table.h"
 #include "../include/db.h"
 
 TrxManager trx_manager;
-pthread_mutex_t trx_table_latch = PTHREAD_MUTEX_INITIALIZER;
 
 int trx_begin(void)
 {
-    int trx_id;
+    // every slot is tried once, since the ids taken in turn map to
+    // slots in turn.
+    for(int i = 0; i < MAX_ACTIVE_TRX; i++)
+    {
+        int trx_id = ++trx_manager.trx_count;
+        int slot = trx_id % MAX_ACTIVE_TRX;
 
-    pthread_mutex_lock(&trx_table_latch);
-    trx_id = ++trx_manager.trx_count;
+        // the slot is still used by a long trx, or the trx which used it
+        // is ending, so take the next id.
+        int expected = 0;
+        if(trx_manager.trx_ids[slot].compare_exchange_strong(
+            expected, trx_id) == false) continue;
 
-    Transaction* new_trx = new Transaction(trx_id);
+        Transaction* new_trx = new Transaction(trx_id);
 
-    trx_manager.trx_table[trx_id] = new_trx;
-    pthread_mutex_unlock(&trx_table_latch);
-    
-    return trx_id;
+        // same as read-only trx, purge keeps every version until
+        // the snapshot number is set.
+        trx_manager.trx_views[slot].store(0);
+        mvcc_init_view(&new_trx->read_view, trx_id);
+        trx_manager.trx_views[slot].store(new_trx->read_view.snapshot_no);
+
+        trx_manager.trx_table[slot].store(new_trx);
+        return trx_id;
+    }
+
+    // too many trxs are active.
+    return 0;
+}
+
+Transaction* trx_get(int trx_id)
+{
+    if(trx_id <= 0) return nullptr;
+    int slot = trx_id % MAX_ACTIVE_TRX;
+
+    // the slot may be taken by a newer trx while it is read, so the id is
+    // checked again after that. the Transaction of other trx is not read,
+    // since it may be freed meanwhile.
+    if(trx_manager.trx_ids[slot].load() != trx_id) return nullptr;
+    Transaction* trx = trx_manager.trx_table[slot].load();
+    if(trx_manager.trx_ids[slot].load() != trx_id) return nullptr;
+
+    return trx;
+}
+
+// takes trx out of the table. returns nullptr if it has already ended.
+Transaction* trx_remove(int trx_id)
+{
+    Transaction* trx = trx_get(trx_id);
+    if(trx == nullptr) return nullptr;
+
+    // only one of threads ending the same trx takes it out.
+    if(trx_manager.trx_table[trx_id % MAX_ACTIVE_TRX]
+        .compare_exchange_strong(trx, nullptr) == false) return nullptr;
+
+    return trx;
+}
+
+int trx_begin_read_only(void)
+{
+    // start looking for a free slot at different place per thread,
+    // so that threads don't contend on the same slot.
+    static std::atomic<int> thread_count(0);
+    thread_local int hint = thread_count++ % MAX_READ_ONLY_TRX;
+
+    for(int i = 0; i < MAX_READ_ONLY_TRX; i++)
+    {
+        int slot = (hint + i) % MAX_READ_ONLY_TRX;
+        uint64_t expected = READ_VIEW_SLOT_FREE;
+
+        if(trx_manager.read_only_views[slot].load() != READ_VIEW_SLOT_FREE)
+        {
+            continue;
+        }
+
+        // make the slot visible to purge before it is used.
+        int count = trx_manager.read_only_slot_count.load();
+        while(count <= slot && trx_manager.read_only_slot_count
+            .compare_exchange_weak(count, slot + 1) == false);
+
+        // claim the slot with the oldest snapshot number first, so that
+        // purge can't free versions this view may read until it is set.
+        if(trx_manager.read_only_views[slot].compare_exchange_strong(
+            expected, 0) == false) continue;
+
+        trx_manager.read_only_views[slot].store(mvcc_snapshot_no());
+
+        hint = slot;
+        return -(slot + 1);
+    }
+
+    // too many read-only trxs, so make a normal one.
+    return trx_begin();
+}
+
+bool trx_is_read_only(int trx_id)
+{
+    return trx_id < 0 && trx_id >= -MAX_READ_ONLY_TRX;
+}
+
+int trx_end_read_only(int trx_id)
+{
+    uint64_t snapshot_no =
+        trx_manager.read_only_views[-trx_id - 1].exchange(READ_VIEW_SLOT_FREE);
+
+    return (snapshot_no == READ_VIEW_SLOT_FREE) ? 0 : trx_id;
 }
 
 void trx_rollback(int trx_id, Transaction* trx, lock_t* head)
 {
+    // rollback runs in the handlers of failed operations, so it must not
+    // fail. the only failure of an undo is a buffer pool whose frames are
+    // all pinned, so it waits for a frame instead.
+    FrameWait frame_wait;
+
+    // records may have moved to other pages, so they are found by key.
     for(auto i = trx->rollback_records.rbegin();
         i != trx->rollback_records.rend(); i++)
     {
-        db_update_with_page(i->table_id, i->page_num, i->offset,
-            i->prev_val, i->val_size, trx_id);
+        switch(i->type)
+        {
+        case UNDO_UPDATE:
+            db_undo_update(i->table_id, i->key, i->prev_val, i->val_size);
+            break;
+        case UNDO_INSERT:
+            db_undo_insert(i->table_id, i->key);
+            break;
+        case UNDO_DELETE:
+            db_undo_delete(i->table_id, i->key, i->prev_val, i->val_size,
+                trx_id);
+            break;
+        }
+        mvcc_remove_version(i->table_id, i->key, trx_id);
     }
 }
 
+// frees trx which has been taken out of the table, and frees its slot.
+void trx_free(int trx_id, Transaction* trx)
+{
+    // trxs waiting for the locks of trx are woken up and stop pointing to
+    // it, since the locks are released first.
+    remove_trx_locks(trx->lock_ptr);
+    trx->lock_ptr = nullptr;
+
+    // deadlock detection follows waiting_trx under lock_table_latch, so
+    // any pointer left to trx is cleared under it before trx is freed.
+    // trxs read here can't be freed meanwhile, since they are cleared in
+    // the same way after they are taken out of the table.
+    pthread_mutex_lock(&lock_table_latch);
+    trx->waiting_trx = nullptr;
+    for(auto& i : trx_manager.trx_table)
+    {
+        Transaction* other = i.load();
+        if(other != nullptr && other->waiting_trx == trx)
+        {
+            other->waiting_trx = nullptr;
+        }
+    }
+    pthread_mutex_unlock(&lock_table_latch);
+
+    delete trx;
+
+    // the slot can be reused from now.
+    trx_manager.trx_views[trx_id % MAX_ACTIVE_TRX].store(READ_VIEW_SLOT_FREE);
+    trx_manager.trx_ids[trx_id % MAX_ACTIVE_TRX].store(0);
+}
+
 int trx_abort(int trx_id)
 {
-    pthread_mutex_lock(&trx_table_latch);
+    if(trx_is_read_only(trx_id)) return trx_end_read_only(trx_id);
+
+    // it has already been aborted
+    auto trx = trx_remove(trx_id);
+    if(trx == nullptr) return 0;
 
-    auto trx = trx_manager.trx_table[trx_id];
-    trx_manager.trx_table.erase(trx_id);
-    
-    pthread_mutex_unlock(&trx_table_latch);
-    
     trx_rollback(trx_id, trx, trx->lock_ptr);
-    delete trx;
+    trx_free(trx_id, trx);
     
     return trx_id;
 }
 
 int trx_commit(int trx_id)
 {
-    pthread_mutex_lock(&trx_table_latch);
+    if(trx_is_read_only(trx_id)) return trx_end_read_only(trx_id);
 
-    delete trx_manager.trx_table[trx_id];
-    trx_manager.trx_table.erase(trx_id);
-    
-    pthread_mutex_unlock(&trx_table_latch);
+    // it has already been aborted
+    auto trx = trx_remove(trx_id);
+    if(trx == nullptr) return 0;
+
+    // versions must be stamped before other trxs can overwrite them.
+    mvcc_commit(trx);
+    trx_free(trx_id, trx);
+
+    trx_purge();
     
     return trx_id;
 }
 
-void trx_add_rollback_record(int trx_id, int64_t table_id, pagenum_t page_num,
-    uint16_t offset, const char* prev_val, uint16_t val_size)
+void trx_abort_all()
+{
+    for(int slot = 0; slot < MAX_ACTIVE_TRX; slot++)
+    {
+        int trx_id = trx_manager.trx_ids[slot].load();
+        if(trx_id != 0) trx_abort(trx_id);
+    }
+
+    int slot_count = trx_manager.read_only_slot_count.load();
+    for(int i = 0; i < slot_count; i++)
+    {
+        trx_manager.read_only_views[i].store(READ_VIEW_SLOT_FREE);
+    }
+}
+
+char* trx_alloc_undo(int trx_id, uint16_t size)
+{
+    auto trx = trx_get(trx_id);
+    if(trx == nullptr) return nullptr;
+
+    pthread_mutex_lock(&trx->trx_latch);
+    char* result = trx->undo_arena.alloc(size);
+    pthread_mutex_unlock(&trx->trx_latch);
+
+    return result;
+}
+
+void trx_add_rollback_record(int trx_id, int64_t table_id, int64_t key,
+    UNDO_TYPE type, const char* prev_val, uint16_t val_size)
 {
-    pthread_mutex_lock(&trx_table_latch);
-    auto trx = trx_manager.trx_table[trx_id];
+    auto trx = trx_get(trx_id);
+    pthread_mutex_lock(&trx->trx_latch);
     trx->rollback_records.push_back(
-        {table_id, page_num, offset, prev_val, val_size}
+        {table_id, key, type, prev_val, val_size}
     );
-    pthread_mutex_unlock(&trx_table_latch);
+    pthread_mutex_unlock(&trx->trx_latch);
 }
 
+bool trx_get_read_view(int trx_id, ReadView* view)
+{
+    if(trx_is_read_only(trx_id))
+    {
+        view->creator_trx_id = trx_id;
+        view->snapshot_no = trx_manager.read_only_views[-trx_id - 1].load();
+        return view->snapshot_no != READ_VIEW_SLOT_FREE;
+    }
+
+    auto trx = trx_get(trx_id);
+    if(trx == nullptr) return false;
+
+    *view = trx->read_view;
+    return true;
+}
+
+void trx_purge()
+{
+    // versions committed up to the oldest snapshot are visible to all views.
+    uint64_t horizon = mvcc_snapshot_no();
+    for(auto& i : trx_manager.trx_views)
+    {
+        horizon = std::min(horizon, i.load());
+    }
+
+    // trx which has claimed its slot but not set the snapshot yet
+    // holds 0, so nothing is purged until it is set.
+    int slot_count = trx_manager.read_only_slot_count.load();
+    for(int i = 0; i < slot_count; i++)
+    {
+        horizon = std::min(horizon, trx_manager.read_only_views[i].load());
+    }
+
+    mvcc_purge(horizon);
+}
+
+// follows the trxs waiting for each other. (lock_table_latch should be held)
 bool dfs(Transaction* curr_trx)
 {
     if(curr_trx == nullptr) return false;
@@ -110,23 +321,21 @@ bool trx_check_deadlock(Transaction* curr_trx)
 Transaction::Transaction(int trx_id)
 : trx_id(trx_id), lock_ptr(nullptr), cycle_num(0), waiting_trx(nullptr)
 {
-    
+    trx_latch = PTHREAD_MUTEX_INITIALIZER;
 }
 
 
 Transaction::~Transaction()
 {
+    // undo images are freed with undo_arena.
     remove_trx_locks(lock_ptr);
-
-    for(auto &i : rollback_records)
-    {
-        if(i.prev_val != nullptr) delete[] i.prev_val;
-        i.prev_val = nullptr;
-    }
 }
 
 TrxManager::TrxManager()
-: trx_count(0)
+: trx_count(0), read_only_slot_count(0)
 {
-    
+    for(auto& i : trx_table) i.store(nullptr);
+    for(auto& i : trx_ids) i.store(0);
+    for(auto& i : trx_views) i.store(READ_VIEW_SLOT_FREE);
+    for(auto& i : read_only_views) i.store(READ_VIEW_SLOT_FREE);
 }
\ No newline at end of file
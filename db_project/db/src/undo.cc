@@ -0,0 +1,116 @@
+#include "../include/undo.h"
+
+#include <pthread.h>
+
+#include <vector>
+
+pthread_mutex_t undo_pool_latch = PTHREAD_MUTEX_INITIALIZER;
+
+// chunks freed by ended trxs. it is never destroyed, since versions kept
+// by mvcc give their chunks back while they are destroyed at exit.
+std::vector<char*>& Undo_pool = *new std::vector<char*>();
+
+char* undo_get_chunk()
+{
+    char* chunk = nullptr;
+
+    pthread_mutex_lock(&undo_pool_latch);
+    if(Undo_pool.empty() == false)
+    {
+        chunk = Undo_pool.back();
+        Undo_pool.pop_back();
+    }
+    pthread_mutex_unlock(&undo_pool_latch);
+
+    if(chunk == nullptr) chunk = new char[UNDO_CHUNK_SIZE];
+    return chunk;
+}
+
+void undo_put_chunks(std::vector<char*>& chunks)
+{
+    pthread_mutex_lock(&undo_pool_latch);
+    while(chunks.empty() == false && Undo_pool.size() < UNDO_POOL_SIZE)
+    {
+        Undo_pool.push_back(chunks.back());
+        chunks.pop_back();
+    }
+    pthread_mutex_unlock(&undo_pool_latch);
+
+    // the pool is full.
+    for(char* chunk : chunks) delete[] chunk;
+    chunks.clear();
+}
+
+UndoArena::UndoArena()
+: used(UNDO_CHUNK_SIZE)
+{
+
+}
+
+UndoArena::UndoArena(UndoArena&& other)
+: chunks(std::move(other.chunks)), large_images(std::move(other.large_images)),
+  used(other.used)
+{
+    other.chunks.clear();
+    other.large_images.clear();
+    other.used = UNDO_CHUNK_SIZE;
+}
+
+UndoArena& UndoArena::operator=(UndoArena&& other)
+{
+    if(this != &other)
+    {
+        reset();
+        chunks = std::move(other.chunks);
+        large_images = std::move(other.large_images);
+        used = other.used;
+
+        other.chunks.clear();
+        other.large_images.clear();
+        other.used = UNDO_CHUNK_SIZE;
+    }
+    return *this;
+}
+
+UndoArena::~UndoArena()
+{
+    reset();
+}
+
+char* UndoArena::alloc(size_t size)
+{
+    // a value in overflow pages may not fit in a chunk.
+    if(size > UNDO_CHUNK_SIZE)
+    {
+        large_images.push_back(new char[size]);
+        return large_images.back();
+    }
+
+    if(used + size > UNDO_CHUNK_SIZE)
+    {
+        chunks.push_back(undo_get_chunk());
+        used = 0;
+    }
+
+    char* result = chunks.back() + used;
+    used += size;
+    return result;
+}
+
+void UndoArena::reset()
+{
+    if(chunks.empty() == false) undo_put_chunks(chunks);
+    used = UNDO_CHUNK_SIZE;
+
+    for(char* image : large_images) delete[] image;
+    large_images.clear();
+}
+
+size_t undo_pool_size()
+{
+    pthread_mutex_lock(&undo_pool_latch);
+    size_t result = Undo_pool.size();
+    pthread_mutex_unlock(&undo_pool_latch);
+
+    return result;
+}
@@ -33,17 +33,15 @@ int main( int argc, char ** argv ) {
         else db_delete(it, i);
     }
     
-    std::vector<int64_t> keys;
-    std::vector<char*> values;
-    std::vector<uint16_t> val_sizes;
+    int64_t key;
+    const char* value;
 
-    db_scan(it, 1, 12001, &keys, &values, &val_sizes);
-
-    for(int i = 0; i < keys.size(); i++)
+    ScanCursor* cursor = db_scan_open(it, 1, 12001);
+    while(db_scan_next(cursor, &key, &value, &val_size) == 0)
     {
-        std::cout << keys[i] << "/" << values[i] << "/"  << val_sizes[i] << std::endl;
-        delete values[i];
+        std::cout << key << "/" << value << "/"  << val_size << std::endl;
     }
+    db_scan_close(cursor);
     puts("Safety off");
     return 0;
 
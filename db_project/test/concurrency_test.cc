@@ -4,9 +4,19 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <random>
 
 #include "../include/db.h"
+#include "../include/bpt.h"
 #include "../include/buffer.h"
+#include "../include/hash_index.h"
+#include "../include/index.h"
+#include "../include/leaf.h"
+#include "../include/key.h"
+#include "../include/key_tree.h"
 #include "../include/trx.h"
 
 #define THREAD_NUMBER 40
@@ -265,6 +275,61 @@ TEST_F(ConcurrencyTestWithSmallBuffer, SingleThreadTest)
     ASSERT_NE(result, 0) << "trx_commit() failed (returns " << result << ")";
 }
 
+struct rollback_arg_t
+{
+    int trx_id;
+    int result;
+    std::atomic<bool> done;
+};
+
+void* abort_trx(void* arg)
+{
+    rollback_arg_t* rollback = (rollback_arg_t*)arg;
+    rollback->result = trx_abort(rollback->trx_id);
+    rollback->done = true;
+    return nullptr;
+}
+
+TEST_F(ConcurrencyTestWithSmallBuffer, RollbackWaitsForFramesTest)
+{
+    char value[120] = "A record which is restored by the rollback";
+    char new_value[120] = "B record which is restored by the rollback";
+    uint16_t len = strlen(value), val_size;
+
+    for(int64_t i = 1; i <= 9000; i++)
+    {
+        ASSERT_EQ(db_insert(table_id, i, value, len), 0);
+    }
+
+    rollback_arg_t rollback;
+    rollback.trx_id = trx_begin();
+    rollback.done = false;
+    ASSERT_EQ(db_update(table_id, 777, new_value, len, &val_size,
+        rollback.trx_id), 0);
+
+    // every frame is pinned by pages other than the header.
+    std::vector<BufferBlockPointer> pinned;
+    for(pagenum_t i = 1; i <= 100; i++)
+    {
+        pinned.push_back(buffer_manager->get_block(table_id, i, 0));
+    }
+    ASSERT_THROW(buffer_manager->get_block(table_id, 0, 0), NoSpaceException);
+
+    // rollback waits for a frame, instead of failing.
+    pthread_t thread;
+    pthread_create(&thread, 0, abort_trx, &rollback);
+    usleep(200 * 1000);
+    ASSERT_EQ(rollback.done.load(), false);
+
+    pinned.clear();
+    pthread_join(thread, nullptr);
+    ASSERT_EQ(rollback.result, rollback.trx_id);
+
+    ASSERT_EQ(db_find(table_id, 777, value, &val_size, 0), 0);
+    ASSERT_EQ(value[0], 'A');
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
 TEST_F(ConcurrencyTest, SingleThreadTest)
 {
     char value[120];
@@ -443,8 +508,8 @@ void* xlodt1(void* tid)
     int trx_id = trx_begin();
     int table_id = *((int*)tid);
     
-    uint16_t value_len;
     char value[120] = "The largest record can have 112 Bytes! So I am trying to test it work well even given longest record";
+    uint16_t value_len = (uint16_t) strlen(value);
     printf("%d", db_update(table_id, 1000, value, value_len, &value_len, trx_id));
     sleep(3);
     printf("%d", db_update(table_id, 1001, value, value_len, &value_len, trx_id));
@@ -458,8 +523,8 @@ void* xlodt2(void* tid)
     int trx_id = trx_begin();
     int table_id = *((int*)tid);
     
-    uint16_t value_len;
     char value[120] = "The largest record can have 112 Bytes! So I am trying to test it work well even given longest record";
+    uint16_t value_len = (uint16_t) strlen(value);
     printf("%d", db_update(table_id, 1001, value, value_len, &value_len, trx_id));
     sleep(3);
     sleep(3);
@@ -582,3 +647,2219 @@ TEST_F(ConcurrencyTest, BothLockTest)
     //    ASSERT_EQ(value[0], '0' + THREAD_NUMBER) << "wrong record at " << i;
     }
 }
+
+struct insert_arg_t
+{
+    int64_t table_id;
+    int64_t key;
+    volatile bool done;
+};
+
+void* insert_one_record(void* arg)
+{
+    insert_arg_t* insert_arg = (insert_arg_t*)arg;
+
+    char value[120] = "The record inserted while a range is being scanned";
+    db_insert(insert_arg->table_id, insert_arg->key, value, strlen(value));
+
+    insert_arg->done = true;
+    return nullptr;
+}
+
+TEST_F(ConcurrencyTest, RangeScanPhantomTest)
+{
+    char value[120] = "The largest record can have 112 Bytes! So I am trying to test it work well even given longest record";
+
+    // insert initial records with even keys
+    for(int64_t i = 0; i <= 2000; i += 2)
+    {
+        int result = db_insert(table_id, i, value, strlen(value));
+        ASSERT_EQ(result, 0) << "failed to insert a record.";
+    }
+
+    std::vector<int64_t> keys;
+    std::vector<char*> values;
+    std::vector<uint16_t> val_sizes;
+
+    int trx_id = trx_begin();
+    ASSERT_EQ(db_scan(table_id, 100, 200, &keys, &values, &val_sizes, trx_id), 0);
+    ASSERT_EQ(keys.size(), 51);
+
+    // one record goes into the scanned range, and the other doesn't.
+    insert_arg_t inside = {table_id, 151, false};
+    insert_arg_t outside = {table_id, 1501, false};
+
+    pthread_t threads[2];
+    pthread_create(&threads[0], 0, insert_one_record, (void *)&inside);
+    pthread_create(&threads[1], 0, insert_one_record, (void *)&outside);
+
+    pthread_join(threads[1], NULL);
+    ASSERT_TRUE(outside.done) << "insert outside of the range has been blocked";
+
+    sleep(1);
+    ASSERT_FALSE(inside.done) << "phantom record has been inserted";
+
+    for(auto i : values) delete[] i;
+    keys.clear(), values.clear(), val_sizes.clear();
+
+    // the range must be same with the first read.
+    ASSERT_EQ(db_scan(table_id, 100, 200, &keys, &values, &val_sizes, trx_id), 0);
+    ASSERT_EQ(keys.size(), 51);
+    for(auto i : values) delete[] i;
+
+    ASSERT_NE(trx_commit(trx_id), 0);
+
+    pthread_join(threads[0], NULL);
+    ASSERT_TRUE(inside.done);
+
+    uint16_t val_size;
+    ASSERT_EQ(db_find(table_id, 151, value, &val_size, 0), 0);
+    ASSERT_EQ(db_find(table_id, 1501, value, &val_size, 0), 0);
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, SnapshotReadTest)
+{
+    char value[120] = "A record which will be read by snapshot";
+    char new_value[120] = "B record which will be read by snapshot";
+    uint16_t len = strlen(value), val_size;
+
+    for(int64_t i = 1; i <= 100; i++)
+    {
+        int result = db_insert(table_id, i, value, len);
+        ASSERT_EQ(result, 0) << "failed to insert a record.";
+    }
+
+    int reader = trx_begin();
+    int writer = trx_begin();
+
+    // the reader doesn't wait for the x lock of the writer.
+    ASSERT_EQ(db_update(table_id, 10, new_value, len, &val_size, writer), 0);
+    ASSERT_EQ(db_find_snapshot(table_id, 10, value, &val_size, reader), 0);
+    ASSERT_EQ(value[0], 'A');
+
+    ASSERT_NE(trx_commit(writer), 0);
+
+    // committed after the snapshot, so it is still invisible.
+    ASSERT_EQ(db_find_snapshot(table_id, 10, value, &val_size, reader), 0);
+    ASSERT_EQ(value[0], 'A');
+    ASSERT_EQ(val_size, len);
+
+    int new_reader = trx_begin();
+    ASSERT_EQ(db_find_snapshot(table_id, 10, value, &val_size, new_reader), 0);
+    ASSERT_EQ(value[0], 'B');
+
+    // rolled back version is never visible.
+    int aborted = trx_begin();
+    ASSERT_EQ(db_update(table_id, 20, new_value, len, &val_size, aborted), 0);
+    ASSERT_EQ(db_find_snapshot(table_id, 20, value, &val_size, aborted), 0);
+    ASSERT_EQ(value[0], 'B');
+    trx_abort(aborted);
+
+    ASSERT_EQ(db_find_snapshot(table_id, 20, value, &val_size, new_reader), 0);
+    ASSERT_EQ(value[0], 'A');
+    ASSERT_EQ(db_find_snapshot(table_id, 1000, value, &val_size, reader), -1);
+
+    // old versions are freed once no snapshot needs them.
+    ASSERT_GT(mvcc_num_versions(), 0);
+    ASSERT_NE(trx_commit(reader), 0);
+    ASSERT_NE(trx_commit(new_reader), 0);
+    ASSERT_EQ(mvcc_num_versions(), 0);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, ShutdownResetTest)
+{
+    char value[120] = "A record which is left updated by shutdown";
+    char new_value[120] = "B record which is left updated by shutdown";
+    uint16_t len = strlen(value), val_size;
+
+    for(int64_t i = 1; i <= 100; i++)
+    {
+        ASSERT_EQ(db_insert(table_id, i, value, len), 0);
+    }
+
+    // trx and a reader are left unfinished by shutdown.
+    int trx = trx_begin();
+    int reader = trx_begin_read_only();
+    ASSERT_EQ(db_update(table_id, 10, new_value, len, &val_size, trx), 0);
+    ASSERT_GT(mvcc_num_versions(), 0);
+
+    shutdown_db();
+    init_db(500);
+    int64_t new_table_id = open_table(pathname.c_str());
+    ASSERT_EQ(new_table_id, table_id);
+
+    // the update of the unfinished trx is rolled back, and none of its
+    // versions and locks is left for the reused table id.
+    ASSERT_EQ(mvcc_num_versions(), 0);
+    ASSERT_EQ(db_find(table_id, 10, value, &val_size, 0), 0);
+    ASSERT_EQ(value[0], 'A');
+    ASSERT_EQ(trx_commit(reader), 0);
+
+    int next = trx_begin();
+    ASSERT_EQ(db_update(table_id, 10, new_value, len, &val_size, next), 0);
+    ASSERT_NE(trx_commit(next), 0);
+    ASSERT_EQ(db_find(table_id, 10, value, &val_size, 0), 0);
+    ASSERT_EQ(value[0], 'B');
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, ReadOnlyTrxTest)
+{
+    char value[120] = "A record which will be read by read-only trx";
+    char new_value[120] = "B record which will be read by read-only trx";
+    uint16_t len = strlen(value), val_size;
+
+    for(int64_t i = 1; i <= 300; i++)
+    {
+        int result = db_insert(table_id, i, value, len);
+        ASSERT_EQ(result, 0) << "failed to insert a record.";
+    }
+
+    int reader = trx_begin_read_only();
+    ASSERT_EQ(trx_is_read_only(reader), true);
+
+    int writer = trx_begin();
+    ASSERT_EQ(db_update(table_id, 150, new_value, len, &val_size, writer), 0);
+    ASSERT_NE(trx_commit(writer), 0);
+
+    // read-only trx still sees its snapshot, without any lock.
+    ASSERT_EQ(db_find(table_id, 150, value, &val_size, reader), 0);
+    ASSERT_EQ(value[0], 'A');
+
+    std::vector<int64_t> keys;
+    std::vector<char*> values;
+    std::vector<uint16_t> val_sizes;
+    ASSERT_EQ(db_scan(table_id, 100, 200, &keys, &values, &val_sizes,
+        reader), 0);
+    ASSERT_EQ(keys.size(), 101);
+    for(size_t i = 0; i < keys.size(); i++)
+    {
+        ASSERT_EQ(values[i][0], 'A') << "newer version is read at " << keys[i];
+        delete[] values[i];
+    }
+
+    // read-only trx can't write.
+    ASSERT_EQ(db_update(table_id, 10, new_value, len, &val_size, reader), -1);
+
+    ASSERT_GT(mvcc_num_versions(), 0);
+    ASSERT_EQ(trx_commit(reader), reader);
+    trx_purge();
+    ASSERT_EQ(mvcc_num_versions(), 0);
+
+    // slots are reused after commit.
+    for(int i = 0; i < 2 * MAX_READ_ONLY_TRX; i++)
+    {
+        int trx_id = trx_begin_read_only();
+        ASSERT_EQ(db_find(table_id, 150, value, &val_size, trx_id), 0);
+        ASSERT_EQ(value[0], 'B');
+        ASSERT_EQ(trx_commit(trx_id), trx_id);
+    }
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+void* begin_and_commit_trxs(void* arg)
+{
+    std::vector<int>* trx_ids = (std::vector<int>*)arg;
+
+    for(int i = 0; i < RECORD_NUMBER; i++)
+    {
+        int trx_id = trx_begin();
+        if(trx_get(trx_id) == nullptr) return nullptr;
+
+        // keep some of trxs active, so the slots of them are skipped.
+        if(i % 100 == 0) trx_ids->push_back(trx_id);
+        else if(trx_commit(trx_id) == trx_id) trx_ids->push_back(trx_id);
+    }
+    return nullptr;
+}
+
+TEST_F(ConcurrencyTest, ConcurrentTrxBeginTest)
+{
+    pthread_t threads[THREAD_NUMBER];
+    std::vector<int> trx_ids[THREAD_NUMBER];
+
+    for(int i = 0; i < THREAD_NUMBER; i++)
+    {
+        pthread_create(&threads[i], 0, begin_and_commit_trxs, &trx_ids[i]);
+    }
+    for(int i = 0; i < THREAD_NUMBER; i++)
+    {
+        pthread_join(threads[i], nullptr);
+    }
+
+    // every trx got its own id.
+    std::vector<int> all_ids;
+    for(int i = 0; i < THREAD_NUMBER; i++)
+    {
+        ASSERT_EQ(trx_ids[i].size(), RECORD_NUMBER);
+        all_ids.insert(all_ids.end(), trx_ids[i].begin(), trx_ids[i].end());
+    }
+    std::sort(all_ids.begin(), all_ids.end());
+    ASSERT_EQ(std::unique(all_ids.begin(), all_ids.end()), all_ids.end());
+
+    // trxs left active are still found, and can be committed.
+    for(int i = 0; i < THREAD_NUMBER; i++)
+    {
+        for(int j = 0; j < RECORD_NUMBER; j += 100)
+        {
+            ASSERT_NE(trx_get(trx_ids[i][j]), nullptr);
+            ASSERT_EQ(trx_commit(trx_ids[i][j]), trx_ids[i][j]);
+            ASSERT_EQ(trx_get(trx_ids[i][j]), nullptr);
+        }
+    }
+}
+
+TEST_F(ConcurrencyTest, TrxTableFullTest)
+{
+    // begin fails, instead of waiting, while every slot is used.
+    std::vector<int> trx_ids;
+    int trx_id;
+    while((trx_id = trx_begin()) != 0)
+    {
+        trx_ids.push_back(trx_id);
+        ASSERT_LE(trx_ids.size(), MAX_ACTIVE_TRX);
+    }
+
+    // a slot freed by commit is used again.
+    ASSERT_EQ(trx_commit(trx_ids.back()), trx_ids.back());
+    trx_ids.back() = trx_begin();
+    ASSERT_GT(trx_ids.back(), 0);
+    ASSERT_EQ(trx_begin(), 0);
+
+    for(int id : trx_ids) ASSERT_EQ(trx_commit(id), id);
+    ASSERT_GT(trx_id = trx_begin(), 0);
+    ASSERT_EQ(trx_commit(trx_id), trx_id);
+}
+
+TEST_F(ConcurrencyTest, UndoArenaTest)
+{
+    char value[120] = "A record whose undo image is kept in the arena";
+    char new_value[120] = "B record whose undo image is kept in the arena";
+    uint16_t len = strlen(value), val_size;
+
+    for(int64_t i = 1; i <= 1000; i++)
+    {
+        int result = db_insert(table_id, i, value, len);
+        ASSERT_EQ(result, 0) << "failed to insert a record.";
+    }
+
+    // undo images of aborted trx are restored, and its chunks are pooled.
+    int trx_id = trx_begin();
+    for(int64_t i = 1; i <= 1000; i++)
+    {
+        ASSERT_EQ(db_update(table_id, i, new_value, len, &val_size, trx_id), 0);
+    }
+    size_t pool_size = undo_pool_size();
+    ASSERT_EQ(trx_abort(trx_id), trx_id);
+    ASSERT_GT(undo_pool_size(), pool_size);
+
+    for(int64_t i = 1; i <= 1000; i++)
+    {
+        ASSERT_EQ(db_find(table_id, i, value, &val_size, 0), 0);
+        ASSERT_EQ(value[0], 'A');
+    }
+
+    // next trx reuses the pooled chunks.
+    pool_size = undo_pool_size();
+    trx_id = trx_begin();
+    for(int64_t i = 1; i <= 1000; i++)
+    {
+        ASSERT_EQ(db_update(table_id, i, new_value, len, &val_size, trx_id), 0);
+    }
+    ASSERT_LT(undo_pool_size(), pool_size);
+
+    // committed undo images are kept until purge.
+    ASSERT_EQ(trx_commit(trx_id), trx_id);
+    ASSERT_EQ(undo_pool_size(), pool_size);
+    ASSERT_EQ(mvcc_num_versions(), 0);
+
+    ASSERT_EQ(db_find(table_id, 500, value, &val_size, 0), 0);
+    ASSERT_EQ(value[0], 'B');
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+struct latch_arg_t
+{
+    int64_t table_id;
+    pagenum_t page_num;
+    bool    done;
+};
+
+// get the page without a trx, as the other thread does.
+void* get_latched_page(void* arg)
+{
+    latch_arg_t* latch_arg = (latch_arg_t*)arg;
+    buffer_manager->get_block(latch_arg->table_id, latch_arg->page_num, 0);
+    latch_arg->done = true;
+    return nullptr;
+}
+
+TEST_F(ConcurrencyTest, PageLatchOwnerTest)
+{
+    char value[120] = "A record whose page is latched";
+    ASSERT_EQ(db_insert(table_id, 1, value, strlen(value)), 0);
+
+    // threads without a trx don't share the latch of a page.
+    latch_arg_t arg = {table_id, 0, false};
+    pthread_t thread;
+    {
+        auto header_bb = buffer_manager->get_block(table_id, 0, 0);
+
+        // the thread which holds it gets it again.
+        auto again_bb = buffer_manager->get_block(table_id, 0, 0);
+        ASSERT_EQ(again_bb.valid, true);
+
+        pthread_create(&thread, 0, get_latched_page, (void *)&arg);
+        sleep(1);
+        ASSERT_FALSE(arg.done) << "latch has been shared by threads";
+    }
+
+    pthread_join(thread, NULL);
+    ASSERT_TRUE(arg.done);
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, RedistributeLeavesTest)
+{
+    char value[120] = "The largest record can have 112 Bytes! So I am trying to test it work well even given longest record";
+    char ret_val[120];
+    uint16_t val_size;
+
+    // records of many sizes, in scattered order, so that leaves are often
+    // redistributed.
+    for(int64_t i = 0; i < 4000; i++)
+    {
+        int64_t key = i * 2731 % 4000;
+        ASSERT_EQ(db_insert(table_id, key, value, 50 + key % 63), 0);
+    }
+
+    std::vector<bool> deleted(4000, false);
+    for(int64_t i = 0; i < 3000; i++)
+    {
+        int64_t key = i * 1571 % 4000;
+        ASSERT_EQ(db_delete(table_id, key), 0);
+        deleted[key] = true;
+    }
+
+    // every record left is still reached from the root.
+    for(int64_t key = 0; key < 4000; key++)
+    {
+        int result = db_find(table_id, key, ret_val, &val_size, 0);
+        ASSERT_EQ(result, deleted[key] ? -1 : 0) << "wrong record at " << key;
+    }
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, FreePageListTest)
+{
+    char value[120] = "The largest record can have 112 Bytes! So I am trying to test it work well even given longest record";
+    char ret_val[120];
+    uint16_t val_size;
+
+    // pages are freed and allocated again while the root changes.
+    for(int round = 0; round < 3; round++)
+    {
+        for(int64_t i = 0; i < 2000; i++)
+        {
+            ASSERT_EQ(db_insert(table_id, i, value, strlen(value)), 0);
+        }
+        for(int64_t i = 0; i < 2000; i++)
+        {
+            if(round == 2 && i % 2) continue;
+            ASSERT_EQ(db_delete(table_id, i), 0);
+        }
+    }
+
+    // the buffered header keeps the free list and the number of pages
+    // of the file, so writing it back doesn't give a used page again.
+    {
+        page_t header_p, file_header_p;
+        auto header_bb = buffer_manager->get_block(table_id, 0, 0, &header_p);
+        file_read_page(table_id, 0, &file_header_p);
+        ASSERT_EQ(header_p.ui64_array[1], file_header_p.ui64_array[1]);
+        ASSERT_EQ(header_p.ui64_array[2], file_header_p.ui64_array[2]);
+    }
+
+    for(int64_t i = 0; i < 2000; i++)
+    {
+        int result = db_find(table_id, i, ret_val, &val_size, 0);
+        ASSERT_EQ(result, (i % 2) ? 0 : -1) << "wrong record at " << i;
+    }
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+struct page_wait_arg_t
+{
+    int64_t table_id;
+    pagenum_t page_num;
+    int hold_ms;
+    bool done;
+};
+
+// get the page, and keep it for a while.
+void* hold_page(void* arg)
+{
+    page_wait_arg_t* wait_arg = (page_wait_arg_t*)arg;
+    {
+        auto bb = buffer_manager->get_block(wait_arg->table_id,
+            wait_arg->page_num, 0);
+        usleep(wait_arg->hold_ms * 1000);
+    }
+    wait_arg->done = true;
+    return nullptr;
+}
+
+TEST_F(ConcurrencyTest, PageWaitersWakeTest)
+{
+    shutdown_db();
+    init_db(2);
+    table_id = open_table(pathname.c_str());
+    ASSERT_GE(table_id, 0);
+
+    // the woken thread may get the block first, so it is tried again.
+    bool woken = true;
+    for(int round = 0; round < 5 && woken; round++)
+    {
+        // threads wait for a page in the last block of the pool.
+        page_wait_arg_t args[3];
+        pthread_t threads[3];
+        {
+            auto first_bb = buffer_manager->get_block(table_id, 5, 0);
+            pagenum_t last_page;
+            {
+                auto second_bb = buffer_manager->get_block(table_id, 6, 0);
+                last_page =
+                    buffer_manager->buffer_list_head->list_next->page_num;
+            }
+            auto last_bb = buffer_manager->get_block(table_id, last_page, 0);
+            first_bb = BufferBlockPointer::unvalid_instance();
+
+            for(int i = 0; i < 2; i++)
+            {
+                args[i] = {table_id, last_page, 500, false};
+                pthread_create(&threads[i], 0, hold_page, (void *)&args[i]);
+            }
+            usleep(100 * 1000);
+        }
+
+        // the block gets another page as soon as it is released, and the
+        // woken thread gets its page into the other block. then a thread
+        // waits for the new page of the block, with the other one for the
+        // old page.
+        {
+            auto other_bb = buffer_manager->get_block(table_id, 7, 0);
+            args[2] = {table_id, 7, 0, false};
+            pthread_create(&threads[2], 0, hold_page, (void *)&args[2]);
+            usleep(100 * 1000);
+        }
+
+        // both of them are woken, although the one for the old page finds
+        // it in the other block.
+        usleep(800 * 1000);
+        woken = args[2].done;
+
+        // a thread left asleep is woken when the block is looked at.
+        buffer_manager->get_block(table_id, 8, 0);
+        for(int i = 0; i < 3; i++) pthread_join(threads[i], NULL);
+    }
+
+    ASSERT_TRUE(woken) << "a waiter of the block has been left asleep";
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+struct ingest_arg_t
+{
+    int64_t table_id;
+    int64_t first_key;
+    bool    commit;
+};
+
+void* ingest_records(void* arg)
+{
+    ingest_arg_t* ingest_arg = (ingest_arg_t*)arg;
+    char value[120];
+
+    int trx_id = trx_begin();
+    for(int64_t i = 0; i < RECORD_NUMBER; i++)
+    {
+        int64_t key = ingest_arg->first_key + i;
+        sprintf(value, "record #%ld ingested by a transaction", key);
+        if(db_insert(ingest_arg->table_id, key, value, strlen(value),
+            trx_id) != 0) return nullptr;
+    }
+
+    if(ingest_arg->commit) trx_commit(trx_id);
+    else trx_abort(trx_id);
+    return nullptr;
+}
+
+TEST_F(ConcurrencyTest, TransactionalInsertDeleteTest)
+{
+    char value[120] = "A record which is inserted or deleted by a trx";
+    uint16_t len = strlen(value), val_size;
+
+    for(int64_t i = 0; i < 1000; i += 2)
+    {
+        ASSERT_EQ(db_insert(table_id, i, value, len), 0);
+    }
+
+    // aborted inserts and deletes are undone.
+    int trx_id = trx_begin();
+    for(int64_t i = 0; i < 1000; i++)
+    {
+        if(i % 2) ASSERT_EQ(db_insert(table_id, i, value, len, trx_id), 0);
+        else ASSERT_EQ(db_delete(table_id, i, trx_id), 0);
+    }
+    ASSERT_EQ(db_find(table_id, 1, value, &val_size, trx_id), 0);
+    ASSERT_EQ(db_find(table_id, 2, value, &val_size, trx_id), -1);
+    ASSERT_EQ(trx_abort(trx_id), trx_id);
+
+    for(int64_t i = 0; i < 1000; i++)
+    {
+        int result = db_find(table_id, i, value, &val_size, 0);
+        ASSERT_EQ(result, (i % 2) ? -1 : 0) << "wrong record at " << i;
+    }
+
+    // snapshot taken before the delete keeps the deleted records.
+    int reader = trx_begin_read_only();
+    trx_id = trx_begin();
+    for(int64_t i = 100; i < 200; i += 2)
+    {
+        ASSERT_EQ(db_delete(table_id, i, trx_id), 0);
+    }
+    ASSERT_EQ(db_insert(table_id, 151, value, len, trx_id), 0);
+    ASSERT_NE(trx_commit(trx_id), 0);
+
+    ASSERT_EQ(db_find(table_id, 150, value, &val_size, 0), -1);
+    ASSERT_EQ(db_find(table_id, 150, value, &val_size, reader), 0);
+    ASSERT_EQ(db_find(table_id, 151, value, &val_size, reader), -1);
+
+    std::vector<int64_t> keys;
+    std::vector<char*> values;
+    std::vector<uint16_t> val_sizes;
+    ASSERT_EQ(db_scan(table_id, 90, 210, &keys, &values, &val_sizes,
+        reader), 0);
+    ASSERT_EQ(keys.size(), 61);
+    for(size_t i = 0; i < keys.size(); i++)
+    {
+        ASSERT_EQ(keys[i], 90 + 2 * (int64_t)i);
+        delete[] values[i];
+    }
+    trx_commit(reader);
+
+    // trxs insert in parallel, and only committed ones remain.
+    const int ingest_threads = 10;
+    pthread_t threads[ingest_threads];
+    ingest_arg_t args[ingest_threads];
+    for(int i = 0; i < ingest_threads; i++)
+    {
+        args[i] = {table_id, 10000 + (int64_t)i * RECORD_NUMBER, i % 2 == 0};
+        pthread_create(&threads[i], 0, ingest_records, &args[i]);
+    }
+    for(int i = 0; i < ingest_threads; i++)
+    {
+        pthread_join(threads[i], nullptr);
+    }
+
+    for(int i = 0; i < ingest_threads; i++)
+    {
+        for(int64_t key = args[i].first_key;
+            key < args[i].first_key + RECORD_NUMBER; key++)
+        {
+            int result = db_find(table_id, key, value, &val_size, 0);
+            ASSERT_EQ(result, args[i].commit ? 0 : -1) << "wrong record at " << key;
+        }
+    }
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+struct scan_arg_t
+{
+    int64_t table_id;
+    int trx_id;
+    std::vector<int64_t> keys;
+    volatile bool done;
+};
+
+void* scan_range(void* arg)
+{
+    scan_arg_t* scan_arg = (scan_arg_t*)arg;
+
+    std::vector<char*> values;
+    std::vector<uint16_t> val_sizes;
+    db_scan(scan_arg->table_id, 5, 15, &scan_arg->keys, &values, &val_sizes,
+        scan_arg->trx_id);
+    for(auto i : values) delete[] i;
+
+    scan_arg->done = true;
+    return nullptr;
+}
+
+TEST_F(ConcurrencyTest, DeleteRollbackPhantomTest)
+{
+    char value[120] = "A record whose delete is rolled back during a scan";
+    uint16_t len = strlen(value);
+
+    for(int64_t i = 2; i <= 20; i += 2)
+    {
+        ASSERT_EQ(db_insert(table_id, i, value, len), 0);
+    }
+
+    // the scan must not read the range without 10, since 10 comes back.
+    int deleter = trx_begin();
+    ASSERT_EQ(db_delete(table_id, 10, deleter), 0);
+
+    scan_arg_t scan_arg = {table_id, trx_begin(), {}, false};
+    pthread_t thread;
+    pthread_create(&thread, 0, scan_range, &scan_arg);
+
+    sleep(1);
+    EXPECT_FALSE(scan_arg.done) << "range has been read under a delete";
+
+    ASSERT_EQ(trx_abort(deleter), deleter);
+    pthread_join(thread, nullptr);
+
+    std::vector<int64_t> expected = {6, 8, 10, 12, 14};
+    ASSERT_EQ(scan_arg.keys, expected);
+
+    // the scan reads the same range again.
+    scan_arg.keys.clear();
+    scan_range(&scan_arg);
+    ASSERT_EQ(scan_arg.keys, expected);
+    ASSERT_NE(trx_commit(scan_arg.trx_id), 0);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, VariableSizeUpdateTest)
+{
+    char value[120], ret_val[120];
+    uint16_t val_size;
+
+    memset(value, 'A', sizeof(value));
+    for(int64_t i = 1; i <= 1000; i++)
+    {
+        ASSERT_EQ(db_insert(table_id, i, value, 50), 0);
+    }
+
+    // values grow and shrink in their leaves, and leaves which can't hold
+    // grown values are split.
+    memset(value, 'B', sizeof(value));
+    for(int64_t i = 1; i <= 1000; i++)
+    {
+        uint16_t new_size = (i % 2 == 0) ? 112 : 10;
+        ASSERT_EQ(db_update(table_id, i, value, new_size, &val_size, 0), 0);
+        ASSERT_EQ(val_size, 50);
+    }
+    for(int64_t i = 1; i <= 1000; i++)
+    {
+        ASSERT_EQ(db_find(table_id, i, ret_val, &val_size, 0), 0);
+        ASSERT_EQ(val_size, (i % 2 == 0) ? 112 : 10);
+        ASSERT_EQ(ret_val[val_size - 1], 'B');
+    }
+
+    // aborted trx restores the old sizes.
+    int trx_id = trx_begin();
+    memset(value, 'C', sizeof(value));
+    for(int64_t i = 1; i <= 1000; i++)
+    {
+        ASSERT_EQ(db_update(table_id, i, value, 30, &val_size, trx_id), 0);
+    }
+    ASSERT_EQ(trx_abort(trx_id), trx_id);
+    for(int64_t i = 1; i <= 1000; i++)
+    {
+        ASSERT_EQ(db_find(table_id, i, ret_val, &val_size, 0), 0);
+        ASSERT_EQ(val_size, (i % 2 == 0) ? 112 : 10);
+        ASSERT_EQ(ret_val[0], 'B');
+    }
+
+    // upsert updates existing records, and inserts the others.
+    trx_id = trx_begin();
+    memset(value, 'D', sizeof(value));
+    for(int64_t i = 501; i <= 1500; i++)
+    {
+        ASSERT_EQ(db_upsert(table_id, i, value, 100, trx_id), 0);
+    }
+    ASSERT_EQ(trx_commit(trx_id), trx_id);
+    for(int64_t i = 1; i <= 1500; i++)
+    {
+        ASSERT_EQ(db_find(table_id, i, ret_val, &val_size, 0), 0);
+        ASSERT_EQ(ret_val[0], (i <= 500) ? 'B' : 'D');
+        if(i > 500)
+        {
+            ASSERT_EQ(val_size, 100);
+        }
+    }
+
+    // aborted upsert deletes the inserted record, and restores the other.
+    trx_id = trx_begin();
+    ASSERT_EQ(db_upsert(table_id, 1, value, 60, trx_id), 0);
+    ASSERT_EQ(db_upsert(table_id, 2000, value, 60, trx_id), 0);
+    ASSERT_EQ(trx_abort(trx_id), trx_id);
+    ASSERT_EQ(db_find(table_id, 1, ret_val, &val_size, 0), 0);
+    ASSERT_EQ(val_size, 10);
+    ASSERT_EQ(db_find(table_id, 2000, ret_val, &val_size, 0), -1);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, BatchInsertTest)
+{
+    char value[120] = "A record inserted by a batch";
+    char ret_val[120];
+    uint16_t len = strlen(value), val_size;
+
+    // some keys exist already, and some appear twice in the batch.
+    for(int64_t i = 1; i <= 3000; i += 100)
+    {
+        ASSERT_EQ(db_insert(table_id, i, value, len), 0);
+    }
+
+    std::vector<int64_t> keys;
+    for(int64_t i = 1; i <= 3000; i++) keys.push_back(i);
+    for(int64_t i = 1; i <= 3000; i += 7) keys.push_back(i);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(34));
+
+    std::vector<const char*> values(keys.size(), value);
+    std::vector<uint16_t> val_sizes(keys.size(), len);
+    ASSERT_EQ(db_insert_batch(table_id, keys, values, val_sizes), 3000 - 30);
+
+    std::vector<int64_t> scan_keys;
+    std::vector<char*> scan_values;
+    std::vector<uint16_t> scan_sizes;
+    ASSERT_EQ(db_scan(table_id, 1, 3000, &scan_keys, &scan_values,
+        &scan_sizes), 0);
+    ASSERT_EQ(scan_keys.size(), 3000);
+    for(int i = 0; i < 3000; i++)
+    {
+        ASSERT_EQ(scan_keys[i], i + 1);
+        delete[] scan_values[i];
+    }
+
+    // records inserted by an aborted batch are deleted.
+    keys.clear();
+    for(int64_t i = 5000; i > 3000; i--) keys.push_back(i);
+    values.assign(keys.size(), value);
+    val_sizes.assign(keys.size(), len);
+
+    int trx_id = trx_begin();
+    ASSERT_EQ(db_insert_batch(table_id, keys, values, val_sizes, trx_id), 2000);
+    ASSERT_EQ(trx_abort(trx_id), trx_id);
+    for(int64_t i = 3001; i <= 5000; i++)
+    {
+        ASSERT_EQ(db_find(table_id, i, ret_val, &val_size, 0), -1);
+    }
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+struct bulk_arg_t
+{
+    int64_t next_key;
+    int64_t last_key;
+    char value[120];
+};
+
+bool next_bulk_record(void* arg, int64_t* key, const char** value,
+    uint16_t* val_size)
+{
+    auto bulk_arg = (bulk_arg_t*)arg;
+    if(bulk_arg->next_key > bulk_arg->last_key) return false;
+
+    *key = bulk_arg->next_key;
+    sprintf(bulk_arg->value, "bulk loaded record #%ld", *key);
+    *value = bulk_arg->value;
+    *val_size = strlen(bulk_arg->value);
+
+    bulk_arg->next_key += 2;
+    return true;
+}
+
+TEST_F(ConcurrencyTest, BulkLoadTest)
+{
+    char ret_val[120], expected[120];
+    uint16_t val_size;
+
+    bulk_arg_t arg;
+    arg.next_key = 2;
+    arg.last_key = 20000;
+    ASSERT_EQ(db_bulk_load(table_id, next_bulk_record, &arg, 0.8), 10000);
+
+    // only an empty table is loaded.
+    arg.next_key = 2;
+    ASSERT_EQ(db_bulk_load(table_id, next_bulk_record, &arg), -1);
+
+    std::vector<int64_t> keys;
+    std::vector<char*> values;
+    std::vector<uint16_t> val_sizes;
+    ASSERT_EQ(db_scan(table_id, 1, 20000, &keys, &values, &val_sizes), 0);
+    ASSERT_EQ(keys.size(), 10000);
+    for(int i = 0; i < 10000; i++)
+    {
+        ASSERT_EQ(keys[i], 2 * (i + 1));
+        delete[] values[i];
+    }
+
+    // the loaded tree is split and merged as usual.
+    for(int64_t i = 1; i <= 20000; i += 2)
+    {
+        sprintf(expected, "inserted record #%ld", i);
+        ASSERT_EQ(db_insert(table_id, i, expected, strlen(expected)), 0);
+    }
+    for(int64_t i = 2; i <= 20000; i += 4)
+    {
+        ASSERT_EQ(db_delete(table_id, i), 0);
+    }
+    for(int64_t i = 1; i <= 20000; i++)
+    {
+        int result = db_find(table_id, i, ret_val, &val_size, 0);
+        if(i % 4 == 2)
+        {
+            ASSERT_EQ(result, -1);
+            continue;
+        }
+
+        ASSERT_EQ(result, 0);
+        sprintf(expected, (i % 2 == 1) ? "inserted record #%ld"
+            : "bulk loaded record #%ld", i);
+        ASSERT_EQ(std::string(ret_val, val_size), expected);
+    }
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, MultiGetTest)
+{
+    char value[120];
+
+    for(int64_t i = 2; i <= 6000; i += 2)
+    {
+        sprintf(value, "record #%ld", i);
+        ASSERT_EQ(db_insert(table_id, i, value, strlen(value)), 0);
+    }
+
+    // half of keys don't exist, and some are looked up twice.
+    std::vector<int64_t> keys;
+    for(int64_t i = 1; i <= 6000; i += 3) keys.push_back(i);
+    keys.push_back(3000);
+    keys.push_back(3000);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(36));
+
+    std::vector<char> values(keys.size() * 20);
+    std::vector<int> offsets;
+    std::vector<uint16_t> val_sizes;
+    int num_found = db_find_many(table_id, keys, values.data(), values.size(),
+        &offsets, &val_sizes, 0, true);
+
+    int expected_found = 0;
+    for(size_t i = 0; i < keys.size(); i++)
+    {
+        if(keys[i] % 2 == 1)
+        {
+            ASSERT_EQ(offsets[i], -1) << "key " << keys[i];
+            continue;
+        }
+
+        sprintf(value, "record #%ld", keys[i]);
+        ASSERT_NE(offsets[i], -1) << "key " << keys[i];
+        ASSERT_EQ(std::string(values.data() + offsets[i], val_sizes[i]), value);
+        expected_found++;
+    }
+    ASSERT_EQ(num_found, expected_found);
+
+    // values which don't fit in the buffer are not returned.
+    ASSERT_EQ(db_find_many(table_id, keys, values.data(), 100,
+        &offsets, &val_sizes), -1);
+
+    // read-only trx reads records deleted after its snapshot.
+    int trx_id = trx_begin_read_only();
+    int writer_id = trx_begin();
+    for(int64_t i = 2; i <= 6000; i += 4)
+    {
+        ASSERT_EQ(db_delete(table_id, i, writer_id), 0);
+    }
+    ASSERT_EQ(trx_commit(writer_id), writer_id);
+    ASSERT_EQ(db_find_many(table_id, keys, values.data(), values.size(),
+        &offsets, &val_sizes, trx_id), num_found);
+    ASSERT_EQ(trx_commit(trx_id), trx_id);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, ScanCursorTest)
+{
+    char value[120];
+
+    for(int64_t i = 1; i <= 3000; i++)
+    {
+        sprintf(value, "record #%ld", i);
+        ASSERT_EQ(db_insert(table_id, i, value, strlen(value)), 0);
+    }
+
+    int64_t key;
+    const char* cursor_value;
+    uint16_t val_size;
+
+    // records are given in order, read in place from the leaves.
+    int64_t expected_key = 100;
+    ScanCursor* cursor = db_scan_open(table_id, 100, 2500);
+    while(db_scan_next(cursor, &key, &cursor_value, &val_size) == 0)
+    {
+        sprintf(value, "record #%ld", expected_key);
+        ASSERT_EQ(key, expected_key);
+        ASSERT_EQ(std::string(cursor_value, val_size), value);
+        expected_key++;
+    }
+    ASSERT_EQ(db_scan_next(cursor, &key, &cursor_value, &val_size), 1);
+    db_scan_close(cursor);
+    ASSERT_EQ(expected_key, 2501);
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+
+    // read-only trx sees the records deleted after its snapshot.
+    int reader_id = trx_begin_read_only();
+    int writer_id = trx_begin();
+    for(int64_t i = 1; i <= 3000; i += 2)
+    {
+        ASSERT_EQ(db_delete(table_id, i, writer_id), 0);
+    }
+    ASSERT_EQ(trx_commit(writer_id), writer_id);
+
+    int num_found = 0;
+    cursor = db_scan_open(table_id, 0, 4000, reader_id);
+    while(db_scan_next(cursor, &key, &cursor_value, &val_size) == 0)
+    {
+        ASSERT_EQ(key, ++num_found);
+    }
+    db_scan_close(cursor);
+    ASSERT_EQ(num_found, 3000);
+    ASSERT_EQ(trx_commit(reader_id), reader_id);
+
+    // with a trx, the records are read under next-key locks.
+    int trx_id = trx_begin();
+    num_found = 0;
+    cursor = db_scan_open(table_id, 1000, 2000, trx_id);
+    while(db_scan_next(cursor, &key, &cursor_value, &val_size) == 0)
+    {
+        ASSERT_EQ(key % 2, 0);
+        num_found++;
+    }
+    db_scan_close(cursor);
+    ASSERT_EQ(num_found, 501);
+    ASSERT_EQ(trx_commit(trx_id), trx_id);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, DescendingScanTest)
+{
+    char value[120];
+
+    for(int64_t i = 1; i <= 3000; i++)
+    {
+        sprintf(value, "record #%ld", i);
+        ASSERT_EQ(db_insert(table_id, i, value, strlen(value)), 0);
+    }
+
+    // leaves are merged, so the left-sibling links are changed too.
+    for(int64_t i = 1; i <= 3000; i++)
+    {
+        if(i % 3 != 0)
+        {
+            ASSERT_EQ(db_delete(table_id, i), 0);
+        }
+    }
+
+    int64_t key;
+    const char* cursor_value;
+    uint16_t val_size;
+
+    // the latest records are read without scanning the range.
+    ScanCursor* cursor = db_scan_open(table_id, 0, 2000, 0, true);
+    for(int64_t i = 1998; i > 1998 - 30; i -= 3)
+    {
+        sprintf(value, "record #%ld", i);
+        ASSERT_EQ(db_scan_next(cursor, &key, &cursor_value, &val_size), 0);
+        ASSERT_EQ(key, i);
+        ASSERT_EQ(std::string(cursor_value, val_size), value);
+    }
+    db_scan_close(cursor);
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+
+    int64_t expected_key = 3000;
+    cursor = db_scan_open(table_id, 10, 4000, 0, true);
+    while(db_scan_next(cursor, &key, &cursor_value, &val_size) == 0)
+    {
+        ASSERT_EQ(key, expected_key);
+        expected_key -= 3;
+    }
+    db_scan_close(cursor);
+    ASSERT_EQ(expected_key, 9);
+
+    // read-only trx sees the records deleted after its snapshot.
+    int reader_id = trx_begin_read_only();
+    int writer_id = trx_begin();
+    for(int64_t i = 3; i <= 3000; i += 6)
+    {
+        ASSERT_EQ(db_delete(table_id, i, writer_id), 0);
+    }
+    ASSERT_EQ(trx_commit(writer_id), writer_id);
+
+    expected_key = 3000;
+    cursor = db_scan_open(table_id, 0, 3000, reader_id, true);
+    while(db_scan_next(cursor, &key, &cursor_value, &val_size) == 0)
+    {
+        ASSERT_EQ(key, expected_key);
+        expected_key -= 3;
+    }
+    db_scan_close(cursor);
+    ASSERT_EQ(expected_key, 0);
+    ASSERT_EQ(trx_commit(reader_id), reader_id);
+
+    // with a trx, the records are read under next-key locks.
+    int trx_id = trx_begin();
+    expected_key = 1998;
+    cursor = db_scan_open(table_id, 1000, 2000, trx_id, true);
+    while(db_scan_next(cursor, &key, &cursor_value, &val_size) == 0)
+    {
+        ASSERT_EQ(key, expected_key);
+        expected_key -= 6;
+    }
+    db_scan_close(cursor);
+    ASSERT_EQ(expected_key, 996);
+    ASSERT_EQ(trx_commit(trx_id), trx_id);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, AggregateTest)
+{
+    for(int64_t i = 1; i <= 2000; i++)
+    {
+        int64_t number = i * 10;
+        ASSERT_EQ(db_insert(table_id, i * 2, (char*)&number, sizeof(number)),
+            0);
+    }
+
+    int64_t result;
+    ASSERT_EQ(db_count(table_id, 101, 300, &result), 0);
+    ASSERT_EQ(result, 100);
+    ASSERT_EQ(db_count(table_id, 5000, 6000, &result), 0);
+    ASSERT_EQ(result, 0);
+
+    // keys 2, 4, ..., 20 have values 10, 20, ..., 100.
+    ASSERT_EQ(db_sum(table_id, 0, 20, &result), 0);
+    ASSERT_EQ(result, 550);
+
+    ASSERT_EQ(db_min_key(table_id, 1001, 3000, &result), 0);
+    ASSERT_EQ(result, 1002);
+    ASSERT_EQ(db_max_key(table_id, INT64_MIN, 1001, &result), 0);
+    ASSERT_EQ(result, 1000);
+    ASSERT_EQ(db_max_key(table_id, 4001, 5000, &result), -1);
+
+    // read-only trx counts the records deleted after its snapshot.
+    int reader_id = trx_begin_read_only();
+    int writer_id = trx_begin();
+    for(int64_t i = 2; i <= 4000; i += 4)
+    {
+        ASSERT_EQ(db_delete(table_id, i, writer_id), 0);
+    }
+    ASSERT_EQ(trx_commit(writer_id), writer_id);
+
+    ASSERT_EQ(db_count(table_id, 1, 4000, &result, reader_id), 0);
+    ASSERT_EQ(result, 2000);
+    ASSERT_EQ(trx_commit(reader_id), reader_id);
+    ASSERT_EQ(db_count(table_id, 1, 4000, &result), 0);
+    ASSERT_EQ(result, 1000);
+
+    // values which are not 8 bytes long can't be summed.
+    ASSERT_EQ(db_insert(table_id, 4001, "text", 4), 0);
+    ASSERT_EQ(db_sum(table_id, 1, 5000, &result), -1);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, LargeValueTest)
+{
+    // values from just over the inline limit to most of the maximum size.
+    auto value_of = [](int64_t key, int size)
+    {
+        std::vector<char> value(size);
+        for(int i = 0; i < size; i++) value[i] = (char)(key * 31 + i * 7);
+        return value;
+    };
+    auto size_of = [](int64_t key) { return 993 + (key * 1637) % 64000; };
+
+    for(int64_t i = 1; i <= 40; i++)
+    {
+        auto value = value_of(i, size_of(i));
+        ASSERT_EQ(db_insert(table_id, i, value.data(), value.size()), 0);
+    }
+
+    std::vector<char> ret_val(65535);
+    uint16_t val_size;
+    for(int64_t i = 1; i <= 40; i++)
+    {
+        ASSERT_EQ(db_find(table_id, i, ret_val.data(), &val_size, 0), 0);
+        ASSERT_EQ(val_size, size_of(i));
+        ASSERT_EQ(memcmp(ret_val.data(), value_of(i, val_size).data(),
+            val_size), 0);
+    }
+
+    // a part of the value is read from the pages which hold it.
+    uint16_t read_size;
+    int size = size_of(17);
+    auto value = value_of(17, size);
+    ASSERT_EQ(db_read_value(table_id, 17, size / 2, ret_val.data(), 5000,
+        &read_size), 0);
+    ASSERT_EQ(read_size, std::min(5000, size - size / 2));
+    ASSERT_EQ(memcmp(ret_val.data(), value.data() + size / 2, read_size), 0);
+    ASSERT_EQ(db_read_value(table_id, 17, size - 10, ret_val.data(), 100,
+        &read_size), 0);
+    ASSERT_EQ(read_size, 10);
+
+    // read-only trx reads the part from its version, one record after another.
+    int reader = trx_begin_read_only();
+    for(int64_t i = 16; i <= 18; i++)
+    {
+        ASSERT_EQ(db_read_value(table_id, i, 100, ret_val.data(), 50,
+            &read_size, reader), 0);
+        ASSERT_EQ(read_size, 50);
+        ASSERT_EQ(memcmp(ret_val.data(),
+            value_of(i, size_of(i)).data() + 100, read_size), 0);
+    }
+    ASSERT_NE(trx_commit(reader), 0);
+
+    ScanCursor* cursor = db_scan_open(table_id, 1, 40);
+    int64_t key, expected_key = 1;
+    const char* cursor_value;
+    while(db_scan_next(cursor, &key, &cursor_value, &val_size) == 0)
+    {
+        ASSERT_EQ(key, expected_key);
+        ASSERT_EQ(val_size, size_of(key));
+        ASSERT_EQ(memcmp(cursor_value, value_of(key, val_size).data(),
+            val_size), 0);
+        expected_key++;
+    }
+    db_scan_close(cursor);
+    ASSERT_EQ(expected_key, 41);
+
+    // the value may move into the leaf, and out of it again.
+    uint16_t old_val_size;
+    ASSERT_EQ(db_update(table_id, 5, (char*)"small", 5, &old_val_size, 0), 0);
+    ASSERT_EQ(old_val_size, size_of(5));
+    ASSERT_EQ(db_find(table_id, 5, ret_val.data(), &val_size, 0), 0);
+    ASSERT_EQ(val_size, 5);
+    value = value_of(6, 30000);
+    ASSERT_EQ(db_update(table_id, 5, value.data(), 30000, &old_val_size, 0), 0);
+    ASSERT_EQ(db_find(table_id, 5, ret_val.data(), &val_size, 0), 0);
+    ASSERT_EQ(val_size, 30000);
+    ASSERT_EQ(memcmp(ret_val.data(), value.data(), val_size), 0);
+
+    // rollback writes the whole old values back.
+    int trx_id = trx_begin();
+    ASSERT_EQ(db_update(table_id, 7, (char*)"small", 5, &old_val_size, trx_id),
+        0);
+    ASSERT_EQ(db_delete(table_id, 8, trx_id), 0);
+    trx_abort(trx_id);
+    for(int64_t i = 7; i <= 8; i++)
+    {
+        ASSERT_EQ(db_find(table_id, i, ret_val.data(), &val_size, 0), 0);
+        ASSERT_EQ(val_size, size_of(i));
+        ASSERT_EQ(memcmp(ret_val.data(), value_of(i, val_size).data(),
+            val_size), 0);
+    }
+
+    // the pages of deleted values are used again.
+    for(int64_t i = 1; i <= 40; i++) ASSERT_EQ(db_delete(table_id, i), 0);
+    for(int64_t i = 1; i <= 40; i++)
+    {
+        auto value = value_of(i, size_of(i));
+        ASSERT_EQ(db_insert(table_id, i, value.data(), value.size()), 0);
+    }
+    ASSERT_EQ(db_find(table_id, 40, ret_val.data(), &val_size, 0), 0);
+    ASSERT_EQ(memcmp(ret_val.data(), value_of(40, size_of(40)).data(),
+        val_size), 0);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, DeltaLeafTest)
+{
+    ASSERT_EQ(db_set_delta_leaves(table_id, true), 0);
+
+    // keys close to each other, and keys far from all of the others,
+    // which make their leaves plain or split them apart.
+    std::vector<int64_t> keys;
+    for(int64_t i = 1; i <= 3000; i++) keys.push_back(i);
+    for(int64_t i = -20; i <= 20; i++) keys.push_back(i * (1LL << 40) + 7);
+    keys.push_back(INT64_MIN);
+    keys.push_back(INT64_MAX);
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    std::mt19937 gen(42);
+    std::vector<int64_t> order = keys;
+    std::shuffle(order.begin(), order.end(), gen);
+
+    char value[32];
+    for(int64_t key : order)
+    {
+        int size = sprintf(value, "value %ld", (long)key);
+        ASSERT_EQ(db_insert(table_id, key, value, size), 0);
+    }
+
+    // half of the records are deleted, so that leaves are merged.
+    std::vector<int64_t> remaining;
+    for(size_t i = 0; i < keys.size(); i++)
+    {
+        if(i % 2) ASSERT_EQ(db_delete(table_id, keys[i]), 0);
+        else remaining.push_back(keys[i]);
+    }
+
+    char ret_val[120];
+    uint16_t val_size;
+    for(size_t i = 0; i < keys.size(); i++)
+    {
+        ASSERT_EQ(db_find(table_id, keys[i], ret_val, &val_size, 0),
+            (i % 2) ? -1 : 0);
+        if(i % 2) continue;
+        int size = sprintf(value, "value %ld", (long)keys[i]);
+        ASSERT_EQ(val_size, size);
+        ASSERT_EQ(memcmp(ret_val, value, size), 0);
+    }
+
+    ScanCursor* cursor = db_scan_open(table_id, INT64_MIN, INT64_MAX);
+    int64_t key;
+    const char* cursor_value;
+    size_t index = 0;
+    while(db_scan_next(cursor, &key, &cursor_value, &val_size) == 0)
+    {
+        ASSERT_LT(index, remaining.size());
+        ASSERT_EQ(key, remaining[index++]);
+    }
+    db_scan_close(cursor);
+    ASSERT_EQ(index, remaining.size());
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, ByteKeyTest)
+{
+    // composite keys of a name and a number. names share their first
+    // bytes, which the tree of keys compares as a whole.
+    auto key_of = [](const std::string& name, int64_t number)
+    {
+        std::string key;
+        key_encode_bytes(&key, name.data(), name.size());
+        key_encode_int64(&key, number);
+        return key;
+    };
+
+    std::vector<std::pair<std::string, int64_t>> columns;
+    for(int i = 0; i < 300; i++)
+    {
+        columns.emplace_back("customer-" + std::to_string(i % 30),
+            (int64_t)(i / 30) - 5);
+    }
+    columns.emplace_back("", 0);
+    columns.emplace_back(std::string("cust\0omer", 9), 1);
+    columns.emplace_back("customer", INT64_MIN);
+    columns.emplace_back("zzz", INT64_MAX);
+
+    std::mt19937 gen(7);
+    std::shuffle(columns.begin(), columns.end(), gen);
+
+    for(auto& [name, number] : columns)
+    {
+        auto key = key_of(name, number);
+        auto value = name + ":" + std::to_string(number);
+        ASSERT_EQ(db_insert_key(table_id, key.data(), key.size(),
+            value.data(), value.size()), 0);
+    }
+    auto key = key_of("customer-3", 2);
+    ASSERT_EQ(db_insert_key(table_id, key.data(), key.size(), "dup", 3), -1);
+
+    char ret_val[120];
+    uint16_t val_size;
+    ASSERT_EQ(db_find_key(table_id, key.data(), key.size(), ret_val,
+        &val_size), 0);
+    ASSERT_EQ(std::string(ret_val, val_size), "customer-3:2");
+    key = key_of("customer-3", 7);
+    ASSERT_EQ(db_find_key(table_id, key.data(), key.size(), ret_val,
+        &val_size), -1);
+
+    // encoded keys are ordered as their columns are.
+    std::sort(columns.begin(), columns.end());
+    std::vector<std::string> keys;
+    std::vector<char*> values;
+    std::vector<uint16_t> val_sizes;
+    auto begin = key_of("", INT64_MIN), end = key_of("zzzz", 0);
+    ASSERT_EQ(db_scan_keys(table_id, begin.data(), begin.size(), end.data(),
+        end.size(), &keys, &values, &val_sizes), 0);
+    ASSERT_EQ(keys.size(), columns.size());
+    for(size_t i = 0; i < keys.size(); i++)
+    {
+        ASSERT_EQ(keys[i], key_of(columns[i].first, columns[i].second));
+        delete[] values[i];
+    }
+
+    // a range within a bucket.
+    keys.clear(), values.clear(), val_sizes.clear();
+    begin = key_of("customer-1", 0), end = key_of("customer-1", 3);
+    ASSERT_EQ(db_scan_keys(table_id, begin.data(), begin.size(), end.data(),
+        end.size(), &keys, &values, &val_sizes), 0);
+    ASSERT_EQ(keys.size(), 4);
+    for(auto value : values) delete[] value;
+
+    // deleted keys come back when the trx is aborted.
+    int trx_id = trx_begin();
+    key = key_of("customer-5", 0);
+    ASSERT_EQ(db_delete_key(table_id, key.data(), key.size(), trx_id), 0);
+    ASSERT_EQ(db_find_key(table_id, key.data(), key.size(), ret_val,
+        &val_size, trx_id), -1);
+    trx_abort(trx_id);
+    ASSERT_EQ(db_find_key(table_id, key.data(), key.size(), ret_val,
+        &val_size), 0);
+
+    for(auto& [name, number] : columns)
+    {
+        auto key = key_of(name, number);
+        ASSERT_EQ(db_delete_key(table_id, key.data(), key.size()), 0);
+    }
+    keys.clear(), values.clear(), val_sizes.clear();
+    begin = key_of("", INT64_MIN);
+    ASSERT_EQ(db_scan_keys(table_id, begin.data(), begin.size(), end.data(),
+        end.size(), &keys, &values, &val_sizes), 0);
+    ASSERT_EQ(keys.size(), 0);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, ByteKeyTreeTest)
+{
+    // long keys sharing their first bytes split the tree into many levels.
+    auto key_of = [](int64_t number)
+    {
+        std::string key(200, 'k');
+        key_encode_int64(&key, number);
+        return key;
+    };
+
+    std::vector<int64_t> numbers;
+    for(int64_t i = 0; i < 3000; i++) numbers.push_back(i * 7 % 3000);
+    for(int64_t number : numbers)
+    {
+        auto key = key_of(number);
+        auto value = std::to_string(number);
+        ASSERT_EQ(db_insert_key(table_id, key.data(), key.size(),
+            value.data(), value.size()), 0);
+    }
+
+    char ret_val[120];
+    uint16_t val_size;
+    for(int64_t number = 0; number < 3001; number++)
+    {
+        auto key = key_of(number);
+        int result = db_find_key(table_id, key.data(), key.size(), ret_val,
+            &val_size);
+        if(number == 3000) ASSERT_EQ(result, -1);
+        else
+        {
+            ASSERT_EQ(result, 0);
+            ASSERT_EQ(std::string(ret_val, val_size), std::to_string(number));
+        }
+    }
+
+    std::vector<std::string> keys;
+    std::vector<char*> values;
+    std::vector<uint16_t> val_sizes;
+    auto begin = key_of(1000), end = key_of(1999);
+    ASSERT_EQ(db_scan_keys(table_id, begin.data(), begin.size(), end.data(),
+        end.size(), &keys, &values, &val_sizes), 0);
+    ASSERT_EQ(keys.size(), 1000);
+    for(size_t i = 0; i < keys.size(); i++)
+    {
+        ASSERT_EQ(keys[i], key_of(1000 + i));
+        delete[] values[i];
+    }
+
+    // a deleted key can be inserted again.
+    auto key = key_of(5);
+    ASSERT_EQ(db_delete_key(table_id, key.data(), key.size()), 0);
+    ASSERT_EQ(db_find_key(table_id, key.data(), key.size(), ret_val,
+        &val_size), -1);
+    ASSERT_EQ(db_insert_key(table_id, key.data(), key.size(), "again", 5), 0);
+    ASSERT_EQ(db_find_key(table_id, key.data(), key.size(), ret_val,
+        &val_size), 0);
+    ASSERT_EQ(std::string(ret_val, val_size), "again");
+
+    std::string long_key(KEY_MAX_SIZE + 1, 'k');
+    ASSERT_EQ(db_insert_key(table_id, long_key.data(), long_key.size(),
+        "long", 4), -1);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+struct key_insert_arg_t
+{
+    int64_t table_id;
+    std::string key;
+    int result;
+    std::atomic<bool> done;
+};
+
+void* insert_key_in_trx(void* arg)
+{
+    key_insert_arg_t* insert = (key_insert_arg_t*)arg;
+    int trx_id = trx_begin();
+    insert->result = db_insert_key(insert->table_id, insert->key.data(),
+        insert->key.size(), "second", 6, trx_id);
+    trx_commit(trx_id);
+    insert->done = true;
+    return nullptr;
+}
+
+TEST_F(ConcurrencyTest, ByteKeyLockWaitTest)
+{
+    std::string first, second, third;
+    key_encode_bytes(&first, "first", 5);
+    key_encode_bytes(&second, "second", 6);
+    key_encode_bytes(&third, "third", 5);
+    ASSERT_EQ(db_insert_key(table_id, first.data(), first.size(), "1", 1), 0);
+    ASSERT_EQ(db_insert_key(table_id, second.data(), second.size(), "2", 1),
+        0);
+
+    int trx_id = trx_begin();
+    ASSERT_EQ(db_delete_key(table_id, first.data(), first.size(), trx_id), 0);
+
+    // the insert waits for the lock of the deleting trx without any latch,
+    // so other keys are read and inserted meanwhile.
+    key_insert_arg_t insert;
+    insert.table_id = table_id;
+    insert.key = first;
+    insert.done = false;
+    pthread_t thread;
+    pthread_create(&thread, 0, insert_key_in_trx, &insert);
+    usleep(100 * 1000);
+    ASSERT_EQ(insert.done.load(), false);
+
+    char ret_val[120];
+    uint16_t val_size;
+    ASSERT_EQ(db_find_key(table_id, second.data(), second.size(), ret_val,
+        &val_size), 0);
+    ASSERT_EQ(db_insert_key(table_id, third.data(), third.size(), "3", 1), 0);
+    ASSERT_EQ(insert.done.load(), false);
+
+    trx_commit(trx_id);
+    pthread_join(thread, nullptr);
+    ASSERT_EQ(insert.result, 0);
+    ASSERT_EQ(db_find_key(table_id, first.data(), first.size(), ret_val,
+        &val_size), 0);
+    ASSERT_EQ(std::string(ret_val, val_size), "second");
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, ByteKeyScanPhantomTest)
+{
+    std::string b, bb, c, d, z;
+    key_encode_bytes(&b, "b", 1);
+    key_encode_bytes(&bb, "bb", 2);
+    key_encode_bytes(&c, "c", 1);
+    key_encode_bytes(&d, "d", 1);
+    key_encode_bytes(&z, "z", 1);
+    ASSERT_EQ(db_insert_key(table_id, b.data(), b.size(), "b", 1), 0);
+    ASSERT_EQ(db_insert_key(table_id, d.data(), d.size(), "d", 1), 0);
+
+    std::vector<std::string> keys;
+    std::vector<char*> values;
+    std::vector<uint16_t> val_sizes;
+    int trx_id = trx_begin();
+    ASSERT_EQ(db_scan_keys(table_id, b.data(), b.size(), c.data(), c.size(),
+        &keys, &values, &val_sizes, trx_id), 0);
+    ASSERT_EQ(keys, std::vector<std::string>({b}));
+    for(auto value : values) delete[] value;
+
+    // a key can't go into the range until the scanning trx ends.
+    key_insert_arg_t insert;
+    insert.table_id = table_id;
+    insert.key = bb;
+    insert.done = false;
+    pthread_t thread;
+    pthread_create(&thread, 0, insert_key_in_trx, &insert);
+    sleep(1);
+    EXPECT_FALSE(insert.done.load()) << "key has been inserted into the range";
+
+    // the gaps after the next key are not locked.
+    ASSERT_EQ(db_insert_key(table_id, z.data(), z.size(), "z", 1), 0);
+
+    keys.clear(), values.clear(), val_sizes.clear();
+    ASSERT_EQ(db_scan_keys(table_id, b.data(), b.size(), c.data(), c.size(),
+        &keys, &values, &val_sizes, trx_id), 0);
+    ASSERT_EQ(keys, std::vector<std::string>({b}));
+    for(auto value : values) delete[] value;
+
+    ASSERT_NE(trx_commit(trx_id), 0);
+    pthread_join(thread, nullptr);
+    ASSERT_EQ(insert.result, 0);
+
+    keys.clear(), values.clear(), val_sizes.clear();
+    ASSERT_EQ(db_scan_keys(table_id, b.data(), b.size(), c.data(), c.size(),
+        &keys, &values, &val_sizes), 0);
+    ASSERT_EQ(keys, std::vector<std::string>({b, bb}));
+    for(auto value : values) delete[] value;
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, ByteKeyChurnTest)
+{
+    // every round inserts and deletes keys which have never been used.
+    auto key_of = [](int64_t number)
+    {
+        std::string key(200, 'k');
+        key_encode_int64(&key, number);
+        return key;
+    };
+
+    uint64_t num_pages = 0;
+    for(int64_t round = 0; round < 5; round++)
+    {
+        for(int64_t i = 0; i < 1000; i++)
+        {
+            auto key = key_of(round * 1000 + i);
+            ASSERT_EQ(db_insert_key(table_id, key.data(), key.size(),
+                "churn", 5), 0);
+        }
+        for(int64_t i = 0; i < 1000; i++)
+        {
+            auto key = key_of(round * 1000 + i);
+            ASSERT_EQ(db_delete_key(table_id, key.data(), key.size()), 0);
+        }
+
+        // keys without records are taken out of the tree, so the pages
+        // they took are used again by the next round.
+        page_t header_p;
+        {
+            auto header_bb = buffer_manager->get_block(table_id, 0, 0,
+                &header_p);
+        }
+        ASSERT_EQ(header_p.ui64_array[KEY_TREE_HEADER_SLOT], 0);
+        if(round == 0) num_pages = header_p.ui64_array[2];
+        ASSERT_EQ(header_p.ui64_array[2], num_pages) << "file grows";
+    }
+
+    // a key deleted in a trx stays until the trx ends, since it comes
+    // back on rollback.
+    auto key = key_of(-1);
+    ASSERT_EQ(db_insert_key(table_id, key.data(), key.size(), "trx", 3), 0);
+    int trx_id = trx_begin();
+    ASSERT_EQ(db_delete_key(table_id, key.data(), key.size(), trx_id), 0);
+    ASSERT_EQ(trx_abort(trx_id), trx_id);
+
+    char ret_val[120];
+    uint16_t val_size;
+    ASSERT_EQ(db_find_key(table_id, key.data(), key.size(), ret_val,
+        &val_size), 0);
+    ASSERT_EQ(std::string(ret_val, val_size), "trx");
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, LatchedPathTest)
+{
+    for(int64_t key = 0; key < 2000; key++)
+    {
+        ASSERT_EQ(db_insert(table_id, key, "value", 5), 0);
+    }
+
+    // the pages above the leaf stay latched while the path lives, and only
+    // the outermost path of a thread keeps them.
+    {
+        page_t header_p;
+        auto header_bb = buffer_manager->get_block(table_id, 0, 0, &header_p);
+        LatchedPath path;
+        {
+            LatchedPath inner;
+            ASSERT_EQ(inner.pages, nullptr);
+        }
+
+        BufferBlockPointer leaf_bb = find_leaf(table_id,
+            header_p.ui64_array[3], 1000, 0);
+        ASSERT_EQ(leaf_bb.valid, true);
+        ASSERT_GE(path.pages->size(), 1);
+        ASSERT_EQ(path.pages->front().page_num, header_p.ui64_array[3]);
+    }
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, StaleRootTest)
+{
+    ASSERT_EQ(db_insert(table_id, 0, "value", 5), 0);
+
+    page_t header_p;
+    buffer_manager->get_block(table_id, 0, 0, &header_p);
+    pagenum_t old_root = header_p.ui64_array[3];
+
+    // the root, read before, is split.
+    int64_t key = 1;
+    for(; header_p.ui64_array[3] == old_root; key++)
+    {
+        ASSERT_EQ(db_insert(table_id, key, "value", 5), 0);
+        buffer_manager->get_block(table_id, 0, 0, &header_p);
+    }
+
+    // a reader starting from the old root still finds the keys which have
+    // gone to the new right half.
+    {
+        BufferBlockPointer leaf_bb = find_leaf(table_id, old_root, key - 1, 0);
+        ASSERT_EQ(leaf_bb.valid, true);
+        page_t leaf_p;
+        buffer_manager->get_page(leaf_bb, leaf_p);
+        ASSERT_GE(leaf_find(leaf_p, key - 1), 0);
+    }
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+struct latch_order_arg_t
+{
+    int64_t table_id;
+    int thread_id;
+};
+
+// readers hold a parent while they wait for its child.
+void* find_records(void* arg)
+{
+    latch_order_arg_t* order = (latch_order_arg_t*)arg;
+    std::mt19937 gen(order->thread_id);
+    char ret_val[120];
+    uint16_t val_size;
+    for(int i = 0; i < 20000; i++)
+    {
+        db_find(order->table_id, gen() % 4000, ret_val, &val_size, 0);
+    }
+    return nullptr;
+}
+
+// writers split and merge leaves, for which their parents are latched.
+void* insert_and_delete_records(void* arg)
+{
+    latch_order_arg_t* order = (latch_order_arg_t*)arg;
+    char value[100] = "a value which is long enough to split leaves often";
+    for(int round = 0; round < 3; round++)
+    {
+        for(int64_t key = order->thread_id; key < 4000; key += 2)
+        {
+            db_insert(order->table_id, key, value, sizeof(value));
+        }
+        for(int64_t key = order->thread_id; key < 4000; key += 2)
+        {
+            db_delete(order->table_id, key);
+        }
+    }
+    return nullptr;
+}
+
+TEST_F(ConcurrencyTest, LatchOrderTest)
+{
+    // readers latch pages from the root down, and so do writers, which
+    // keep the path until they split or merge. this ends without deadlock.
+    latch_order_arg_t args[6];
+    pthread_t threads[6];
+    for(int i = 0; i < 6; i++)
+    {
+        args[i] = {table_id, i};
+        pthread_create(&threads[i], 0,
+            (i < 2) ? insert_and_delete_records : find_records, &args[i]);
+    }
+    for(int i = 0; i < 6; i++) pthread_join(threads[i], nullptr);
+
+    char ret_val[120];
+    uint16_t val_size;
+    for(int64_t key = 0; key < 4000; key++)
+    {
+        ASSERT_EQ(db_find(table_id, key, ret_val, &val_size, 0), -1);
+    }
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, SecondaryIndexTest)
+{
+    // values have the key, and an attribute at offset 8.
+    std::map<int64_t, int32_t> attributes;
+    auto value_of = [](int64_t key, int32_t attribute)
+    {
+        std::string value(16, 0);
+        memcpy(&value[0], &key, 8);
+        memcpy(&value[8], &attribute, 4);
+        return value;
+    };
+    auto check_index = [&](int index_id, int32_t low, int32_t high)
+    {
+        std::vector<int64_t> keys, expected;
+        ASSERT_EQ(db_index_find(table_id, index_id, low, high, &keys), 0);
+        for(auto& [key, attribute] : attributes)
+        {
+            if(low <= attribute && attribute <= high) expected.push_back(key);
+        }
+        std::sort(keys.begin(), keys.end());
+        ASSERT_EQ(keys, expected);
+    };
+
+    for(int64_t key = 0; key < 1000; key++)
+    {
+        attributes[key] = (int32_t)(key % 50) - 25;
+        auto value = value_of(key, attributes[key]);
+        ASSERT_EQ(db_insert(table_id, key, value.data(), value.size()), 0);
+    }
+    // a value too short to have the attribute is not indexed.
+    ASSERT_EQ(db_insert(table_id, 5000, "short", 5), 0);
+
+    // the index is filled from the records of the table.
+    int index_id = db_create_index(table_id, 8);
+    ASSERT_GE(index_id, 0);
+    ASSERT_EQ(db_index_find(table_id, index_id + 1, 0, 0, nullptr), -1);
+    check_index(index_id, INT32_MIN, INT32_MAX);
+    check_index(index_id, -3, 3);
+
+    // keys sharing their lower 32 bits and the attribute.
+    std::vector<int64_t> batch_keys;
+    std::vector<std::string> batch_values;
+    for(int64_t key = 1; key <= 4; key++)
+    {
+        batch_keys.push_back((key << 32) | 7);
+        attributes[batch_keys.back()] = attributes[7];
+        batch_values.push_back(value_of(batch_keys.back(), attributes[7]));
+    }
+    std::vector<const char*> values;
+    std::vector<uint16_t> val_sizes;
+    for(auto& value : batch_values)
+    {
+        values.push_back(value.data());
+        val_sizes.push_back(value.size());
+    }
+    ASSERT_EQ(db_insert_batch(table_id, batch_keys, values, val_sizes), 4);
+    check_index(index_id, attributes[7], attributes[7]);
+
+    // a value in overflow pages is indexed by its attribute, too.
+    std::string large = value_of(2000, 1000);
+    large.resize(3000, 'x');
+    attributes[2000] = 1000;
+    ASSERT_EQ(db_upsert(table_id, 2000, large.data(), large.size()), 0);
+
+    uint16_t old_val_size;
+    for(int64_t key = 0; key < 1000; key += 7)
+    {
+        // the attribute moves, or stays with a longer value.
+        std::string value = value_of(key, (key % 2) ? attributes[key] : 100);
+        if(key % 2) value.resize(200, 'y');
+        else attributes[key] = 100;
+        ASSERT_EQ(db_update(table_id, key, &value[0], value.size(),
+            &old_val_size, 0), 0);
+    }
+    for(int64_t key = 3; key < 1000; key += 11)
+    {
+        ASSERT_EQ(db_delete(table_id, key), 0);
+        attributes.erase(key);
+    }
+    check_index(index_id, INT32_MIN, INT32_MAX);
+    check_index(index_id, 100, 1000);
+
+    // changes of an aborted trx are taken out of the index.
+    int trx_id = trx_begin();
+    std::string value = value_of(1, -1000);
+    ASSERT_EQ(db_update(table_id, 1, &value[0], value.size(),
+        &old_val_size, trx_id), 0);
+    ASSERT_EQ(db_delete(table_id, 2, trx_id), 0);
+    value = value_of(3000, 5);
+    ASSERT_EQ(db_insert(table_id, 3000, value.data(), value.size(), trx_id),
+        0);
+    std::vector<int64_t> keys;
+    ASSERT_EQ(db_index_find(table_id, index_id, -1000, -1000, &keys), 0);
+    ASSERT_EQ(keys, std::vector<int64_t>{ 1 });
+    trx_abort(trx_id);
+    check_index(index_id, INT32_MIN, INT32_MAX);
+
+    // the index stays in the file.
+    ASSERT_EQ(shutdown_db(), 0);
+    init_db(500);
+    table_id = open_table(pathname.c_str());
+    check_index(index_id, -10, 10);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, CoveringIndexTest)
+{
+    // values have an attribute at 0, and an amount at 4.
+    auto value_of = [](int32_t attribute, int64_t amount)
+    {
+        std::string value(40, 'v');
+        memcpy(&value[0], &attribute, 4);
+        memcpy(&value[4], &amount, 8);
+        return value;
+    };
+    auto amounts_of = [&](int index_id, int32_t attribute)
+    {
+        std::vector<int64_t> keys;
+        std::vector<std::string> included;
+        EXPECT_EQ(db_index_find(table_id, index_id, attribute, attribute,
+            &keys, &included), 0);
+        EXPECT_EQ(keys.size(), included.size());
+
+        std::map<int64_t, int64_t> amounts;
+        for(size_t i = 0; i < keys.size(); i++)
+        {
+            EXPECT_EQ(included[i].size(), 8);
+            memcpy(&amounts[keys[i]], included[i].data(), 8);
+        }
+        return amounts;
+    };
+
+    std::map<int64_t, int64_t> expected;
+    for(int64_t key = 0; key < 500; key++)
+    {
+        auto value = value_of(key % 10, key * 100);
+        ASSERT_EQ(db_insert(table_id, key, value.data(), value.size()), 0);
+        if(key % 10 == 3) expected[key] = key * 100;
+    }
+
+    ASSERT_EQ(db_create_index(table_id, 0, 4,
+        MAX_INDEX_INCLUDED_SIZE + 1), -1);
+    int index_id = db_create_index(table_id, 0, 4, 8);
+    ASSERT_GE(index_id, 0);
+    ASSERT_EQ(amounts_of(index_id, 3), expected);
+
+    // a change of the included bytes alone changes the entry.
+    uint16_t old_val_size;
+    auto value = value_of(3, -1);
+    ASSERT_EQ(db_update(table_id, 13, &value[0], value.size(),
+        &old_val_size, 0), 0);
+    expected[13] = -1;
+    ASSERT_EQ(amounts_of(index_id, 3), expected);
+
+    // and is undone by rollback.
+    int trx_id = trx_begin();
+    value = value_of(3, -2);
+    ASSERT_EQ(db_upsert(table_id, 23, value.data(), value.size(), trx_id), 0);
+    ASSERT_EQ(amounts_of(index_id, 3)[23], -2);
+    trx_abort(trx_id);
+    ASSERT_EQ(amounts_of(index_id, 3), expected);
+
+    // a value ending in the range has fewer included bytes.
+    ASSERT_EQ(db_insert(table_id, 1000, "\3\0\0\0abc", 7), 0);
+    std::vector<int64_t> keys;
+    std::vector<std::string> included;
+    ASSERT_EQ(db_index_find(table_id, index_id, 3, 3, &keys, &included), 0);
+    auto it = std::find(keys.begin(), keys.end(), 1000);
+    ASSERT_NE(it, keys.end());
+    ASSERT_EQ(included[it - keys.begin()], "abc");
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, KeyFilterTest)
+{
+    for(int64_t key = 0; key < 10000; key += 2)
+    {
+        ASSERT_EQ(db_insert(table_id, key, "even", 4), 0);
+    }
+    ASSERT_EQ(db_set_key_filter(table_id, true), 0);
+
+    // most keys which are not in the table are found missing without
+    // releasing(so reading) any page.
+    char ret_val[120];
+    uint16_t val_size;
+    int num_read = 0;
+    for(int64_t key = 1; key < 10000; key += 2)
+    {
+        uint64_t calling_count = buffer_manager->calling_count;
+        ASSERT_EQ(db_find(table_id, key, ret_val, &val_size, 0), -1);
+        if(buffer_manager->calling_count != calling_count) num_read++;
+    }
+    ASSERT_LT(num_read, 5000 / 20);
+
+    for(int64_t key = 0; key < 10000; key += 2)
+    {
+        ASSERT_EQ(db_find(table_id, key, ret_val, &val_size, 0), 0);
+    }
+
+    // keys added past the size of the filter make it built again.
+    std::vector<int64_t> keys;
+    std::vector<const char*> values;
+    std::vector<uint16_t> val_sizes;
+    for(int64_t key = 10001; key < 40000; key += 2)
+    {
+        keys.push_back(key);
+        values.push_back("odd");
+        val_sizes.push_back(3);
+    }
+    ASSERT_EQ(db_insert_batch(table_id, keys, values, val_sizes),
+        keys.size());
+    ASSERT_EQ(db_upsert(table_id, 1, "odd", 3), 0);
+
+    std::vector<int> offsets;
+    std::vector<uint16_t> found_sizes;
+    std::vector<char> found(keys.size() * 3);
+    ASSERT_EQ(db_find_many(table_id, keys, found.data(), found.size(),
+        &offsets, &found_sizes), keys.size());
+
+    // a deleted key comes back with rollback.
+    int trx_id = trx_begin();
+    ASSERT_EQ(db_delete(table_id, 4, trx_id), 0);
+    trx_abort(trx_id);
+    ASSERT_EQ(db_find(table_id, 4, ret_val, &val_size, 0), 0);
+
+    // the filter is built again when the table is opened.
+    ASSERT_EQ(shutdown_db(), 0);
+    init_db(500);
+    table_id = open_table(pathname.c_str());
+    ASSERT_EQ(db_find(table_id, 1, ret_val, &val_size, 0), 0);
+    ASSERT_EQ(db_find(table_id, 3, ret_val, &val_size, 0), -1);
+    ASSERT_EQ(db_delete(table_id, 3), -1);
+    ASSERT_EQ(db_find(table_id, 39999, ret_val, &val_size, 0), 0);
+
+    ASSERT_EQ(db_set_key_filter(table_id, false), 0);
+    ASSERT_EQ(db_find(table_id, 2, ret_val, &val_size, 0), 0);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, AdaptiveHashIndexTest)
+{
+    char value[120];
+    memset(value, 'a', sizeof(value));
+    for(int64_t key = 0; key < 30000; key += 10)
+    {
+        ASSERT_EQ(db_insert(table_id, key, value, 100), 0);
+    }
+
+    // hot keys get entries, and their lookups don't descend the tree.
+    char ret_val[120];
+    uint16_t val_size;
+    uint64_t hits, misses;
+    db_adaptive_hash_stats(&hits, &misses);
+    for(int i = 0; i < 10; i++)
+    {
+        for(int64_t key = 10000; key < 11000; key += 10)
+        {
+            ASSERT_EQ(db_find(table_id, key, ret_val, &val_size, 0), 0);
+            ASSERT_EQ(val_size, 100);
+        }
+    }
+    uint64_t new_hits, new_misses;
+    db_adaptive_hash_stats(&new_hits, &new_misses);
+    ASSERT_EQ(new_misses - misses, 100 * HASH_INDEX_HOT_LOOKUPS);
+    ASSERT_EQ(new_hits - hits, 100 * (10 - HASH_INDEX_HOT_LOOKUPS));
+
+    // the leaves of the hot keys are split, and then merged.
+    memset(value, 'b', sizeof(value));
+    for(int64_t key = 10000; key < 11000; key += 10)
+    {
+        for(int64_t other = key + 1; other < key + 10; other++)
+        {
+            ASSERT_EQ(db_insert(table_id, other, value, 120), 0);
+        }
+        ASSERT_EQ(db_find(table_id, key, ret_val, &val_size, 0), 0);
+        ASSERT_EQ(ret_val[0], 'a');
+    }
+    for(int64_t key = 10000; key < 11000; key += 10)
+    {
+        ASSERT_EQ(db_find(table_id, key + 5, ret_val, &val_size, 0), 0);
+        ASSERT_EQ(ret_val[0], 'b');
+    }
+    for(int64_t key = 10000; key < 11000; key += 10)
+    {
+        for(int64_t other = key + 1; other < key + 10; other++)
+        {
+            ASSERT_EQ(db_delete(table_id, other), 0);
+        }
+        ASSERT_EQ(db_find(table_id, key, ret_val, &val_size, 0), 0);
+        ASSERT_EQ(ret_val[0], 'a');
+    }
+    for(int64_t key = 10000; key < 11000; key += 10)
+    {
+        ASSERT_EQ(db_find(table_id, key, ret_val, &val_size, 0), 0);
+        ASSERT_EQ(ret_val[0], 'a');
+        ASSERT_EQ(db_find(table_id, key + 5, ret_val, &val_size, 0), -1);
+    }
+
+    // a deleted key isn't found by its entry.
+    ASSERT_EQ(db_delete(table_id, 10000), 0);
+    ASSERT_EQ(db_find(table_id, 10000, ret_val, &val_size, 0), -1);
+
+    db_set_adaptive_hash(false);
+    db_adaptive_hash_stats(&hits, &misses);
+    ASSERT_EQ(db_find(table_id, 10010, ret_val, &val_size, 0), 0);
+    db_adaptive_hash_stats(&new_hits, &new_misses);
+    ASSERT_EQ(new_hits, hits);
+    ASSERT_EQ(new_misses, misses);
+    db_set_adaptive_hash(true);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+struct cache_arg_t
+{
+    int64_t table_id;
+    int thread_id;
+    std::atomic<bool>* stop;
+};
+
+void* read_cached_records(void* arg)
+{
+    cache_arg_t* cache = (cache_arg_t*)arg;
+    std::mt19937 gen(cache->thread_id);
+    char ret_val[120];
+    uint16_t val_size;
+    while(cache->stop->load() == false)
+    {
+        db_find(cache->table_id, gen() % 200, ret_val, &val_size, 0);
+    }
+    return nullptr;
+}
+
+// each writer changes its own records, deleting and inserting some of them.
+void* change_cached_records(void* arg)
+{
+    cache_arg_t* cache = (cache_arg_t*)arg;
+    std::mt19937 gen(cache->thread_id);
+    for(int i = 1; i <= 5000; i++)
+    {
+        int64_t key = (gen() % 50) * 2 + cache->thread_id;
+        std::string value = std::to_string(i) + std::string(gen() % 100, 'v');
+        uint16_t old_size;
+        db_update(cache->table_id, key, (char*)value.c_str(), value.size(),
+            &old_size, 0);
+
+        if(i % 10 == 0)
+        {
+            db_delete(cache->table_id, key + 100);
+            if(gen() % 2 == 0)
+            {
+                db_insert(cache->table_id, key + 100, value.c_str(),
+                    value.size());
+            }
+        }
+    }
+    return nullptr;
+}
+
+TEST_F(ConcurrencyTest, RecordCacheTest)
+{
+    for(int64_t key = 0; key < 1000; key++)
+    {
+        std::string value = "value " + std::to_string(key);
+        ASSERT_EQ(db_insert(table_id, key, value.c_str(), value.size()), 0);
+    }
+    db_set_record_cache(4096);
+
+    // hot records are read without reading any page.
+    char ret_val[120];
+    uint16_t val_size;
+    ASSERT_EQ(db_find(table_id, 7, ret_val, &val_size, 0), 0);
+    uint64_t calling_count = buffer_manager->calling_count;
+    ASSERT_EQ(db_find(table_id, 7, ret_val, &val_size, 0), 0);
+    ASSERT_EQ(std::string(ret_val, val_size), "value 7");
+    uint16_t read_size;
+    ASSERT_EQ(db_read_value(table_id, 7, 6, ret_val, 10, &read_size), 0);
+    ASSERT_EQ(std::string(ret_val, read_size), "7");
+    ASSERT_EQ(buffer_manager->calling_count, calling_count);
+
+    // changes drop the values, and so do their rollbacks.
+    uint16_t old_size;
+    char new_value[] = "updated";
+    ASSERT_EQ(db_update(table_id, 7, new_value, 7, &old_size, 0), 0);
+    ASSERT_EQ(db_find(table_id, 7, ret_val, &val_size, 0), 0);
+    ASSERT_EQ(std::string(ret_val, val_size), "updated");
+
+    int trx_id = trx_begin();
+    char trx_value[] = "in trx";
+    ASSERT_EQ(db_update(table_id, 7, trx_value, 6, &old_size, trx_id), 0);
+    ASSERT_EQ(db_find(table_id, 7, ret_val, &val_size, trx_id), 0);
+    ASSERT_EQ(std::string(ret_val, val_size), "in trx");
+    ASSERT_EQ(db_delete(table_id, 8, trx_id), 0);
+    trx_abort(trx_id);
+    ASSERT_EQ(db_find(table_id, 7, ret_val, &val_size, 0), 0);
+    ASSERT_EQ(std::string(ret_val, val_size), "updated");
+    ASSERT_EQ(db_find(table_id, 8, ret_val, &val_size, 0), 0);
+    ASSERT_EQ(std::string(ret_val, val_size), "value 8");
+
+    ASSERT_EQ(db_upsert(table_id, 8, "upserted", 8), 0);
+    ASSERT_EQ(db_find(table_id, 8, ret_val, &val_size, 0), 0);
+    ASSERT_EQ(std::string(ret_val, val_size), "upserted");
+    ASSERT_EQ(db_delete(table_id, 8), 0);
+    ASSERT_EQ(db_find(table_id, 8, ret_val, &val_size, 0), -1);
+
+    // only the values read last are kept.
+    uint64_t hits, misses;
+    for(int64_t key = 0; key < 1000; key++)
+    {
+        db_find(table_id, key, ret_val, &val_size, 0);
+    }
+    db_record_cache_stats(&hits, &misses);
+    ASSERT_EQ(db_find(table_id, 0, ret_val, &val_size, 0), 0);
+    ASSERT_EQ(db_find(table_id, 999, ret_val, &val_size, 0), 0);
+    uint64_t new_hits, new_misses;
+    db_record_cache_stats(&new_hits, &new_misses);
+    ASSERT_EQ(new_hits - hits, 1);
+    ASSERT_EQ(new_misses - misses, 1);
+
+    db_set_record_cache(0);
+    ASSERT_EQ(db_find(table_id, 999, ret_val, &val_size, 0), 0);
+    db_record_cache_stats(&hits, &misses);
+    ASSERT_EQ(hits, new_hits);
+
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}
+
+TEST_F(ConcurrencyTest, RecordCacheConcurrentTest)
+{
+    for(int64_t key = 0; key < 200; key++)
+    {
+        std::string value = "value " + std::to_string(key);
+        ASSERT_EQ(db_insert(table_id, key, value.c_str(), value.size()), 0);
+    }
+    db_set_record_cache(1 << 16);
+
+    std::atomic<bool> stop(false);
+    cache_arg_t args[6];
+    pthread_t threads[6];
+    for(int i = 0; i < 6; i++)
+    {
+        args[i] = {table_id, i, &stop};
+        pthread_create(&threads[i], 0,
+            (i < 2) ? change_cached_records : read_cached_records, &args[i]);
+    }
+    pthread_join(threads[0], nullptr);
+    pthread_join(threads[1], nullptr);
+    stop = true;
+    for(int i = 2; i < 6; i++) pthread_join(threads[i], nullptr);
+
+    // no value read during the changes is left older than the leaf.
+    char cached[200][120];
+    uint16_t cached_size[200];
+    int cached_result[200];
+    for(int64_t key = 0; key < 200; key++)
+    {
+        cached_result[key] = db_find(table_id, key, cached[key],
+            &cached_size[key], 0);
+    }
+    db_set_record_cache(0);
+    for(int64_t key = 0; key < 200; key++)
+    {
+        char ret_val[120];
+        uint16_t val_size;
+        ASSERT_EQ(db_find(table_id, key, ret_val, &val_size, 0),
+            cached_result[key]) << key;
+        if(cached_result[key] < 0) continue;
+        ASSERT_EQ(std::string(ret_val, val_size),
+            std::string(cached[key], cached_size[key])) << key;
+    }
+    ASSERT_EQ(check_all_page_latch_unlock(), true) << "page lock remains!";
+}